@@ -0,0 +1,41 @@
+// generated by nob from scenes/default.scene, edit the scene instead
+#include "rt.h"
+
+const char scene_baked_path[] = "scenes/default.scene";
+
+hittable_t scene_prims[] = {
+	{.sphere = {SPHERE, {.x = 0, .y = 0, .z = -1}, 0.5}},
+	{.sphere = {SPHERE, {.x = -1, .y = 0, .z = -1}, 0.40000000000000002}},
+	{.sphere = {SPHERE, {.x = 0, .y = -100.5, .z = -1}, 100}},
+};
+const u64 scene_prim_count = 3;
+const bool scene_unrolled = true;
+
+static const sphere_t scene_order[] = {
+	{SPHERE, {.x = 0, .y = 0, .z = -1}, 0.5},
+	{SPHERE, {.x = -1, .y = 0, .z = -1}, 0.40000000000000002},
+	{SPHERE, {.x = 0, .y = -100.5, .z = -1}, 100},
+};
+
+KERNEL hit_t scene_hit(ray_t r, real_t mint, real_t maxt) {
+	hit_t result = {0};
+#pragma GCC unroll 64
+	for (u64 i = 0; i < 3; i++) {
+		hit_t hit = hit_sphere(scene_order[i], r, mint, maxt);
+		if (hit.is_hit) {
+			result = hit;
+			maxt = hit.t;
+		}
+	}
+	return result;
+}
+
+KERNEL bool scene_occluded(ray_t r, real_t mint, real_t maxt) {
+#pragma GCC unroll 64
+	for (u64 i = 0; i < 3; i++) {
+		if (occluded_sphere(scene_order[i], r, mint, maxt)) {
+			return true;
+		}
+	}
+	return false;
+}
@@ -0,0 +1,164 @@
+#include <unistd.h>
+
+#include "rt.h"
+
+// :instance
+instance_t instance_create(affine_t to_world, u32 blas) {
+	return (instance_t){.to_object = affine_inverse(to_world), .blas = blas};
+}
+
+static aabb_t instance_bounds(instance_t inst, const bvh_t* blas) {
+	if (blas->prim_count == 0) {
+		return aabb_empty();
+	}
+
+	affine_t to_world = affine_inverse(inst.to_object);
+	aabb_t	 local = blas->nodes[0].bounds;
+	aabb_t	 bounds = aabb_empty();
+
+	for (u32 corner = 0; corner < 8; corner++) {
+		vec3_t p = vec3(corner & 1 ? local.max.x : local.min.x, corner & 2 ? local.max.y : local.min.y,
+						corner & 4 ? local.max.z : local.min.z);
+		bounds = aabb_grow(bounds, affine_point(to_world, p));
+	}
+	return bounds;
+}
+
+static hit_t instance_hit(instance_t inst, const bvh_t* blas, ray_t r, real_t mint, real_t maxt) {
+	// the direction is not renormalized, so t means the same in both spaces
+	ray_t local = {
+		.origin = affine_point(inst.to_object, r.origin),
+		.direction = affine_vector(inst.to_object, r.direction),
+	};
+
+	hit_t hit = bvh_hit(blas, local, mint, maxt);
+	if (!hit.is_hit) {
+		return hit;
+	}
+
+	hit.point = vec3_muladd(r.direction, (hit.t), r.origin);
+	hit.normal = vec3_norm(affine_vector_transposed(inst.to_object, hit.normal));
+	return hit;
+}
+
+static bool instance_occluded(instance_t inst, const bvh_t* blas, ray_t r, real_t mint, real_t maxt) {
+	ray_t local = {
+		.origin = affine_point(inst.to_object, r.origin),
+		.direction = affine_vector(inst.to_object, r.direction),
+	};
+	return bvh_occluded(blas, local, mint, maxt);
+}
+
+tlas_t tlas_build(context_t ctx, instance_view_t instances, bvh_view_t blases) {
+	tlas_t tlas = {
+		.blases = blases.items,
+		.blas_count = blases.count,
+		._allocator = ctx.allocator,
+	};
+
+	aabb_t* bounds = alloc(ctx, instances.count * sizeof(aabb_t) + 1);
+	u32*	indices = alloc(ctx, instances.count * sizeof(u32) + 1);
+	for (u64 i = 0; i < instances.count; i++) {
+		try instances.items[i].blas >= blases.count or_fail("instance references a missing blas");
+		bounds[i] = instance_bounds(instances.items[i], &blases.items[instances.items[i].blas]);
+	}
+
+	tlas.node_count = bvh_build_nodes(ctx, bounds, indices, instances.count, &tlas.nodes);
+
+	tlas.instances = alloc(ctx, instances.count * sizeof(instance_t) + 1);
+	tlas.instance_count = instances.count;
+	for (u64 i = 0; i < instances.count; i++) {
+		tlas.instances[i] = instances.items[indices[i]];
+	}
+
+	dealloc(ctx, bounds);
+	dealloc(ctx, indices);
+	return tlas;
+}
+
+void tlas_destroy(tlas_t* tlas) {
+	allocator_dealloc(tlas->_allocator, tlas->nodes);
+	allocator_dealloc(tlas->_allocator, tlas->instances);
+	*tlas = (tlas_t){0};
+}
+
+KERNEL hit_t tlas_hit(const tlas_t* tlas, ray_t r, real_t mint, real_t maxt) {
+	hit_t result = {0};
+	if (tlas->instance_count == 0) {
+		return result;
+	}
+
+	vec3_t inv_dir = vec3(1 / r.direction.x, 1 / r.direction.y, 1 / r.direction.z);
+
+	u32 stack[BVH_MAX_DEPTH];
+	u32 top = 0;
+	stack[top++] = 0;
+
+	while (top > 0) {
+		u32				  idx = stack[--top];
+		const bvh_node_t* node = &tlas->nodes[idx];
+
+		if (!aabb_hit(node->bounds, r.origin, inv_dir, mint, maxt)) {
+			continue;
+		}
+
+		if (node->count != 0) {
+			for (u32 i = node->offset; i < node->offset + node->count; i++) {
+				instance_t inst = tlas->instances[i];
+				hit_t	   this_hit = instance_hit(inst, &tlas->blases[inst.blas], r, mint, maxt);
+				if (this_hit.is_hit) {
+					result = this_hit;
+					maxt = this_hit.t;
+				}
+			}
+			continue;
+		}
+
+		u32 near = idx + 1;
+		u32 far = node->offset;
+		if (vec3_data(&r.direction)[node->axis] < 0) {
+			near = node->offset;
+			far = idx + 1;
+		}
+		stack[top++] = far;
+		stack[top++] = near;
+	}
+
+	return result;
+}
+
+KERNEL bool tlas_occluded(const tlas_t* tlas, ray_t r, real_t mint, real_t maxt) {
+	if (tlas->instance_count == 0) {
+		return false;
+	}
+
+	vec3_t inv_dir = vec3(1 / r.direction.x, 1 / r.direction.y, 1 / r.direction.z);
+
+	u32 stack[BVH_MAX_DEPTH];
+	u32 top = 0;
+	stack[top++] = 0;
+
+	while (top > 0) {
+		u32				  idx = stack[--top];
+		const bvh_node_t* node = &tlas->nodes[idx];
+
+		if (!aabb_hit(node->bounds, r.origin, inv_dir, mint, maxt)) {
+			continue;
+		}
+
+		if (node->count != 0) {
+			for (u32 i = node->offset; i < node->offset + node->count; i++) {
+				instance_t inst = tlas->instances[i];
+				if (instance_occluded(inst, &tlas->blases[inst.blas], r, mint, maxt)) {
+					return true;
+				}
+			}
+			continue;
+		}
+
+		stack[top++] = node->offset;
+		stack[top++] = idx + 1;
+	}
+
+	return false;
+}
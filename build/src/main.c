@@ -0,0 +1,265 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "rt.h"
+
+vec3_t gamma_correction(vec3_t v) {
+	return (vec3_t){
+		.x = v.x > 0 ? sqrt(v.x) : 0,
+		.y = v.y > 0 ? sqrt(v.y) : 0,
+		.z = v.z > 0 ? sqrt(v.z) : 0,
+	};
+}
+
+// the n x n samples of a pixel, row by row
+void pixel_samples(vec3_t pix_center, vec3_t camera_center, vec3_t pix_delta_u, vec3_t pix_delta_v, u32 n, ray_t* samples) {
+	const f64 ysamples = n;
+	const f64 xsamples = n;
+
+	for (i64 ry = 0; ry < n; ry++) {
+		for (i64 rx = 0; rx < n; rx++) {
+			vec3_t center = pix_center;
+			vec3p_add(&center, vec3_mul(pix_delta_u, ry / ysamples - 0.5));
+			vec3p_add(&center, vec3_mul(pix_delta_v, rx / xsamples - 0.5));
+
+			vec3_t ray_dir = vec3_sub(center, camera_center);
+
+			samples[ry * n + rx] = (ray_t){
+				.origin = camera_center,
+				.direction = ray_dir,
+			};
+		}
+	}
+}
+
+int main(int argc, char** argv) {
+	context_t ctx = context_default();
+	printf("[INFO] kernels: %s\n", kernel_isa());
+
+	// `main [mode] [file.scene]`, any argument that isn't a mode is the scene
+	const char* scene_file = "scenes/default.scene";
+	bool		wavefront = false, tiles = false, baked = false;
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "wavefront")) {
+			// breadth first, one image row of paths at a time
+			wavefront = true;
+		} else if (!strcmp(argv[i], "tiles")) {
+			// camera rays against per tile culled lists instead of the accelerator
+			tiles = true;
+		} else if (!strcmp(argv[i], "baked")) {
+			// the spheres compiled into scene_hit from scenes/default.scene, while there are few enough
+			// to be unrolled; the camera and settings still come from the scene file
+			baked = scene_unrolled;
+		} else {
+			scene_file = argv[i];
+		}
+	}
+
+	scene_t scene = {0};
+	f64		load_start = time_now();
+	error_t err = scene_load(ctx, scene_file, &scene);
+	try err != NO_ERROR or_failf("failed loading %s:%lu (error %d)", scene_file, scene.error_line, err);
+	printf("[INFO] scene: %s, %lu prims in %.3fs\n", scene_file, scene.prims.count, time_now() - load_start);
+
+	const u64 width = scene.width;
+	const u64 height = scene.height;
+	const u32 n = scene.samples;
+
+	// Camera
+	vec3_t camera_center = scene.camera.center;
+	vec3_t focal_length = {0, 0, scene.camera.focal_length};
+
+	// Viewport
+	f64 viewport_height = scene.camera.viewport_height;
+	f64 viewport_width = viewport_height * ((f64)width / height);
+
+	vec3_t viewport_u = {viewport_width, 0, 0};
+	vec3_t viewport_v = {0, -viewport_height, 0};
+
+	vec3_t pix_delta_u = vec3_div(viewport_u, width);
+	vec3_t pix_delta_v = vec3_div(viewport_v, height);
+
+	vec3_t viewport_upper_left = vec3_muladd(vec3_add(viewport_u, viewport_v), -(1 / (real_t)2), vec3_sub(camera_center, focal_length));
+	vec3_t pix00_location = vec3_muladd(vec3_add(pix_delta_u, pix_delta_v), (1 / (real_t)2), viewport_upper_left);
+
+	// World
+	hittable_view_t spheres_view = view_darr(scene.prims);
+
+	// Acceleration structure, a bvh is reused from the cache while the world is unchanged
+	const char* cache_path = "scene.bvh";
+	const u64	cache_key = hittables_hash(spheres_view);
+
+	world_t world = {.accel.type = accel_choose(spheres_view)};
+	if (baked) {
+		world.accel = (accel_t){.type = ACCEL_BAKED, .baked = {scene_hit, scene_occluded}};
+	} else if (world.accel.type != ACCEL_BVH) {
+		world.accel = accel_build(ctx, world.accel.type, spheres_view);
+	} else if (bvh_cache_load(cache_path, cache_key, &world.accel.bvh) != NO_ERROR) {
+		world.accel.bvh = bvh_build(ctx, spheres_view);
+
+		const int fd = open(cache_path, O_CREAT | O_WRONLY | O_TRUNC, 0644);
+		try fd < 0 || bvh_cache_write(&world.accel.bvh, cache_key, fd) or_fail("failed writing bvh cache");
+		close(fd);
+	}
+
+	image_t* img = image_create(ctx, width, height);
+
+	// render the image
+
+	const u64	spp = n * n;
+	wavefront_t wf = {0};
+	ray_t*		row_samples = null;
+	u32*		row_pixels = null;
+	vec3_t*		row_colors = null;
+
+	hittable_set_t	 scene_set = {0}, tile_set = {0};
+	gbuffer_pixel_t* gbuffer = null;
+
+	ray_t* samples = alloc(ctx, spp * sizeof(ray_t));
+	hit_t* hits = alloc(ctx, spp * sizeof(hit_t));
+
+	if (tiles) {
+		scene_set = hittable_set_build(ctx, spheres_view);
+		tile_set = hittable_set_build(ctx, spheres_view);
+	}
+	if (!tiles && !wavefront) {
+		// g-buffer pass, a few probe rays per pixel decide how the rest of its samples are traced
+		gbuffer = alloc(ctx, width * height * sizeof(gbuffer_pixel_t));
+		for (u64 i = 0; i < height; i++) {
+			for (u64 j = 0; j < width; j++) {
+				vec3_t pix_center = pix00_location;
+				vec3p_add(&pix_center, vec3_mul(pix_delta_u, i));
+				vec3p_add(&pix_center, vec3_mul(pix_delta_v, j));
+
+				pixel_samples(pix_center, camera_center, pix_delta_u, pix_delta_v, n, samples);
+				gbuffer[i * width + j] = gbuffer_probe(&world, samples, n, n, RAY_MINT, RAY_MAXT);
+			}
+		}
+	}
+	if (wavefront) {
+		wf = wavefront_create(ctx, width * spp);
+		row_samples = alloc(ctx, width * spp * sizeof(ray_t));
+		row_pixels = alloc(ctx, width * spp * sizeof(u32));
+		row_colors = alloc(ctx, width * sizeof(vec3_t));
+	}
+
+	for (u64 i = 0; i < height; i++) {
+		// a band of tiles every TILE_SIZE rows
+		if (tiles) {
+			if (i % TILE_SIZE != 0) {
+				continue;
+			}
+			u64 rows = height - i < TILE_SIZE ? height - i : TILE_SIZE;
+
+			for (u64 tj = 0; tj < width; tj += TILE_SIZE) {
+				u64 cols = width - tj < TILE_SIZE ? width - tj : TILE_SIZE;
+
+				// the samples stay within half a pixel of the centers
+				vec3_t corner = pix00_location;
+				vec3p_add(&corner, vec3_mul(pix_delta_u, i - 0.5));
+				vec3p_add(&corner, vec3_mul(pix_delta_v, tj - 0.5));
+
+				frustum_t f = frustum_create(camera_center, corner, vec3_mul(pix_delta_u, rows), vec3_mul(pix_delta_v, cols));
+				tile_cull_set(&f, &scene_set, &tile_set);
+
+				for (u64 y = i; y < i + rows; y++) {
+					for (u64 x = tj; x < tj + cols; x++) {
+						vec3_t pix_center = pix00_location;
+						vec3p_add(&pix_center, vec3_mul(pix_delta_u, y));
+						vec3p_add(&pix_center, vec3_mul(pix_delta_v, x));
+
+						pixel_samples(pix_center, camera_center, pix_delta_u, pix_delta_v, n, samples);
+
+						vec3_t color = {0};
+						for (u64 s = 0; s < spp; s++) {
+							hit_t hit = hit_set(&tile_set, samples[s], RAY_MINT, RAY_MAXT);
+							vec3p_add(&color, ray_color_hit(samples[s], hit, &world, scene.bounces));
+						}
+						img->data[y * img->w + x] = vec3_to_color(gamma_correction(vec3_div(color, spp)));
+					}
+				}
+			}
+			continue;
+		}
+
+		if (wavefront) {
+			for (u64 j = 0; j < width; j++) {
+				vec3_t pix_center = pix00_location;
+				vec3p_add(&pix_center, vec3_mul(pix_delta_u, i));
+				vec3p_add(&pix_center, vec3_mul(pix_delta_v, j));
+
+				pixel_samples(pix_center, camera_center, pix_delta_u, pix_delta_v, n, row_samples + j * spp);
+				for (u64 s = 0; s < spp; s++) {
+					row_pixels[j * spp + s] = j;
+				}
+				row_colors[j] = (vec3_t){0};
+			}
+
+			wavefront_render(&wf, &world, row_samples, row_pixels, width * spp, scene.bounces, row_colors);
+
+			for (u64 j = 0; j < width; j++) {
+				vec3_t color = vec3_div(row_colors[j], spp);
+				img->data[i * img->w + j] = vec3_to_color(gamma_correction(color));
+			}
+			continue;
+		}
+
+		for (u64 j = 0; j < width; j++) {
+			vec3_t pix_center = pix00_location;
+			vec3p_add(&pix_center, vec3_mul(pix_delta_u, i));
+			vec3p_add(&pix_center, vec3_mul(pix_delta_v, j));
+
+			vec3_t color = {0};
+			u64	   rays = 0;
+
+			pixel_samples(pix_center, camera_center, pix_delta_u, pix_delta_v, n, samples);
+
+			// primary rays are coherent, they go through the world together unless the g-buffer says otherwise
+			gbuffer_hit_block(&world, gbuffer[i * width + j], samples, n, n, RAY_MINT, RAY_MAXT, hits);
+
+			for (u64 s = 0; s < spp; s++) {
+				vec3_t pix_color = ray_color_hit(samples[s], hits[s], &world, scene.bounces);
+
+				vec3p_add(&color, pix_color);
+				rays++;
+			}
+			vec3p_div(&color, rays);
+			color = gamma_correction(color);
+
+			img->data[i * img->w + j] = vec3_to_color(color);
+		}
+	}
+
+	dealloc(ctx, samples);
+	dealloc(ctx, hits);
+	if (tiles) {
+		hittable_set_destroy(&scene_set);
+		hittable_set_destroy(&tile_set);
+	}
+	if (gbuffer) {
+		dealloc(ctx, gbuffer);
+	}
+	if (wavefront) {
+		wavefront_destroy(&wf);
+		dealloc(ctx, row_samples);
+		dealloc(ctx, row_pixels);
+		dealloc(ctx, row_colors);
+	}
+
+	/* create tga */ {
+		const int fd = open("output.tga", O_CREAT | O_WRONLY | O_TRUNC, 0644);
+
+		try image_write_tga(img, fd) or_fail("failed writing tga");
+		close(fd);
+	}
+
+	image_destroy(img);
+	accel_destroy(&world.accel);
+	scene_destroy(&scene);
+	// write(STDOUT_FILENO, "-\n-\n-\n", 6);
+
+	return 0;
+}
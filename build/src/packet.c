@@ -0,0 +1,246 @@
+#include <unistd.h>
+
+#include "rt.h"
+
+// :packet
+void packet_init(packet_t* p, const ray_t* rays, real_t maxt) {
+	p->has_frustum = true;
+
+	for (u32 i = 0; i < PACKET_SIZE; i++) {
+		p->ox[i] = rays[i].origin.x, p->oy[i] = rays[i].origin.y, p->oz[i] = rays[i].origin.z;
+		p->dx[i] = rays[i].direction.x, p->dy[i] = rays[i].direction.y, p->dz[i] = rays[i].direction.z;
+		p->idx[i] = 1 / p->dx[i], p->idy[i] = 1 / p->dy[i], p->idz[i] = 1 / p->dz[i];
+		p->t[i] = maxt;
+		p->prim[i] = PACKET_MISS;
+
+		vec3_t d = vec3_sub(rays[i].origin, rays[0].origin);
+		if (vec3_len2(d) != 0) {
+			p->has_frustum = false;
+		}
+	}
+
+	if (!p->has_frustum) {
+		return;
+	}
+
+	// corners in winding order, each side plane holds two neighbouring corner rays
+	const u32 corners[4] = {0, PACKET_DIM - 1, PACKET_SIZE - 1, PACKET_SIZE - PACKET_DIM};
+	vec3_t	  center = {0};
+	for (u32 i = 0; i < PACKET_SIZE; i++) {
+		vec3p_add(&center, rays[i].direction);
+	}
+
+	for (u32 i = 0; i < 4; i++) {
+		vec3_t n = vec3_cross(rays[corners[i]].direction, rays[corners[(i + 1) % 4]].direction);
+		if (vec3_dot(n, center) < 0) {
+			n = vec3_neg(n);
+		}
+		p->planes[i] = n;
+
+		// rays that aren't laid out as a block get no culling, just the per lane tests
+		for (u32 lane = 0; lane < PACKET_SIZE; lane++) {
+			if (vec3_dot(n, rays[lane].direction) < -1e-12 * vec3_len2(n)) {
+				p->has_frustum = false;
+			}
+		}
+	}
+}
+
+// true when the box is fully outside one of the side planes
+static bool packet_frustum_culls(const packet_t* p, aabb_t b) {
+	vec3_t origin = vec3(p->ox[0], p->oy[0], p->oz[0]);
+
+	for (u32 i = 0; i < 4; i++) {
+		vec3_t n = p->planes[i];
+
+		// corner of the box furthest along the plane normal
+		vec3_t far = vec3(n.x > 0 ? b.max.x : b.min.x, n.y > 0 ? b.max.y : b.min.y, n.z > 0 ? b.max.z : b.min.z);
+		if (vec3_dot(n, vec3_sub(far, origin)) < 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// early out on the first lane that hits, coherent packets rarely need more than one test
+static bool packet_hits_box(const packet_t* p, aabb_t b, real_t mint) {
+	for (u32 i = 0; i < PACKET_SIZE; i++) {
+		real_t t0x = (b.min.x - p->ox[i]) * p->idx[i], t1x = (b.max.x - p->ox[i]) * p->idx[i];
+		real_t t0y = (b.min.y - p->oy[i]) * p->idy[i], t1y = (b.max.y - p->oy[i]) * p->idy[i];
+		real_t t0z = (b.min.z - p->oz[i]) * p->idz[i], t1z = (b.max.z - p->oz[i]) * p->idz[i];
+
+		real_t near = max_real(mint, max_real(min_real(t0x, t1x), max_real(min_real(t0y, t1y), min_real(t0z, t1z))));
+		real_t far = min_real(p->t[i], min_real(max_real(t0x, t1x), min_real(max_real(t0y, t1y), max_real(t0z, t1z))));
+		if (near <= far) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// same math as hit_sphere, for every lane at once
+KERNEL static void packet_hit_sphere(packet_t* p, sphere_t s, u32 prim, real_t mint) {
+	for (u32 i = 0; i < PACKET_SIZE; i++) {
+		real_t ocx = s.center.x - p->ox[i], ocy = s.center.y - p->oy[i], ocz = s.center.z - p->oz[i];
+
+		real_t a = p->dx[i] * p->dx[i] + p->dy[i] * p->dy[i] + p->dz[i] * p->dz[i];
+		real_t h = p->dx[i] * ocx + p->dy[i] * ocy + p->dz[i] * ocz;
+		real_t c = ocx * ocx + ocy * ocy + ocz * ocz - s.radius * s.radius;
+
+		real_t ha = h / a;
+		real_t lx = ocx - p->dx[i] * ha, ly = ocy - p->dy[i] * ha, lz = ocz - p->dz[i] * ha;
+		real_t discriminant = a * (s.radius * s.radius - (lx * lx + ly * ly + lz * lz));
+		real_t sqrt_ = real_sqrt(max_real(discriminant, 0));
+
+		// the far root only counts when the near one is behind mint
+		real_t q = h < 0 ? h - sqrt_ : h + sqrt_;
+		real_t near = min_real(c / q, q / a), far = max_real(c / q, q / a);
+		real_t root = near > mint ? near : far;
+
+		bool hit = discriminant >= 0 && q != 0 && root > mint && root < p->t[i];
+		p->t[i] = hit ? root : p->t[i];
+		p->prim[i] = hit ? prim : p->prim[i];
+	}
+}
+
+KERNEL void packet_hit_bvh(const bvh_t* bvh, packet_t* p, real_t mint) {
+	if (bvh->prim_count == 0) {
+		return;
+	}
+
+	u32 stack[BVH_MAX_DEPTH];
+	u32 top = 0;
+	stack[top++] = 0;
+
+	while (top > 0) {
+		u32				  idx = stack[--top];
+		const bvh_node_t* node = &bvh->nodes[idx];
+
+		if (p->has_frustum && packet_frustum_culls(p, node->bounds)) {
+			continue;
+		}
+		if (!packet_hits_box(p, node->bounds, mint) || !bvh_node_valid(bvh, idx, top)) {
+			continue;
+		}
+
+		if (node->count != 0) {
+			for (u32 i = node->offset; i < node->offset + node->count; i++) {
+				switch (bvh->prims[i].type) {
+#define X(kind, name)                                          \
+	case kind:                                                 \
+		packet_hit_##name(p, bvh->prims[i].name, i, mint); \
+		break;
+					HITTABLE_KINDS(X)
+#undef X
+				}
+			}
+			continue;
+		}
+
+		// the packet is coherent, the first lane decides the order for everyone
+		real_t dir[3] = {p->dx[0], p->dy[0], p->dz[0]};
+		u32 near = idx + 1;
+		u32 far = node->offset;
+		if (dir[node->axis] < 0) {
+			near = node->offset;
+			far = idx + 1;
+		}
+		stack[top++] = far;
+		stack[top++] = near;
+	}
+}
+
+hit_t packet_lane_hit(const bvh_t* bvh, const packet_t* p, u32 lane, real_t mint, real_t maxt) {
+	if (p->prim[lane] == PACKET_MISS) {
+		return (hit_t){0};
+	}
+
+	// only the winning primitive is intersected again, to fill in the rest of hit_t
+	ray_t r = {
+		.origin = vec3(p->ox[lane], p->oy[lane], p->oz[lane]),
+		.direction = vec3(p->dx[lane], p->dy[lane], p->dz[lane]),
+	};
+	return hit_hittable(bvh->prims[p->prim[lane]], r, mint, maxt);
+}
+
+// hit points and normals of the sphere lanes at once, from the t traversal found
+// instead of intersecting each winner again like packet_lane_hit
+static void packet_resolve_sphere(const bvh_t* bvh, const packet_t* p, hit_t* out) {
+	bool   lane[PACKET_SIZE];
+	real_t centerx[PACKET_SIZE], centery[PACKET_SIZE], centerz[PACKET_SIZE], inv_radius[PACKET_SIZE];
+	for (u32 i = 0; i < PACKET_SIZE; i++) {
+		// the other lanes run on a unit sphere at the origin and are dropped below
+		lane[i] = p->prim[i] != PACKET_MISS && bvh->prims[p->prim[i]].type == SPHERE;
+		sphere_t s = lane[i] ? bvh->prims[p->prim[i]].sphere : (sphere_t){.radius = 1};
+		centerx[i] = s.center.x, centery[i] = s.center.y, centerz[i] = s.center.z;
+		inv_radius[i] = 1 / s.radius;
+	}
+
+	real_t pointx[PACKET_SIZE], pointy[PACKET_SIZE], pointz[PACKET_SIZE];
+	real_t normalx[PACKET_SIZE], normaly[PACKET_SIZE], normalz[PACKET_SIZE];
+	do { _Pragma("omp simd") for (u64 vecmath_i = 0; vecmath_i < (PACKET_SIZE); vecmath_i++) { pointx[vecmath_i] = (p->ox[vecmath_i] + (p->dx[vecmath_i] * p->t[vecmath_i])); pointy[vecmath_i] = (p->oy[vecmath_i] + (p->dy[vecmath_i] * p->t[vecmath_i])); pointz[vecmath_i] = (p->oz[vecmath_i] + (p->dz[vecmath_i] * p->t[vecmath_i])); normalx[vecmath_i] = ((pointx[vecmath_i] - centerx[vecmath_i]) * inv_radius[vecmath_i]); normaly[vecmath_i] = ((pointy[vecmath_i] - centery[vecmath_i]) * inv_radius[vecmath_i]); normalz[vecmath_i] = ((pointz[vecmath_i] - centerz[vecmath_i]) * inv_radius[vecmath_i]); } } while (0);
+
+	for (u32 i = 0; i < PACKET_SIZE; i++) {
+		if (!lane[i]) {
+			continue;
+		}
+
+		// same orientation rule as hit_sphere
+		vec3_t direction = vec3(p->dx[i], p->dy[i], p->dz[i]);
+		vec3_t outward_normal = vec3(normalx[i], normaly[i], normalz[i]);
+		out[i] = (hit_t){
+			.is_hit = true,
+			.t = p->t[i],
+			.point = vec3(pointx[i], pointy[i], pointz[i]),
+			.is_front_face = vec3_dot(direction, outward_normal),
+		};
+		out[i].normal = out[i].is_front_face ? outward_normal : vec3_neg(outward_normal);
+	}
+}
+
+// every lane, each kind fills in the lanes whose winner is one of its primitives
+KERNEL void packet_resolve(const bvh_t* bvh, const packet_t* p, hit_t* out) {
+	for (u32 i = 0; i < PACKET_SIZE; i++) {
+		if (p->prim[i] == PACKET_MISS) {
+			out[i] = (hit_t){0};
+		}
+	}
+#define X(kind, name) packet_resolve_##name(bvh, p, out);
+	HITTABLE_KINDS(X)
+#undef X
+}
+
+KERNEL void world_hit_block(const world_t* w, const ray_t* rays, u64 width, u64 height, real_t mint, real_t maxt, hit_t* out) {
+	bool packets = w->accel.type == ACCEL_BVH && w->tlas.instance_count == 0;
+	packets = packets && width % PACKET_DIM == 0 && height % PACKET_DIM == 0;
+
+	if (!packets) {
+		for (u64 i = 0; i < width * height; i++) {
+			out[i] = world_hit(w, rays[i], mint, maxt);
+		}
+		return;
+	}
+
+	for (u64 by = 0; by < height; by += PACKET_DIM) {
+		for (u64 bx = 0; bx < width; bx += PACKET_DIM) {
+			ray_t block[PACKET_SIZE];
+			for (u32 y = 0; y < PACKET_DIM; y++) {
+				for (u32 x = 0; x < PACKET_DIM; x++) {
+					block[y * PACKET_DIM + x] = rays[(by + y) * width + bx + x];
+				}
+			}
+
+			packet_t p;
+			hit_t	 hits[PACKET_SIZE];
+			packet_init(&p, block, maxt);
+			packet_hit_bvh(&w->accel.bvh, &p, mint);
+			packet_resolve(&w->accel.bvh, &p, hits);
+
+			for (u32 y = 0; y < PACKET_DIM; y++) {
+				for (u32 x = 0; x < PACKET_DIM; x++) {
+					out[(by + y) * width + bx + x] = hits[y * PACKET_DIM + x];
+				}
+			}
+		}
+	}
+}
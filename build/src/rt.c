@@ -0,0 +1,437 @@
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "rt.h"
+
+// :hittable
+// Both roots of the ray sphere quadratic, near <= far. The discriminant comes
+// from the distance between the center and the line, and the roots from
+// c / q and q / a, so neither subtracts two nearly equal values: with f32
+// the textbook h * h - a * c and h - sqrt loses most of its digits.
+static inline bool sphere_roots(sphere_t s, ray_t r, real_t* near, real_t* far) {
+	vec3_t oc = vec3_sub(s.center, r.origin);
+
+	real_t a = vec3_len2(r.direction);
+	real_t h = vec3_dot(r.direction, oc);
+	real_t c = vec3_len2(oc) - s.radius * s.radius;
+
+	vec3_t l = vec3_sub(oc, vec3_mul(r.direction, h / a));
+	real_t discriminant = a * (s.radius * s.radius - vec3_len2(l));
+	if (discriminant < 0) {
+		return false;
+	}
+
+	real_t sqrt_ = real_sqrt(discriminant);
+	real_t q = h < 0 ? h - sqrt_ : h + sqrt_;
+	if (q == 0) {
+		return false;
+	}
+
+	*near = min_real(c / q, q / a);
+	*far = max_real(c / q, q / a);
+	return true;
+}
+
+// inline, as sphere_roots, so every traversal kernel takes it into each of its isa clones
+inline hit_t hit_sphere(sphere_t s, ray_t r, real_t mint, real_t maxt) {
+	real_t near, far;
+	if (!sphere_roots(s, r, &near, &far)) {
+		return (hit_t){.is_hit = false};
+	}
+
+	// for the closest point in range
+	real_t root = near;
+
+	if (root <= mint || maxt <= root) {
+		root = far;
+
+		if (root <= mint || maxt <= root) {
+			return (hit_t){.is_hit = false};  // no hit in range
+		}
+	}
+
+	hit_t hit = {.is_hit = true};
+	hit.t = root;
+	hit.point = vec3_muladd(r.direction, (root), r.origin);
+
+	vec3_t outward_normal = vec3_div(vec3_sub(hit.point, s.center), s.radius);
+	hit.is_front_face = vec3_dot(r.direction, outward_normal);
+	hit.normal = hit.is_front_face ? outward_normal : vec3_neg(outward_normal);
+
+	return hit;
+}
+
+hit_t hit_hittable(hittable_t h, ray_t r, real_t mint, real_t maxt) {
+	switch (h.type) {
+#define X(kind, name) \
+	case kind:        \
+		return hit_##name(h.name, r, mint, maxt);
+		HITTABLE_KINDS(X)
+#undef X
+	}
+	unreachable;
+}
+
+KERNEL hit_t hit_many(hittable_view_t hs, ray_t r, real_t mint, real_t maxt) {
+	hit_t result = {0};
+
+	for (u64 i = 0; i < hs.count; i++) {
+		hit_t this_hit = hit_hittable(hs.items[i], r, mint, maxt);
+		if (this_hit.is_hit) {
+			result = this_hit;
+			maxt = this_hit.t;
+		}
+	}
+
+	return result;
+}
+
+u32 crossings_sphere(sphere_t s, ray_t r, real_t mint, real_t maxt, crossing_t* out) {
+	real_t roots[2];
+	if (!sphere_roots(s, r, &roots[0], &roots[1])) {
+		return 0;
+	}
+
+	u32 n = 0;
+	for (u32 i = 0; i < 2; i++) {
+		real_t t = roots[i];
+		if (mint < t && t < maxt) {
+			vec3_t point = vec3_muladd(r.direction, (t), r.origin);
+			out[n++] = (crossing_t){.t = t, .normal = vec3_div(vec3_sub(point, s.center), s.radius), .entering = i == 0};
+		}
+	}
+	return n;
+}
+
+u32 crossings_hittable(hittable_t h, ray_t r, real_t mint, real_t maxt, crossing_t* out) {
+	switch (h.type) {
+#define X(kind, name) \
+	case kind:        \
+		return crossings_##name(h.name, r, mint, maxt, out);
+		HITTABLE_KINDS(X)
+#undef X
+	}
+	unreachable;
+}
+
+bool occluded_sphere(sphere_t s, ray_t r, real_t mint, real_t maxt) {
+	real_t near, far;
+	if (!sphere_roots(s, r, &near, &far)) {
+		return false;
+	}
+
+	// either root in range will do, the point and normal are never needed
+	return (mint < near && near < maxt) || (mint < far && far < maxt);
+}
+
+bool occluded_hittable(hittable_t h, ray_t r, real_t mint, real_t maxt) {
+	switch (h.type) {
+#define X(kind, name) \
+	case kind:        \
+		return occluded_##name(h.name, r, mint, maxt);
+		HITTABLE_KINDS(X)
+#undef X
+	}
+	unreachable;
+}
+
+bool occluded_many(hittable_view_t hs, ray_t r, real_t mint, real_t maxt) {
+	for (u64 i = 0; i < hs.count; i++) {
+		if (occluded_hittable(hs.items[i], r, mint, maxt)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+real_t sphere_distance(sphere_t s, vec3_t p) {
+	return max_real(vec3_len(vec3_sub(p, s.center)) - s.radius, 0);
+}
+
+real_t distance_hittable(hittable_t h, vec3_t p) {
+	switch (h.type) {
+#define X(kind, name) \
+	case kind:        \
+		return name##_distance(h.name, p);
+		HITTABLE_KINDS(X)
+#undef X
+	}
+	unreachable;
+}
+
+static aabb_t sphere_bounds(sphere_t s) {
+	vec3_t r = vec3(s.radius, s.radius, s.radius);
+	return (aabb_t){.min = vec3_sub(s.center, r), .max = vec3_add(s.center, r)};
+}
+
+aabb_t hittable_bounds(hittable_t h) {
+	switch (h.type) {
+#define X(kind, name) \
+	case kind:        \
+		return name##_bounds(h.name);
+		HITTABLE_KINDS(X)
+#undef X
+	}
+	unreachable;
+}
+
+static u64 sphere_hash(sphere_t s, u64 h) {
+	h = hash_fnv1a(&s.center, sizeof(s.center), h);
+	return hash_fnv1a(&s.radius, sizeof(s.radius), h);
+}
+
+u64 hittables_hash(hittable_view_t hs) {
+	u64 h = hash_fnv1a(&hs.count, sizeof(hs.count), HASH_FNV1A_SEED);
+
+	for (u64 i = 0; i < hs.count; i++) {
+		hittable_t item = hs.items[i];
+		h = hash_fnv1a(&item.type, sizeof(item.type), h);
+
+		switch (item.type) {
+#define X(kind, name)                   \
+	case kind:                          \
+		h = name##_hash(item.name, h); \
+		break;
+			HITTABLE_KINDS(X)
+#undef X
+		}
+	}
+
+	return h;
+}
+
+// :hittable_set
+hittable_set_t hittable_set_build(context_t ctx, hittable_view_t hs) {
+	hittable_set_t set = {._allocator = ctx.allocator};
+
+	for (u64 i = 0; i < hs.count; i++) {
+		switch (hs.items[i].type) {
+#define X(kind, name)         \
+	case kind:                \
+		set.name##_count++; \
+		break;
+			HITTABLE_KINDS(X)
+#undef X
+		}
+	}
+
+#define X(kind, name)                                                        \
+	set.name##s = alloc(ctx, set.name##_count * sizeof(name##_t) + 1); \
+	set.name##_count = 0;
+	HITTABLE_KINDS(X)
+#undef X
+
+	for (u64 i = 0; i < hs.count; i++) {
+		switch (hs.items[i].type) {
+#define X(kind, name)                                           \
+	case kind:                                                  \
+		set.name##s[set.name##_count++] = hs.items[i].name; \
+		break;
+			HITTABLE_KINDS(X)
+#undef X
+		}
+	}
+
+	return set;
+}
+
+void hittable_set_destroy(hittable_set_t* set) {
+#define X(kind, name) allocator_dealloc(set->_allocator, set->name##s);
+	HITTABLE_KINDS(X)
+#undef X
+	*set = (hittable_set_t){0};
+}
+
+KERNEL hit_t hit_set(const hittable_set_t* set, ray_t r, real_t mint, real_t maxt) {
+	hit_t result = {0};
+
+#define X(kind, name)                                                       \
+	for (u64 i = 0; i < set->name##_count; i++) {                           \
+		hit_t this_hit = hit_##name(set->name##s[i], r, mint, maxt); \
+		if (this_hit.is_hit) {                                              \
+			result = this_hit;                                              \
+			maxt = this_hit.t;                                              \
+		}                                                                   \
+	}
+	HITTABLE_KINDS(X)
+#undef X
+
+	return result;
+}
+
+bool occluded_set(const hittable_set_t* set, ray_t r, real_t mint, real_t maxt) {
+#define X(kind, name)                                             \
+	for (u64 i = 0; i < set->name##_count; i++) {                 \
+		if (occluded_##name(set->name##s[i], r, mint, maxt)) { \
+			return true;                                          \
+		}                                                         \
+	}
+	HITTABLE_KINDS(X)
+#undef X
+
+	return false;
+}
+
+// :sampling
+real_t rand_real() {
+	real_t val = rand();
+	real_t max = RAND_MAX;
+	return val / max;
+}
+
+vec3_t vec3_rand(real_t min, real_t max) {
+	real_t d = max - min;
+	return (vec3_t){
+		.x = rand_real() * d + min,
+		.y = rand_real() * d + min,
+		.z = rand_real() * d + min,
+	};
+}
+
+vec3_t vec3_rand_unit() {
+	while (true) {
+		vec3_t vec = vec3_rand(-1, 1);
+		real_t len2 = vec3_len2(vec);
+		if (0 < len2 && len2 <= 1) {
+			return vec3_div(vec, real_sqrt(len2));
+		}
+	}
+}
+
+vec3_t vec3_rand_hemisphere(vec3_t normal) {
+	vec3_t rand = vec3_rand_unit();
+	real_t sign = vec3_dot(rand, normal);
+	return sign < 0 ? vec3_neg(rand) : rand;
+}
+
+vec3_t sky_color(vec3_t direction) {
+	direction = vec3_norm(direction);
+
+	real_t a = (direction.y + 1) / 2;
+
+	vec3_t white = vec3(1, 1, 1);
+	vec3_t blue = vec3(0.5, 0.7, 1.0);
+
+	real_t a_inv = 1 - a;
+	return vec3_muladd(blue, (a), vec3_mul(white, a_inv));
+}
+
+// :accel
+#define ACCEL_GRID_MIN_PRIMS 256
+#define ACCEL_GRID_MAX_SPREAD 0.5
+#define ACCEL_GRID_MAX_OUTLIER 4.
+
+accel_type_t accel_choose(hittable_view_t hs) {
+	if (hs.count < ACCEL_GRID_MIN_PRIMS) {
+		return ACCEL_BVH;
+	}
+
+	// size of a primitive is the longest side of its bounds
+	f64 sum = 0, sum2 = 0, largest = 0;
+	for (u64 i = 0; i < hs.count; i++) {
+		aabb_t b = hittable_bounds(hs.items[i]);
+		vec3_t d = vec3_sub(b.max, b.min);
+		f64	   size = max_f64(d.x, max_f64(d.y, d.z));
+
+		sum += size;
+		sum2 += size * size;
+		largest = max_f64(largest, size);
+	}
+
+	f64 mean = sum / hs.count;
+	f64 variance = max_f64(sum2 / hs.count - mean * mean, 0);
+
+	// a single huge primitive (a ground sphere) lands in every cell it touches
+	if (largest > ACCEL_GRID_MAX_OUTLIER * mean || sqrt(variance) > ACCEL_GRID_MAX_SPREAD * mean) {
+		return ACCEL_BVH;
+	}
+	return ACCEL_GRID;
+}
+
+accel_t accel_build(context_t ctx, accel_type_t type, hittable_view_t hs) {
+	switch (type) {
+		case ACCEL_BVH:
+			return (accel_t){.type = type, .bvh = bvh_build(ctx, hs)};
+		case ACCEL_GRID:
+			return (accel_t){.type = type, .grid = grid_build(ctx, hs)};
+		case ACCEL_BAKED:
+			break;
+	}
+	unreachable;
+}
+
+void accel_destroy(accel_t* accel) {
+	switch (accel->type) {
+		case ACCEL_BVH:
+			bvh_destroy(&accel->bvh);
+			return;
+		case ACCEL_GRID:
+			grid_destroy(&accel->grid);
+			return;
+		case ACCEL_BAKED:
+			return;
+	}
+	unreachable;
+}
+
+hit_t accel_hit(const accel_t* accel, ray_t r, real_t mint, real_t maxt) {
+	switch (accel->type) {
+		case ACCEL_BVH:
+			return bvh_hit(&accel->bvh, r, mint, maxt);
+		case ACCEL_GRID:
+			return grid_hit(&accel->grid, r, mint, maxt);
+		case ACCEL_BAKED:
+			return accel->baked.hit(r, mint, maxt);
+	}
+	unreachable;
+}
+
+bool accel_occluded(const accel_t* accel, ray_t r, real_t mint, real_t maxt) {
+	switch (accel->type) {
+		case ACCEL_BVH:
+			return bvh_occluded(&accel->bvh, r, mint, maxt);
+		case ACCEL_GRID:
+			return grid_occluded(&accel->grid, r, mint, maxt);
+		case ACCEL_BAKED:
+			return accel->baked.occluded(r, mint, maxt);
+	}
+	unreachable;
+}
+
+// :world
+hit_t world_hit(const world_t* w, ray_t r, real_t mint, real_t maxt) {
+	hit_t hit = accel_hit(&w->accel, r, mint, maxt);
+	if (hit.is_hit) {
+		maxt = hit.t;
+	}
+
+	hit_t instanced = tlas_hit(&w->tlas, r, mint, maxt);
+	return instanced.is_hit ? instanced : hit;
+}
+
+bool world_occluded(const world_t* w, ray_t r, real_t mint, real_t maxt) {
+	return accel_occluded(&w->accel, r, mint, maxt) || tlas_occluded(&w->tlas, r, mint, maxt);
+}
+
+// :integrator
+KERNEL vec3_t ray_color_hit(ray_t ray, hit_t hit, const world_t* world, i32 max_bouces) {
+	if (hit.is_hit) {
+		ray_t next_ray = {
+			.origin = ray_offset_origin(hit.point, hit.normal),
+			.direction = vec3_rand_hemisphere(hit.normal),
+		};
+		vec3_t color = ray_color(next_ray, world, max_bouces - 1);
+		return vec3_mul(color, 0.5);
+	}
+
+	return sky_color(ray.direction);
+}
+
+KERNEL vec3_t ray_color(ray_t ray, const world_t* world, i32 max_bouces) {
+	if (max_bouces <= 0) {
+		return (vec3_t){0};
+	}
+
+	hit_t hit = world_hit(world, ray, RAY_MINT, RAY_MAXT);
+	return ray_color_hit(ray, hit, world, max_bouces);
+}
@@ -0,0 +1,92 @@
+#include <unistd.h>
+
+#include "rt.h"
+
+// :tile
+frustum_t frustum_create(vec3_t origin, vec3_t corner, vec3_t edge_u, vec3_t edge_v) {
+	frustum_t f = {.origin = origin};
+
+	vec3_t dirs[4] = {
+		vec3_sub(corner, origin),
+		vec3_sub(vec3_add(corner, edge_u), origin),
+		vec3_sub(vec3_add(vec3_add(corner, edge_u), edge_v), origin),
+		vec3_sub(vec3_add(corner, edge_v), origin),
+	};
+	vec3_t center = {0};
+	for (u32 i = 0; i < 4; i++) {
+		vec3p_add(&center, dirs[i]);
+	}
+
+	// side planes hold two neighbouring corner rays, the last one faces away from the camera
+	for (u32 i = 0; i < 4; i++) {
+		vec3_t n = vec3_cross(dirs[i], dirs[(i + 1) % 4]);
+		if (vec3_dot(n, center) < 0) {
+			n = vec3_neg(n);
+		}
+		f.planes[i] = vec3_div(n, vec3_len(n));
+	}
+	f.planes[4] = vec3_div(center, vec3_len(center));
+
+	return f;
+}
+
+bool frustum_culls_aabb(const frustum_t* f, aabb_t b) {
+	for (u32 i = 0; i < FRUSTUM_PLANES; i++) {
+		vec3_t n = f->planes[i];
+
+		// corner of the box furthest along the plane normal
+		vec3_t far = vec3(n.x > 0 ? b.max.x : b.min.x, n.y > 0 ? b.max.y : b.min.y, n.z > 0 ? b.max.z : b.min.z);
+		if (vec3_dot(n, vec3_sub(far, f->origin)) < 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool frustum_culls_sphere(const frustum_t* f, sphere_t s) {
+	vec3_t oc = vec3_sub(s.center, f->origin);
+	for (u32 i = 0; i < FRUSTUM_PLANES; i++) {
+		if (vec3_dot(f->planes[i], oc) < -s.radius) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool frustum_culls_hittable(const frustum_t* f, hittable_t h) {
+	switch (h.type) {
+#define X(kind, name) \
+	case kind:        \
+		return frustum_culls_##name(f, h.name);
+		HITTABLE_KINDS(X)
+#undef X
+	}
+	unreachable;
+}
+
+u64 tile_cull(const frustum_t* f, hittable_view_t hs, hittable_t* out) {
+	u64 count = 0;
+	for (u64 i = 0; i < hs.count; i++) {
+		if (!frustum_culls_hittable(f, hs.items[i])) {
+			out[count++] = hs.items[i];
+		}
+	}
+	return count;
+}
+
+u64 tile_cull_set(const frustum_t* f, const hittable_set_t* set, hittable_set_t* out) {
+	u64 count = 0;
+
+#define X(kind, name)                                         \
+	out->name##_count = 0;                                    \
+	for (u64 i = 0; i < set->name##_count; i++) {             \
+		if (!frustum_culls_##name(f, set->name##s[i])) {      \
+			out->name##s[out->name##_count++] = set->name##s[i]; \
+		}                                                     \
+	}                                                         \
+	count += out->name##_count;
+	HITTABLE_KINDS(X)
+#undef X
+
+	return count;
+}
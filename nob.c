@@ -11,17 +11,36 @@
 // #define CC "clang", "-O3"
 // #define CC "./tcc", "-L", "../tinycc/", "-I", "../tinycc/include/", "-O3"
 
-#define CFLAGS "-Wall", "-Wextra", "-lm"
+#define CFLAGS "-Wall", "-Wextra"
+#define LDFLAGS "-lm"  // after the sources, or --as-needed drops it
 
 #define arr(arr) arr, NOB_ARRAY_LEN(arr)
 
 const char* build_path = "./build";
 
 const char* rt_program = "main";
-const char* rt_srcs[] = {"src/main.c", "src/msk.h", "src/msk.c"};
+const char* rt_srcs[] = {"src/main.c", "src/msk.h", "src/msk.c", "src/rt.h", "src/rt.c", "src/bvh.c", "src/instance.c", "src/grid.c", "src/packet.c", "src/wavefront.c", "src/tile.c", "src/gbuffer.c", "src/scene.c", "src/render.c", "src/server.c", "src/scheduler.c", "src/query.c"};
+
+// same sources with real_t as f32, see msk.h
+const char* rt_f32_program = "main_f32";
+#define F32_FLAGS "-DMSK_F32"
+
+// same sources with the four lane vec3_t, see msk.h
+const char* rt_simd_program = "main_simd";
+#define SIMD_FLAGS "-DMSK_SIMD", "-mavx2", "-mfma"
+
+// baked into generated c and linked into every main, see bake_scene
+const char* scene_path = "scenes/default.scene";
+const char* scene_output = "build/src/baked_scene.c";
+#define SCENE_UNROLL_MAX 64	 // larger scenes keep a loop over the data
+
+const char* bench_program = "bench";
+const char* bench_f32_program = "bench_f32";
+const char* bench_simd_program = "bench_simd";
+const char* bench_srcs[] = {"src/bench.c", "src/msk.h", "src/msk.c", "src/rt.h", "src/rt.c", "src/bvh.c", "src/instance.c", "src/grid.c", "src/packet.c", "src/wavefront.c", "src/tile.c", "src/gbuffer.c", "src/scene.c", "src/render.c", "src/server.c", "src/scheduler.c", "src/query.c"};
 
 const char* test_program = "test";
-const char* test_srcs[] = {"tests/fmt.c", "src/msk.h", "src/msk.c"};
+const char* test_srcs[] = {"tests/fmt.c", "tests/bvh.c", "tests/grid.c", "tests/packet.c", "tests/wavefront.c", "tests/tile.c", "tests/gbuffer.c", "tests/hittable.c", "tests/scene.c", "tests/render.c", "tests/server.c", "tests/scheduler.c", "tests/query.c", "tests/test_scene.h", "src/msk.h", "src/msk.c", "src/rt.h", "src/rt.c", "src/bvh.c", "src/instance.c", "src/grid.c", "src/packet.c", "src/wavefront.c", "src/tile.c", "src/gbuffer.c", "src/scene.c", "src/render.c", "src/server.c", "src/scheduler.c", "src/query.c"};
 
 bool is_define(char* str, char* start) {
 	bool  before_define = true;
@@ -112,6 +131,9 @@ typedef enum {
 	TT_LPAREN,	// (
 	TT_RPAREN,	// )
 	TT_COMMA,	// ,
+	TT_LBRACKET,  // [
+	TT_RBRACKET,  // ]
+	TT_ASSIGN,	  // =
 
 	TT_PLUS,   // +
 	TT_MINUS,  // -
@@ -122,8 +144,8 @@ typedef enum {
 } token_type_t;
 
 const char* token_type_name[] = {
-	"TT_EOF",	"TT_ILLEGAL", "TT_LITERAL", "TT_IDENTIFIER", "TT_LPAREN", "TT_RPAREN",
-	"TT_COMMA", "TT_PLUS",	  "TT_MINUS",	"TT_DIV",		 "TT_MUL",	  "TT_DOT",
+	"TT_EOF",	"TT_ILLEGAL", "TT_LITERAL", "TT_IDENTIFIER", "TT_LPAREN", "TT_RPAREN", "TT_COMMA",
+	"TT_LBRACKET", "TT_RBRACKET", "TT_ASSIGN", "TT_PLUS",	  "TT_MINUS",	"TT_DIV",		 "TT_MUL",	  "TT_DOT",
 };
 
 typedef struct {
@@ -170,7 +192,14 @@ token_t lexer_read_identifier(lexer_t* lx) {
 	const u64	position = lx->position;
 	const char* start = lx->ptr;
 
-	while (isalpha(lx->curr) || isdigit(lx->curr) || lx->curr == '.' || lx->curr == '_') {
+	while (isalpha(lx->curr) || isdigit(lx->curr) || lx->curr == '.' || lx->curr == '_' || lx->curr == '-') {
+		if (lx->curr == '-') {
+			// only as part of ->, anything else is a minus
+			if (lx->readPosition >= lx->sv.count || lx->sv.data[lx->readPosition] != '>') {
+				break;
+			}
+			lexer_next_char(lx);
+		}
 		lexer_next_char(lx);
 	}
 
@@ -229,6 +258,15 @@ token_t lexer_next_token(lexer_t* lx) {
 		case ',': {
 			token = create_token(TT_COMMA, lx->ptr, 1);
 		}; break;
+		case '[': {
+			token = create_token(TT_LBRACKET, lx->ptr, 1);
+		}; break;
+		case ']': {
+			token = create_token(TT_RBRACKET, lx->ptr, 1);
+		}; break;
+		case '=': {
+			token = create_token(TT_ASSIGN, lx->ptr, 1);
+		}; break;
 		case '\0': {
 			token = create_token(TT_EOF, lx->ptr, 1);
 		}; break;
@@ -243,138 +281,371 @@ token_t lexer_next_token(lexer_t* lx) {
 	return token;
 }
 
-Nob_String_Builder transpile_tokens(token_view_t tokens) {
-	da_t(char*) to_free = {0};
+// :vecmath tree
+// Operands of + and - are vectors, the right hand side of * and / is a scalar.
+// In vecmath_lanes a name followed by [] is a batch in SoA layout, p[] is
+// px[i], py[i], pz[i] for a vector and p[i] for a scalar.
+typedef enum {
+	EX_NAME,  // identifier or number
+	EX_NEG,	  // -lhs
+	EX_ADD,	  // lhs + rhs
+	EX_SUB,	  // lhs - rhs
+	EX_MUL,	  // lhs * rhs
+	EX_DIV,	  // lhs / rhs
+} expr_kind_t;
 
-	// eval parenthesis
-	for (u64 i = 0; i < tokens.count; i++) {
-		token_t token = tokens.items[i];
-		nob_log(NOB_INFO, "p: %s - \"" SV_Fmt "\"", token_type_name[token.type], SV_Arg(token.literal));
+typedef struct {
+	expr_kind_t		kind;
+	bool			scalar;
+	bool			lane;  // a name with [], one value per lane
+	Nob_String_View name;
+	u64				lhs, rhs;
+	u64				uses;  // parents referencing the node, shared ones are hoisted
+	i64				temp;  // index of the hoisted temporary, -1 when emitted inline
+} expr_t;
 
-		// find open
-		if (token.type != TT_LPAREN) {
-			continue;
+typedef struct {
+	token_view_t tokens;
+	u64			 pos;
+	bool		 lanes;	 // parsing a vecmath_lanes
+	da_t(expr_t) nodes;	 // interned, equal subtrees are the same node
+} expr_parser_t;
+
+u64 expr_intern(expr_parser_t* p, expr_t node) {
+	for (u64 i = 0; i < p->nodes.count; i++) {
+		expr_t n = p->nodes.items[i];
+		if (n.kind == node.kind && n.scalar == node.scalar && n.lane == node.lane && n.lhs == node.lhs && n.rhs == node.rhs &&
+			nob_sv_eq(n.name, node.name)) {
+			return i;
 		}
-		u64 len = 0;
-		u64 count = 1;
-
-		// find close
-		while (count != 0) {
-			len++;
-			try i + len > tokens.count or_fail("bad parsing");
-			token = tokens.items[i + len];
-			if (token.type == TT_LPAREN) {
-				count++;
-			} else if (token.type == TT_RPAREN) {
-				count--;
+	}
+	node.temp = -1;
+	nob_da_append(&p->nodes, node);
+	return p->nodes.count - 1;
+}
+
+token_type_t expr_peek(const expr_parser_t* p) {
+	return p->pos < p->tokens.count ? p->tokens.items[p->pos].type : TT_EOF;
+}
+
+u64 expr_parse_sum(expr_parser_t* p, bool scalar);
+
+u64 expr_parse_factor(expr_parser_t* p, bool scalar) {
+	try p->pos >= p->tokens.count or_fail("vecmath: expression ends early");
+	token_t token = p->tokens.items[p->pos++];
+
+	switch (token.type) {
+		case TT_LPAREN: {
+			u64 inner = expr_parse_sum(p, scalar);
+			try expr_peek(p) != TT_RPAREN or_fail("vecmath: missing )");
+			p->pos++;
+			return inner;
+		}
+		case TT_MINUS:
+			return expr_intern(p, (expr_t){.kind = EX_NEG, .scalar = scalar, .lhs = expr_parse_factor(p, scalar)});
+		case TT_IDENTIFIER:
+		case TT_LITERAL: {
+			bool lane = expr_peek(p) == TT_LBRACKET;
+			if (lane) {
+				try !p->lanes or_fail("vecmath: [] only works in vecmath_lanes");
+				try p->pos + 1 >= p->tokens.count || p->tokens.items[p->pos + 1].type != TT_RBRACKET or_fail("vecmath: missing ]");
+				p->pos += 2;
 			}
-			nob_log(NOB_INFO, "rp: %s - \"" SV_Fmt "\"", token_type_name[token.type], SV_Arg(token.literal));
+			return expr_intern(p, (expr_t){.kind = EX_NAME, .scalar = scalar, .lane = lane, .name = token.literal});
 		}
+		default:
+			break;
+	}
+	nob_log(NOB_ERROR, "vecmath: unexpected %s \"" SV_Fmt "\"", token_type_name[token.type], SV_Arg(token.literal));
+	exit(1);
+}
 
-		Nob_String_Builder substr = transpile_tokens((token_view_t){tokens.items + i + 1, len});
-		nob_da_append(&to_free, substr.items);
+u64 expr_parse_product(expr_parser_t* p, bool scalar) {
+	u64 lhs = expr_parse_factor(p, scalar);
+	while (expr_peek(p) == TT_MUL || expr_peek(p) == TT_DIV) {
+		expr_kind_t kind = p->tokens.items[p->pos++].type == TT_MUL ? EX_MUL : EX_DIV;
+		u64			rhs = expr_parse_factor(p, true);
+		lhs = expr_intern(p, (expr_t){.kind = kind, .scalar = scalar, .lhs = lhs, .rhs = rhs});
+	}
+	return lhs;
+}
 
-		// substitute tokens that have been condensed
-		memmove(&tokens.items[i + 1], &tokens.items[i + len + 1], (tokens.count - (i + len + 1)) * sizeof(token_t));
-		tokens.count = tokens.count - len + 1;
-		tokens.items[i] = create_token(TT_LITERAL, substr.items, substr.count);
+u64 expr_parse_sum(expr_parser_t* p, bool scalar) {
+	u64 lhs = expr_parse_product(p, scalar);
+	while (expr_peek(p) == TT_PLUS || expr_peek(p) == TT_MINUS) {
+		expr_kind_t kind = p->tokens.items[p->pos++].type == TT_PLUS ? EX_ADD : EX_SUB;
+		u64			rhs = expr_parse_product(p, scalar);
+		lhs = expr_intern(p, (expr_t){.kind = kind, .scalar = scalar, .lhs = lhs, .rhs = rhs});
 	}
+	return lhs;
+}
+
+// counts every edge of the dag once, a node reached twice is a common subexpression
+void expr_count_uses(expr_parser_t* p, u64 idx, bool* seen) {
+	if (seen[idx]) {
+		return;
+	}
+	seen[idx] = true;
 
-	// eval first priority
-	for (u64 i = 1; i + 1 < tokens.count;) {
-		token_t token = tokens.items[i];
+	expr_t n = p->nodes.items[idx];
+	if (n.kind == EX_NAME) {
+		return;
+	}
+	p->nodes.items[n.lhs].uses++;
+	expr_count_uses(p, n.lhs, seen);
+	if (n.kind != EX_NEG) {
+		p->nodes.items[n.rhs].uses++;
+		expr_count_uses(p, n.rhs, seen);
+	}
+}
 
-		nob_log(NOB_INFO, "2p: %s - \"" SV_Fmt "\"", token_type_name[token.type], SV_Arg(token.literal));
+void expr_emit(const expr_parser_t* p, u64 idx, Nob_String_Builder* sb);
 
-		// find * and /
-		if (token.type != TT_MUL && token.type != TT_DIV) {
-			i++;
-			continue;
-		}
+// a vector product used once folds into the sum above it, a * s + b becomes vec3_muladd(a, s, b)
+bool expr_fusable(const expr_parser_t* p, u64 idx) {
+	expr_t n = p->nodes.items[idx];
+	return !n.scalar && n.temp < 0 && (n.kind == EX_MUL || n.kind == EX_DIV);
+}
 
-		token_t lhs = tokens.items[i - 1];
-		token_t rhs = tokens.items[i + 1];
+void expr_emit_muladd(const expr_parser_t* p, u64 product, bool negate, u64 addend, Nob_String_Builder* sb) {
+	expr_t n = p->nodes.items[product];
+
+	nob_sb_append_cstr(sb, "vec3_muladd(");
+	expr_emit(p, n.lhs, sb);
+	nob_sb_append_cstr(sb, negate ? ", -" : ", ");
+	// dividing is multiplying by the reciprocal, vec3_div does the same
+	nob_sb_append_cstr(sb, n.kind == EX_DIV ? "(1 / (real_t)" : "(");
+	expr_emit(p, n.rhs, sb);
+	nob_sb_append_cstr(sb, "), ");
+	expr_emit(p, addend, sb);
+	nob_sb_append_cstr(sb, ")");
+}
 
-		nob_log(NOB_INFO, "found 2p: %s(" SV_Fmt ") %s(" SV_Fmt ") %s(" SV_Fmt ")", token_type_name[lhs.type],
-				SV_Arg(lhs.literal), token_type_name[token.type], SV_Arg(token.literal), token_type_name[rhs.type],
-				SV_Arg(rhs.literal));
+void expr_emit(const expr_parser_t* p, u64 idx, Nob_String_Builder* sb) {
+	expr_t n = p->nodes.items[idx];
 
-		Nob_String_Builder sb = {0};
-		if (token.type == TT_MUL) {
-			nob_sb_append_cstr(&sb, "vec3_mul(");
-		} else {
-			nob_sb_append_cstr(&sb, "vec3_div(");
+	if (n.temp >= 0) {
+		nob_sb_append_cstr(sb, nob_temp_sprintf("vecmath_t%ld", n.temp));
+		return;
+	}
+	if (n.kind == EX_NAME) {
+		nob_sb_append_buf(sb, n.name.data, n.name.count);
+		return;
+	}
+
+	if (n.scalar) {
+		const char* ops[] = {[EX_ADD] = " + ", [EX_SUB] = " - ", [EX_MUL] = " * ", [EX_DIV] = " / "};
+
+		nob_sb_append_cstr(sb, n.kind == EX_NEG ? "(-" : "(");
+		expr_emit(p, n.lhs, sb);
+		if (n.kind != EX_NEG) {
+			nob_sb_append_cstr(sb, ops[n.kind]);
+			expr_emit(p, n.rhs, sb);
 		}
-		nob_sb_append_buf(&sb, lhs.literal.data, lhs.literal.count);
-		nob_sb_append_cstr(&sb, ", ");
-		nob_sb_append_buf(&sb, rhs.literal.data, rhs.literal.count);
-		nob_sb_append_cstr(&sb, ")");
-		nob_da_append(&to_free, sb.items);
+		nob_sb_append_cstr(sb, ")");
+		return;
+	}
 
-		// substitute tokens that have been condensed
-		memmove(&tokens.items[i], &tokens.items[i + 2], (tokens.count - (i + 1)) * sizeof(token_t));
-		tokens.count = tokens.count - 2;
-		tokens.items[i - 1] = create_token(TT_LITERAL, sb.items, sb.count);
+	if (n.kind == EX_ADD && expr_fusable(p, n.rhs)) {
+		expr_emit_muladd(p, n.rhs, false, n.lhs, sb);
+		return;
+	}
+	if (n.kind == EX_ADD && expr_fusable(p, n.lhs)) {
+		expr_emit_muladd(p, n.lhs, false, n.rhs, sb);
+		return;
+	}
+	if (n.kind == EX_SUB && expr_fusable(p, n.rhs)) {
+		expr_emit_muladd(p, n.rhs, true, n.lhs, sb);
+		return;
 	}
 
-	// eval second priority
-	for (u64 i = 1; i + 1 < tokens.count;) {
-		token_t token = tokens.items[i];
+	const char* calls[] = {
+		[EX_NEG] = "vec3_neg(", [EX_ADD] = "vec3_add(", [EX_SUB] = "vec3_sub(", [EX_MUL] = "vec3_mul(", [EX_DIV] = "vec3_div(",
+	};
+	nob_sb_append_cstr(sb, calls[n.kind]);
+	expr_emit(p, n.lhs, sb);
+	if (n.kind != EX_NEG) {
+		nob_sb_append_cstr(sb, ", ");
+		expr_emit(p, n.rhs, sb);
+	}
+	nob_sb_append_cstr(sb, ")");
+}
 
-		nob_log(NOB_INFO, "3p: %s - \"" SV_Fmt "\"", token_type_name[token.type], SV_Arg(token.literal));
+// one component of a lane, or the whole value when comp is -1 and the node is a scalar
+void expr_emit_lane(const expr_parser_t* p, u64 idx, i32 comp, Nob_String_Builder* sb) {
+	expr_t		n = p->nodes.items[idx];
+	const char* suffix = n.scalar ? "" : (const char*[]){"x", "y", "z"}[comp];
 
-		// find + and -
-		if (token.type != TT_PLUS && token.type != TT_MINUS) {
-			i++;
-			continue;
+	if (n.temp >= 0) {
+		nob_sb_append_cstr(sb, nob_temp_sprintf("vecmath_t%ld%s", n.temp, suffix));
+		return;
+	}
+	if (n.kind == EX_NAME) {
+		nob_sb_append_buf(sb, n.name.data, n.name.count);
+		if (n.lane) {
+			nob_sb_append_cstr(sb, nob_temp_sprintf("%s[vecmath_i]", suffix));
+		} else if (!n.scalar) {
+			nob_sb_append_cstr(sb, nob_temp_sprintf(".%s", suffix));
 		}
+		return;
+	}
 
-		token_t lhs = tokens.items[i - 1];
-		token_t rhs = tokens.items[i + 1];
+	const char* ops[] = {[EX_ADD] = " + ", [EX_SUB] = " - ", [EX_MUL] = " * ", [EX_DIV] = " / "};
 
-		nob_log(NOB_INFO, "found 2p: %s(" SV_Fmt ") %s(" SV_Fmt ") %s(" SV_Fmt ")", token_type_name[lhs.type],
-				SV_Arg(lhs.literal), token_type_name[token.type], SV_Arg(token.literal), token_type_name[rhs.type],
-				SV_Arg(rhs.literal));
+	nob_sb_append_cstr(sb, n.kind == EX_NEG ? "(-" : "(");
+	expr_emit_lane(p, n.lhs, comp, sb);
+	if (n.kind != EX_NEG) {
+		nob_sb_append_cstr(sb, ops[n.kind]);
+		expr_emit_lane(p, n.rhs, comp, sb);
+	}
+	nob_sb_append_cstr(sb, ")");
+}
 
-		Nob_String_Builder sb = {0};
-		if (token.type == TT_PLUS) {
-			nob_sb_append_cstr(&sb, "vec3_add(");
-		} else {
-			nob_sb_append_cstr(&sb, "vec3_sub(");
-		}
-		nob_sb_append_buf(&sb, lhs.literal.data, lhs.literal.count);
-		nob_sb_append_cstr(&sb, ", ");
-		nob_sb_append_buf(&sb, rhs.literal.data, rhs.literal.count);
-		nob_sb_append_cstr(&sb, ")");
-		nob_da_append(&to_free, sb.items);
+// shared nodes become temporaries, children before parents; outside of lanes
+// only vectors, a repeated scalar there is the compiler's to spot
+void expr_hoist(expr_parser_t* p, u64 idx, bool* seen, Nob_String_Builder* prelude, i64* temps) {
+	if (seen[idx]) {
+		return;
+	}
+	seen[idx] = true;
 
-		// substitute tokens that have been condensed
-		memmove(&tokens.items[i], &tokens.items[i + 2], (tokens.count - (i + 1)) * sizeof(token_t));
-		tokens.count = tokens.count - 2;
-		tokens.items[i - 1] = create_token(TT_LITERAL, sb.items, sb.count);
+	expr_t n = p->nodes.items[idx];
+	if (n.kind == EX_NAME) {
+		return;
+	}
+	expr_hoist(p, n.lhs, seen, prelude, temps);
+	if (n.kind != EX_NEG) {
+		expr_hoist(p, n.rhs, seen, prelude, temps);
 	}
 
-	nob_log(NOB_INFO, "count: %d", tokens.count);
-	for (u64 i = 0; i < tokens.count; i++) {
-		token_t token = tokens.items[i];
-		nob_log(NOB_INFO, "here: %s - \"" SV_Fmt "\"", token_type_name[token.type], SV_Arg(token.literal));
+	if (n.uses < 2 || (n.scalar && !p->lanes)) {
+		return;
+	}
+	if (!p->lanes) {
+		nob_sb_append_cstr(prelude, nob_temp_sprintf("vec3_t vecmath_t%ld = ", *temps));
+		expr_emit(p, idx, prelude);
+		nob_sb_append_cstr(prelude, "; ");
+	} else {
+		for (i32 comp = 0; comp < (n.scalar ? 1 : 3); comp++) {
+			nob_sb_append_cstr(prelude, nob_temp_sprintf("real_t vecmath_t%ld%s = ", *temps, n.scalar ? "" : (const char*[]){"x", "y", "z"}[comp]));
+			expr_emit_lane(p, idx, comp, prelude);
+			nob_sb_append_cstr(prelude, "; ");
+		}
 	}
+	p->nodes.items[idx].temp = (*temps)++;
+}
+
+Nob_String_Builder transpile_tokens(token_view_t tokens) {
+	expr_parser_t p = {.tokens = tokens};
+
+	u64 root = expr_parse_sum(&p, false);
+	try p.pos != tokens.count or_fail("vecmath: trailing tokens");
 
-	token_t token = tokens.items[0];
-	assert(token.type == TT_LITERAL);
+	bool* seen = calloc(p.nodes.count, sizeof(bool));
+	p.nodes.items[root].uses++;
+	expr_count_uses(&p, root, seen);
+
+	Nob_String_Builder prelude = {0};
+	i64				   temps = 0;
+	memset(seen, 0, p.nodes.count * sizeof(bool));
+	expr_hoist(&p, root, seen, &prelude, &temps);
 
 	Nob_String_Builder result = {0};
-	nob_da_append_many(&result, token.literal.data, token.literal.count);
-	nob_log(NOB_INFO, "res: \"" SV_Fmt "\"", result.count, result.items);
+	if (temps == 0) {
+		expr_emit(&p, root, &result);
+	} else {
+		// a statement expression, so the temporaries work anywhere an expression does
+		nob_sb_append_cstr(&result, "({ ");
+		nob_sb_append_buf(&result, prelude.items, prelude.count);
+		expr_emit(&p, root, &result);
+		nob_sb_append_cstr(&result, "; })");
+	}
+	nob_log(NOB_INFO, "res: \"" SV_Fmt "\"", (int)result.count, result.items);
+
+	free(seen);
+	nob_sb_free(prelude);
+	nob_da_free(p.nodes);
+	return result;
+}
+
+// vecmath_lanes(count, a[] = expression, b[] = expression, ...) becomes one
+// loop over the lanes, every component written out as scalar code so the
+// compiler vectorizes it; outputs can be read by the assignments after them
+Nob_String_Builder transpile_lanes(Nob_String_View count, token_view_t tokens) {
+	expr_parser_t p = {.tokens = tokens, .lanes = true};
+	da_t(u64) roots = {0};
+	da_t(Nob_String_View) outputs = {0};
+
+	while (p.pos < tokens.count) {
+		try p.pos + 3 >= tokens.count or_fail("vecmath_lanes: expected name[] = expression");
+		token_t name = tokens.items[p.pos];
+		try name.type != TT_IDENTIFIER || tokens.items[p.pos + 1].type != TT_LBRACKET ||
+			tokens.items[p.pos + 2].type != TT_RBRACKET || tokens.items[p.pos + 3].type != TT_ASSIGN
+			or_fail("vecmath_lanes: expected name[] = expression");
+		p.pos += 4;
+
+		u64 root = expr_parse_sum(&p, false);
+		nob_da_append(&roots, root);
+		nob_da_append(&outputs, name.literal);
+
+		try p.pos < tokens.count && expr_peek(&p) != TT_COMMA or_fail("vecmath_lanes: expected , between assignments");
+		p.pos += p.pos < tokens.count;
+	}
+
+	bool* seen = calloc(p.nodes.count, sizeof(bool));
+	for (u64 i = 0; i < roots.count; i++) {
+		p.nodes.items[roots.items[i]].uses++;
+		expr_count_uses(&p, roots.items[i], seen);
+	}
 
-	for (u64 i = 0; i < to_free.count; i++) {
-		NOB_FREE(to_free.items[i]);
+	Nob_String_Builder prelude = {0};
+	i64				   temps = 0;
+	memset(seen, 0, p.nodes.count * sizeof(bool));
+	for (u64 i = 0; i < roots.count; i++) {
+		expr_hoist(&p, roots.items[i], seen, &prelude, &temps);
 	}
 
+	// on one line, so the transpiled file keeps the line numbers of the source
+	Nob_String_Builder result = {0};
+	nob_sb_append_cstr(&result, "do { _Pragma(\"omp simd\") for (u64 vecmath_i = 0; vecmath_i < (");
+	nob_sb_append_buf(&result, count.data, count.count);
+	nob_sb_append_cstr(&result, "); vecmath_i++) { ");
+	nob_sb_append_buf(&result, prelude.items, prelude.count);
+	for (u64 i = 0; i < roots.count; i++) {
+		for (i32 comp = 0; comp < 3; comp++) {
+			nob_sb_append_buf(&result, outputs.items[i].data, outputs.items[i].count);
+			nob_sb_append_cstr(&result, nob_temp_sprintf("%s[vecmath_i] = ", (const char*[]){"x", "y", "z"}[comp]));
+			expr_emit_lane(&p, roots.items[i], comp, &result);
+			nob_sb_append_cstr(&result, "; ");
+		}
+	}
+	nob_sb_append_cstr(&result, "} } while (0)");
+	nob_log(NOB_INFO, "res: \"" SV_Fmt "\"", (int)result.count, result.items);
+
+	free(seen);
+	nob_sb_free(prelude);
+	nob_da_free(roots);
+	nob_da_free(outputs);
+	nob_da_free(p.nodes);
 	return result;
 }
 
-Nob_String_Builder transpile_math(Nob_String_View sv) {
+Nob_String_Builder transpile_math(Nob_String_View sv, bool lanes) {
+	// the lane count is plain c, only what follows the first top level comma is tokenized
+	Nob_String_View count = {0};
+	if (lanes) {
+		i32 depth = 0;
+		for (u64 i = 0; i < sv.count; i++) {
+			depth += sv.data[i] == '(' ? 1 : sv.data[i] == ')' ? -1 : 0;
+			if (depth == 0 && sv.data[i] == ',') {
+				count = nob_sv_from_parts(sv.data, i);
+				sv = nob_sv_from_parts(sv.data + i + 1, sv.count - i - 1);
+				break;
+			}
+		}
+		try count.data == null or_fail("vecmath_lanes: missing lane count");
+	}
+
 	lexer_t lx = {.sv = sv};
 	da_t(token_t) tokens = {0};
 
@@ -382,12 +653,16 @@ Nob_String_Builder transpile_math(Nob_String_View sv) {
 
 	while (lx.curr) {
 		token_t token = lexer_next_token(&lx);
+		if (token.type == TT_EOF) {
+			break;	// trailing whitespace
+		}
 		nob_da_append(&tokens, token);
 
 		nob_log(NOB_INFO, "tok: %s - \"" SV_Fmt "\"", token_type_name[token.type], SV_Arg(token.literal));
 	}
 
-	Nob_String_Builder res = transpile_tokens((token_view_t){tokens.items, tokens.count});
+	token_view_t	   view = {tokens.items, tokens.count};
+	Nob_String_Builder res = lanes ? transpile_lanes(count, view) : transpile_tokens(view);
 
 	nob_da_free(tokens);
 	return res;
@@ -399,6 +674,8 @@ void apply_vecmath(const char** files, u64 len) {
 		const char* output = nob_temp_sprintf("%s/%s", build_path, file);
 
 		if (!nob_needs_rebuild1(output, file)) {
+			// transpiled copy is up to date, it must still be the one compiled
+			files[i] = output;
 			continue;
 		}
 
@@ -411,8 +688,8 @@ void apply_vecmath(const char** files, u64 len) {
 		char* curr = src.items;
 		char* found = null;
 
-		const char* vecmath = "vecmath" "(";
-		u64			next = slen(vecmath);
+		const char* vecmath = "vecmath";
+		const char* lanes_suffix = "_lanes(";
 
 		Nob_String_Builder out = {0};
 
@@ -422,6 +699,15 @@ void apply_vecmath(const char** files, u64 len) {
 				break;
 			}
 
+			// vecmath( or vecmath_lanes(, any other name that starts with vecmath is left alone
+			bool lanes = strncmp(found + slen(vecmath), lanes_suffix, slen(lanes_suffix)) == 0;
+			u64	 next = slen(vecmath) + (lanes ? slen(lanes_suffix) : 1);
+			if (!lanes && found[slen(vecmath)] != '(') {
+				nob_sb_append_buf(&out, curr, (found + slen(vecmath)) - curr);
+				curr = found + slen(vecmath);
+				continue;
+			}
+
 			if (is_define(found - 1, start)) {
 				// ignore
 				nob_sb_append_buf(&out, curr, (found + next) - curr);
@@ -438,7 +724,7 @@ void apply_vecmath(const char** files, u64 len) {
 			Nob_String_View sv = get_inside_p(found);
 			nob_log(NOB_INFO, "transpile: " SV_Fmt, SV_Arg(sv));
 
-			Nob_String_Builder transpiled = transpile_math(sv);
+			Nob_String_Builder transpiled = transpile_math(sv, lanes);
 			nob_sb_append_buf(&out, transpiled.items, transpiled.count);
 			nob_sb_free(transpiled);
 
@@ -460,6 +746,153 @@ void apply_vecmath(const char** files, u64 len) {
 	}
 }
 
+// :scene
+typedef struct {
+	f64 center[3];
+	f64 radius;
+	f64 power;	// of the camera, the squared tangent length; the unrolled tests go lowest first
+} baked_sphere_t;
+
+Nob_String_View sv_next_word(Nob_String_View* sv) {
+	*sv = nob_sv_trim_left(*sv);
+	u64 len = 0;
+	while (len < sv->count && !isspace(sv->data[len])) {
+		len++;
+	}
+	Nob_String_View word = nob_sv_from_parts(sv->data, len);
+	sv->data += len, sv->count -= len;
+	return word;
+}
+
+f64 sv_next_number(Nob_String_View* sv, const char* path, u64 line) {
+	Nob_String_View word = sv_next_word(sv);
+	char*			end = null;
+	f64				value = strtod(nob_temp_sv_to_cstr(word), &end);
+	try word.count == 0 || *end != '\0' or_failf("%s:%lu: expected a number, got \"" SV_Fmt "\"", path, line, SV_Arg(word));
+	return value;
+}
+
+int baked_sphere_compare(const void* a, const void* b) {
+	f64 da = ((const baked_sphere_t*)a)->power, db = ((const baked_sphere_t*)b)->power;
+	return da < db ? -1 : da > db;
+}
+
+// Turns a scene file into c: the primitives as data for the accelerators, and
+// scene_hit/scene_occluded with every sphere as immediates. Every statement is
+// checked like scene_parse does, only the ones the bake needs are kept.
+void bake_scene(const char* path, const char* output) {
+	if (!nob_needs_rebuild1(output, path)) {
+		return;
+	}
+
+	Nob_String_Builder src = {0};
+	try !nob_read_entire_file(path, &src) or_failf("unable to read scene: %s", path);
+
+	da_t(baked_sphere_t) spheres = {0};
+	f64 camera[3] = {0};
+
+	// the same statements scene_parse reads, anything else fails the bake as it would fail the load
+	Nob_String_View rest = nob_sv_from_parts(src.items, src.count);
+	for (u64 line = 1; rest.count > 0; line++) {
+		Nob_String_View sv = nob_sv_chop_by_delim(&rest, '\n');
+		const char*		comment = memchr(sv.data, '#', sv.count);
+		sv.count = comment != null ? (u64)(comment - sv.data) : sv.count;
+		Nob_String_View keyword = sv_next_word(&sv);
+
+		if (keyword.count == 0) {
+			continue;
+		}
+		if (nob_sv_eq(keyword, nob_sv_from_cstr("camera"))) {
+			for (u32 i = 0; i < 3; i++) {
+				camera[i] = sv_next_number(&sv, path, line);
+			}
+			sv_next_number(&sv, path, line), sv_next_number(&sv, path, line);
+		} else if (nob_sv_eq(keyword, nob_sv_from_cstr("sphere"))) {
+			baked_sphere_t s = {0};
+			for (u32 i = 0; i < 3; i++) {
+				s.center[i] = sv_next_number(&sv, path, line);
+			}
+			s.radius = sv_next_number(&sv, path, line);
+			nob_da_append(&spheres, s);
+		} else if (nob_sv_eq(keyword, nob_sv_from_cstr("image"))) {
+			sv_next_number(&sv, path, line), sv_next_number(&sv, path, line);
+		} else if (nob_sv_eq(keyword, nob_sv_from_cstr("samples")) || nob_sv_eq(keyword, nob_sv_from_cstr("bounces"))) {
+			sv_next_number(&sv, path, line);
+		} else {
+			nob_log(NOB_ERROR, "%s:%lu: unknown keyword \"" SV_Fmt "\"", path, line, SV_Arg(keyword));
+			exit(1);
+		}
+
+		Nob_String_View extra = sv_next_word(&sv);
+		try extra.count != 0 or_failf("%s:%lu: unexpected \"" SV_Fmt "\" after the statement", path, line, SV_Arg(extra));
+	}
+
+	for (u64 i = 0; i < spheres.count; i++) {
+		baked_sphere_t* s = &spheres.items[i];
+		f64				d[3] = {s->center[0] - camera[0], s->center[1] - camera[1], s->center[2] - camera[2]};
+		// orders like the distance to the surface for small spheres, and needs no libm in nob
+		s->power = d[0] * d[0] + d[1] * d[1] + d[2] * d[2] - s->radius * s->radius;
+	}
+
+	Nob_String_Builder out = {0};
+	nob_sb_append_cstr(&out, nob_temp_sprintf("// generated by nob from %s, edit the scene instead\n", path));
+	nob_sb_append_cstr(&out, "#include \"rt.h\"\n\n");
+	nob_sb_append_cstr(&out, nob_temp_sprintf("const char scene_baked_path[] = \"%s\";\n\n", path));
+
+	// %.17g round trips every double, the data matches what a parser would read
+	nob_sb_append_cstr(&out, "hittable_t scene_prims[] = {\n");
+	for (u64 i = 0; i < spheres.count; i++) {
+		baked_sphere_t b = spheres.items[i];
+		nob_sb_append_cstr(&out, nob_temp_sprintf("\t{.sphere = {SPHERE, {.x = %.17g, .y = %.17g, .z = %.17g}, %.17g}},\n",
+												  b.center[0], b.center[1], b.center[2], b.radius));
+	}
+	nob_sb_append_cstr(&out, nob_temp_sprintf("};\nconst u64 scene_prim_count = %lu;\n", spheres.count));
+
+	bool unrolled = spheres.count <= SCENE_UNROLL_MAX;
+	nob_sb_append_cstr(&out, nob_temp_sprintf("const bool scene_unrolled = %s;\n\n", unrolled ? "true" : "false"));
+
+	if (!unrolled) {
+		nob_sb_append_cstr(&out, "hit_t scene_hit(ray_t r, real_t mint, real_t maxt) {\n"
+								 "\treturn hit_many((hittable_view_t){scene_prims, scene_prim_count}, r, mint, maxt);\n}\n\n"
+								 "bool scene_occluded(ray_t r, real_t mint, real_t maxt) {\n"
+								 "\treturn occluded_many((hittable_view_t){scene_prims, scene_prim_count}, r, mint, maxt);\n}\n");
+	} else {
+		// nearest first, the first hit shrinks maxt for the rest and the first occluder ends the test
+		qsort(spheres.items, spheres.count, sizeof(*spheres.items), baked_sphere_compare);
+
+		// one call site in a loop the compiler unrolls, hit_sphere is then inlined once per sphere
+		// with the constants folded in; three separate calls were not inlined at all
+		nob_sb_append_cstr(&out, "static const sphere_t scene_order[] = {\n");
+		for (u64 i = 0; i < spheres.count; i++) {
+			baked_sphere_t b = spheres.items[i];
+			nob_sb_append_cstr(&out, nob_temp_sprintf("\t{SPHERE, {.x = %.17g, .y = %.17g, .z = %.17g}, %.17g},\n", b.center[0],
+													  b.center[1], b.center[2], b.radius));
+		}
+		nob_sb_append_cstr(&out, "};\n\n");
+
+		nob_sb_append_cstr(&out, nob_temp_sprintf("KERNEL hit_t scene_hit(ray_t r, real_t mint, real_t maxt) {\n"
+												  "\thit_t result = {0};\n"
+												  "#pragma GCC unroll %d\n"
+												  "\tfor (u64 i = 0; i < %lu; i++) {\n"
+												  "\t\thit_t hit = hit_sphere(scene_order[i], r, mint, maxt);\n"
+												  "\t\tif (hit.is_hit) {\n\t\t\tresult = hit;\n\t\t\tmaxt = hit.t;\n\t\t}\n"
+												  "\t}\n\treturn result;\n}\n\n",
+												  SCENE_UNROLL_MAX, spheres.count));
+		nob_sb_append_cstr(&out, nob_temp_sprintf("KERNEL bool scene_occluded(ray_t r, real_t mint, real_t maxt) {\n"
+												  "#pragma GCC unroll %d\n"
+												  "\tfor (u64 i = 0; i < %lu; i++) {\n"
+												  "\t\tif (occluded_sphere(scene_order[i], r, mint, maxt)) {\n\t\t\treturn true;\n\t\t}\n"
+												  "\t}\n\treturn false;\n}\n",
+												  SCENE_UNROLL_MAX, spheres.count));
+	}
+
+	nob_log(NOB_INFO, "baked %lu spheres from %s%s", spheres.count, path, unrolled ? ", unrolled" : "");
+	try !nob_write_entire_file(output, out.items, out.count) or_failf("unable to write %s", output);
+
+	nob_sb_free(src);
+	nob_sb_free(out);
+	nob_da_free(spheres);
+}
 
 i32 main(i32 argc, char** argv) {
 	NOB_GO_REBUILD_URSELF_PLUS(argc, argv, "src/msk.h", "src/msk.c");
@@ -473,26 +906,83 @@ i32 main(i32 argc, char** argv) {
 	try !nob_mkdir_if_not_exists("build/src") or_fail("failed to create build/src dir");
 	try !nob_mkdir_if_not_exists("build/tests") or_fail("failed to create build/tests dir");
 
+	bake_scene(scene_path, scene_output);
 	apply_vecmath(arr(rt_srcs));
 	const char *rt_output = nob_temp_sprintf("%s/%s", build_path, rt_program);
 
-	if (nob_needs_rebuild(rt_output, rt_srcs, NOB_ARRAY_LEN(rt_srcs))) {
+	if (nob_needs_rebuild(rt_output, rt_srcs, NOB_ARRAY_LEN(rt_srcs)) || nob_needs_rebuild1(rt_output, scene_output)) {
 		nob_cmd_append(&cmd, CC, CFLAGS, "-o", rt_output);
 		nob_da_append_many(&cmd, rt_srcs, NOB_ARRAY_LEN(rt_srcs));
+		nob_cmd_append(&cmd, scene_output);
+		nob_cmd_append(&cmd, LDFLAGS);
 
 		try !nob_cmd_run_sync_and_reset(&cmd) or_fail("failed to compile rt");
 	}
 
+	const char* rt_f32_output = nob_temp_sprintf("%s/%s", build_path, rt_f32_program);
+
+	if (nob_needs_rebuild(rt_f32_output, rt_srcs, NOB_ARRAY_LEN(rt_srcs)) || nob_needs_rebuild1(rt_f32_output, scene_output)) {
+		nob_cmd_append(&cmd, CC, CFLAGS, F32_FLAGS, "-o", rt_f32_output);
+		nob_da_append_many(&cmd, rt_srcs, NOB_ARRAY_LEN(rt_srcs));
+		nob_cmd_append(&cmd, scene_output);
+		nob_cmd_append(&cmd, LDFLAGS);
+
+		try !nob_cmd_run_sync_and_reset(&cmd) or_fail("failed to compile rt f32");
+	}
+
+	const char* rt_simd_output = nob_temp_sprintf("%s/%s", build_path, rt_simd_program);
+
+	if (nob_needs_rebuild(rt_simd_output, rt_srcs, NOB_ARRAY_LEN(rt_srcs)) || nob_needs_rebuild1(rt_simd_output, scene_output)) {
+		nob_cmd_append(&cmd, CC, CFLAGS, SIMD_FLAGS, "-o", rt_simd_output);
+		nob_da_append_many(&cmd, rt_srcs, NOB_ARRAY_LEN(rt_srcs));
+		nob_cmd_append(&cmd, scene_output);
+		nob_cmd_append(&cmd, LDFLAGS);
+
+		try !nob_cmd_run_sync_and_reset(&cmd) or_fail("failed to compile rt simd");
+	}
+
 	apply_vecmath(arr(test_srcs));
 	const char *test_output = nob_temp_sprintf("%s/%s", build_path, test_program);
 
 	if (nob_needs_rebuild(test_output, test_srcs, NOB_ARRAY_LEN(test_srcs))) {
 		nob_cmd_append(&cmd, CC, CFLAGS, "-o", test_output);
 		nob_da_append_many(&cmd, test_srcs, NOB_ARRAY_LEN(test_srcs));
+		nob_cmd_append(&cmd, LDFLAGS);
 
 		try !nob_cmd_run_sync_and_reset(&cmd) or_fail("failed to compile tests");
 	}
 
+	apply_vecmath(arr(bench_srcs));
+	const char *bench_output = nob_temp_sprintf("%s/%s", build_path, bench_program);
+
+	if (nob_needs_rebuild(bench_output, bench_srcs, NOB_ARRAY_LEN(bench_srcs))) {
+		nob_cmd_append(&cmd, CC, CFLAGS, "-o", bench_output);
+		nob_da_append_many(&cmd, bench_srcs, NOB_ARRAY_LEN(bench_srcs));
+		nob_cmd_append(&cmd, LDFLAGS);
+
+		try !nob_cmd_run_sync_and_reset(&cmd) or_fail("failed to compile bench");
+	}
+
+	const char* bench_f32_output = nob_temp_sprintf("%s/%s", build_path, bench_f32_program);
+
+	if (nob_needs_rebuild(bench_f32_output, bench_srcs, NOB_ARRAY_LEN(bench_srcs))) {
+		nob_cmd_append(&cmd, CC, CFLAGS, F32_FLAGS, "-o", bench_f32_output);
+		nob_da_append_many(&cmd, bench_srcs, NOB_ARRAY_LEN(bench_srcs));
+		nob_cmd_append(&cmd, LDFLAGS);
+
+		try !nob_cmd_run_sync_and_reset(&cmd) or_fail("failed to compile bench f32");
+	}
+
+	const char* bench_simd_output = nob_temp_sprintf("%s/%s", build_path, bench_simd_program);
+
+	if (nob_needs_rebuild(bench_simd_output, bench_srcs, NOB_ARRAY_LEN(bench_srcs))) {
+		nob_cmd_append(&cmd, CC, CFLAGS, SIMD_FLAGS, "-o", bench_simd_output);
+		nob_da_append_many(&cmd, bench_srcs, NOB_ARRAY_LEN(bench_srcs));
+		nob_cmd_append(&cmd, LDFLAGS);
+
+		try !nob_cmd_run_sync_and_reset(&cmd) or_fail("failed to compile bench simd");
+	}
+
 	if (!strcmp(command, "run")) {
 		nob_cmd_append(&cmd, rt_output);
 		try !nob_cmd_run_sync(cmd) or_fail("./main returned bad status code");
@@ -500,6 +990,14 @@ i32 main(i32 argc, char** argv) {
 		return 0;
 	}
 
+	if (!strcmp(command, "bench")) {
+		nob_cmd_append(&cmd, bench_output);
+		nob_da_append_many(&cmd, argv, argc);  // optional benchmark name
+		try !nob_cmd_run_sync(cmd) or_fail("./bench returned bad status code");
+
+		return 0;
+	}
+
 	if (!strcmp(command, "test")) {
 		nob_cmd_append(&cmd, test_output);
 		try !nob_cmd_run_sync(cmd) or_fail("TEST FAILED");
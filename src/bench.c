@@ -0,0 +1,976 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "rt.h"
+
+// benchmarks, `./nob bench [name]` runs all of them or only the named one
+
+// :scene
+static f64 bench_rand(f64 min, f64 max) {
+	return min + (max - min) * ((f64)rand() / RAND_MAX);
+}
+
+// the "random small spheres" layout, evenly spread with similar radii
+static hittable_view_t bench_sphere_field(context_t ctx, u64 count, f64 size) {
+	hittable_view_t hs = {.items = alloc(ctx, count * sizeof(hittable_t)), .count = count};
+	for (u64 i = 0; i < count; i++) {
+		hs.items[i].sphere = (sphere_t){
+			.type = SPHERE,
+			.center = vec3(bench_rand(-size, size), bench_rand(-size, size), bench_rand(-size, size)),
+			.radius = bench_rand(0.15, 0.25),
+		};
+	}
+	return hs;
+}
+
+static ray_t bench_ray(f64 size) {
+	return (ray_t){
+		.origin = vec3(bench_rand(-size, size), bench_rand(-size, size), bench_rand(-size, size)),
+		.direction = vec3(bench_rand(-1, 1), bench_rand(-1, 1), bench_rand(-1, 1)),
+	};
+}
+
+static ray_t* bench_rays(context_t ctx, u64 count, f64 size) {
+	ray_t* rays = alloc(ctx, count * sizeof(ray_t));
+	for (u64 i = 0; i < count; i++) {
+		rays[i] = bench_ray(size);
+	}
+	return rays;
+}
+
+// :accel
+static void bench_accel_one(context_t ctx, const char* name, hittable_view_t hs, f64 size) {
+	const u64 ray_count = 200000;
+	ray_t*	  rays = bench_rays(ctx, ray_count, size);
+
+	const char* names[] = {[ACCEL_BVH] = "bvh", [ACCEL_GRID] = "grid"};
+	printf("%-22s %8lu prims, heuristic picks %s\n", name, hs.count, names[accel_choose(hs)]);
+
+	for (accel_type_t type = ACCEL_BVH; type <= ACCEL_GRID; type++) {
+		f64		start = time_now();
+		accel_t accel = accel_build(ctx, type, hs);
+		f64		build = time_now() - start;
+
+		u64 hits = 0;
+		start = time_now();
+		for (u64 i = 0; i < ray_count; i++) {
+			hits += accel_hit(&accel, rays[i], 0.0001, 1e9).is_hit;
+		}
+		f64 trace = time_now() - start;
+
+		printf("    %-5s build %8.2f ms  %7.2f Mrays/s  (%lu hits)\n", names[type], build * 1e3,
+			   ray_count / trace / 1e6, hits);
+		accel_destroy(&accel);
+	}
+
+	dealloc(ctx, rays);
+}
+
+static void bench_accel(context_t ctx) {
+	srand(28);
+	const u64 counts[] = {10000, 100000, 1000000};
+
+	for (u64 i = 0; i < sizeof(counts) / sizeof(*counts); i++) {
+		// constant density, about one sphere per 8 units of volume
+		f64				size = cbrt(counts[i]);
+		hittable_view_t hs = bench_sphere_field(ctx, counts[i], size);
+		bench_accel_one(ctx, "sphere field", hs, size);
+
+		// same field on top of a huge ground sphere
+		hs.items[0].sphere = (sphere_t){SPHERE, vec3(0, -1000 - size, 0), 1000};
+		bench_accel_one(ctx, "sphere field + ground", hs, size);
+
+		dealloc(ctx, hs.items);
+	}
+}
+
+// :occlusion
+static void bench_occlusion(context_t ctx) {
+	srand(29);
+	const u64 prim_count = 100000;
+	const u64 ray_count = 200000;
+
+	f64				size = cbrt(prim_count);
+	hittable_view_t hs = bench_sphere_field(ctx, prim_count, size);
+	ray_t*			rays = bench_rays(ctx, ray_count, size);
+
+	const char* names[] = {[ACCEL_BVH] = "bvh", [ACCEL_GRID] = "grid"};
+	for (accel_type_t type = ACCEL_BVH; type <= ACCEL_GRID; type++) {
+		accel_t accel = accel_build(ctx, type, hs);
+
+		// short segments like shadow rays towards a nearby light, and unbounded ones
+		const f64 lengths[] = {4, 1e9};
+		for (u64 l = 0; l < sizeof(lengths) / sizeof(*lengths); l++) {
+			u64 hits = 0, occluded = 0;
+
+			f64 start = time_now();
+			for (u64 i = 0; i < ray_count; i++) {
+				hits += accel_hit(&accel, rays[i], 0.0001, lengths[l]).is_hit;
+			}
+			f64 closest = time_now() - start;
+
+			start = time_now();
+			for (u64 i = 0; i < ray_count; i++) {
+				occluded += accel_occluded(&accel, rays[i], 0.0001, lengths[l]);
+			}
+			f64 any = time_now() - start;
+
+			printf("%-5s maxt %-6g closest %6.2f Mrays/s  occluded %6.2f Mrays/s  %.2fx  (%lu/%lu)\n", names[type],
+				   lengths[l], ray_count / closest / 1e6, ray_count / any / 1e6, closest / any, hits, occluded);
+		}
+		accel_destroy(&accel);
+	}
+
+	dealloc(ctx, rays);
+	dealloc(ctx, hs.items);
+}
+
+// :packet
+static void bench_packet(context_t ctx) {
+	srand(30);
+	const u64 res = 512;
+	const u64 counts[] = {1000, 100000};
+
+	for (u64 c = 0; c < sizeof(counts) / sizeof(*counts); c++) {
+		f64				size = cbrt(counts[c]);
+		hittable_view_t hs = bench_sphere_field(ctx, counts[c], size);
+		world_t			world = {.accel = accel_build(ctx, ACCEL_BVH, hs)};
+
+		// pinhole camera outside the field, looking down -z
+		ray_t* rays = alloc(ctx, res * res * sizeof(ray_t));
+		hit_t* hits = alloc(ctx, res * res * sizeof(hit_t));
+		for (u64 y = 0; y < res; y++) {
+			for (u64 x = 0; x < res; x++) {
+				rays[y * res + x] = (ray_t){vec3(0, 0, 3 * size), vec3((f64)x / res - 0.5, (f64)y / res - 0.5, -1)};
+			}
+		}
+
+		u64 single_hits = 0, packet_hits = 0;
+		f64 start = time_now();
+		for (u64 i = 0; i < res * res; i++) {
+			single_hits += world_hit(&world, rays[i], 0.0001, 1e9).is_hit;
+		}
+		f64 single = time_now() - start;
+
+		// the image in rows of PACKET_DIM, as the renderer would hand out tiles
+		start = time_now();
+		for (u64 y = 0; y < res; y += PACKET_DIM) {
+			world_hit_block(&world, rays + y * res, res, PACKET_DIM, 0.0001, 1e9, hits + y * res);
+		}
+		f64 packet = time_now() - start;
+		for (u64 i = 0; i < res * res; i++) {
+			packet_hits += hits[i].is_hit;
+		}
+
+		printf("%7lu prims  single %6.2f Mrays/s  packet %6.2f Mrays/s  %.2fx  (%lu/%lu hits)\n", hs.count,
+			   res * res / single / 1e6, res * res / packet / 1e6, single / packet, single_hits, packet_hits);
+
+		dealloc(ctx, rays);
+		dealloc(ctx, hits);
+		accel_destroy(&world.accel);
+		dealloc(ctx, hs.items);
+	}
+}
+
+// :wavefront
+static void bench_wavefront(context_t ctx) {
+	srand(31);
+	const u64 res = 128;
+	const u64 spp = 4;
+	const i32 bounces = 16;
+
+	// everything within RAY_MAXT of the camera
+	hittable_view_t hs = bench_sphere_field(ctx, 20000, 4);
+	for (u64 i = 0; i < hs.count; i++) {
+		hs.items[i].sphere.radius *= 0.4;
+	}
+	world_t world = {.accel = accel_build(ctx, ACCEL_BVH, hs)};
+
+	u64		count = res * res * spp;
+	ray_t*	rays = alloc(ctx, count * sizeof(ray_t));
+	u32*	pixels = alloc(ctx, count * sizeof(u32));
+	vec3_t* accum = alloc(ctx, res * res * sizeof(vec3_t));
+	for (u64 i = 0; i < count; i++) {
+		u64 pixel = i / spp;
+		rays[i] = (ray_t){vec3(0, 0, 5),
+						  vec3((pixel % res) / (f64)res - 0.5 + bench_rand(0, 1. / res), (pixel / res) / (f64)res - 0.5, -1)};
+		pixels[i] = pixel;
+	}
+
+	f64 start = time_now();
+	for (u64 i = 0; i < count; i++) {
+		vec3p_add(&accum[pixels[i]], ray_color(rays[i], &world, bounces));
+	}
+	f64 depth_first = time_now() - start;
+
+	const u64 capacities[] = {4096, 65536, 1 << 20};
+	for (u64 c = 0; c < sizeof(capacities) / sizeof(*capacities); c++) {
+		wavefront_t wf = wavefront_create(ctx, capacities[c]);
+
+		start = time_now();
+		wavefront_render(&wf, &world, rays, pixels, count, bounces, accum);
+		f64 wavefront = time_now() - start;
+
+		printf("%lu paths  depth first %6.3f s  wavefront (queue %7lu) %6.3f s  %.2fx\n", count, depth_first,
+			   capacities[c], wavefront, depth_first / wavefront);
+		wavefront_destroy(&wf);
+	}
+
+	dealloc(ctx, rays);
+	dealloc(ctx, pixels);
+	dealloc(ctx, accum);
+	accel_destroy(&world.accel);
+	dealloc(ctx, hs.items);
+}
+
+// :reorder
+static void bench_reorder(context_t ctx) {
+	srand(32);
+	const u64 counts[] = {10000, 1000000, 4000000};
+	const u64 path_count = 1 << 18;
+	const i32 bounces = 8;
+
+	for (u64 c = 0; c < sizeof(counts) / sizeof(*counts); c++) {
+		// about one sphere per unit of volume, so most bounces hit again within RAY_MAXT
+		f64				size = cbrt(counts[c]) / 2;
+		hittable_view_t hs = bench_sphere_field(ctx, counts[c], size);
+		world_t			world = {.accel = accel_build(ctx, ACCEL_BVH, hs)};
+
+		ray_t*	rays = alloc(ctx, path_count * sizeof(ray_t));
+		u32*	pixels = alloc(ctx, path_count * sizeof(u32));
+		vec3_t* accum = alloc(ctx, sizeof(vec3_t));
+		for (u64 i = 0; i < path_count; i++) {
+			rays[i] = (ray_t){vec3(0, 0, 0), vec3_rand_unit()};
+			pixels[i] = 0;
+		}
+
+		f64 times[2], sort = 0;
+		for (u32 reorder = 0; reorder < 2; reorder++) {
+			wavefront_t wf = wavefront_create(ctx, path_count);
+			wf.reorder = reorder;
+
+			f64 start = time_now();
+			wavefront_render(&wf, &world, rays, pixels, path_count, bounces, accum);
+			times[reorder] = time_now() - start;
+			sort = wf.sort_seconds;
+			wavefront_destroy(&wf);
+		}
+
+		f64 saved = times[0] - (times[1] - sort);
+		printf("%8lu prims  unsorted %6.3f s  sorted %6.3f s (sort %.3f s, traversal saved %.3f s)  %.2fx\n", hs.count,
+			   times[0], times[1], sort, saved, times[0] / times[1]);
+
+		dealloc(ctx, rays);
+		dealloc(ctx, pixels);
+		dealloc(ctx, accum);
+		accel_destroy(&world.accel);
+		dealloc(ctx, hs.items);
+	}
+}
+
+// :stream
+static void bench_stream(context_t ctx) {
+	srand(33);
+	const u64 counts[] = {10000, 100000, 1000000, 4000000};
+	const u64 ray_count = 500000;
+
+	for (u64 c = 0; c < sizeof(counts) / sizeof(*counts); c++) {
+		f64				size = cbrt(counts[c]);
+		hittable_view_t hs = bench_sphere_field(ctx, counts[c], size);
+		bvh_t			bvh = bvh_build(ctx, hs);
+		ray_t*			rays = bench_rays(ctx, ray_count, size);
+		hit_t*			hits = alloc(ctx, ray_count * sizeof(hit_t));
+
+		u64 single_hits = 0, stream_hits = 0;
+		f64 start = time_now();
+		for (u64 i = 0; i < ray_count; i++) {
+			single_hits += bvh_hit(&bvh, rays[i], 0.0001, 1e9).is_hit;
+		}
+		f64 single = time_now() - start;
+
+		start = time_now();
+		bvh_hit_stream(&bvh, rays, ray_count, 0.0001, 1e9, hits);
+		f64 stream = time_now() - start;
+		for (u64 i = 0; i < ray_count; i++) {
+			stream_hits += hits[i].is_hit;
+		}
+
+		printf("%8lu prims (%6.1f MB of nodes)  single %6.2f Mrays/s  stream %6.2f Mrays/s  %.2fx  (%lu/%lu hits)\n",
+			   hs.count, bvh.node_count * sizeof(bvh_node_t) / 1e6, ray_count / single / 1e6, ray_count / stream / 1e6,
+			   single / stream, single_hits, stream_hits);
+
+		dealloc(ctx, rays);
+		dealloc(ctx, hits);
+		bvh_destroy(&bvh);
+		dealloc(ctx, hs.items);
+	}
+}
+
+// :tile
+static void bench_tile(context_t ctx) {
+	srand(34);
+	const u64 res = 512;
+	const u64 counts[] = {100, 1000, 10000, 100000};
+
+	for (u64 c = 0; c < sizeof(counts) / sizeof(*counts); c++) {
+		f64				size = cbrt(counts[c]);
+		hittable_view_t hs = bench_sphere_field(ctx, counts[c], size);
+		world_t			world = {.accel = accel_build(ctx, ACCEL_BVH, hs)};
+		vec3_t			origin = vec3(0, 0, 3 * size);
+
+		// same camera as the packet bench
+		ray_t* rays = alloc(ctx, res * res * sizeof(ray_t));
+		hit_t* hits = alloc(ctx, res * res * sizeof(hit_t));
+		for (u64 y = 0; y < res; y++) {
+			for (u64 x = 0; x < res; x++) {
+				rays[y * res + x] = (ray_t){origin, vec3((f64)x / res - 0.5, (f64)y / res - 0.5, -1)};
+			}
+		}
+
+		u64 bvh_hits = 0, tile_hits = 0;
+		f64 start = time_now();
+		for (u64 i = 0; i < res * res; i++) {
+			bvh_hits += world_hit(&world, rays[i], 0.0001, 1e9).is_hit;
+		}
+		f64 bvh = time_now() - start;
+
+		start = time_now();
+		for (u64 y = 0; y < res; y += PACKET_DIM) {
+			world_hit_block(&world, rays + y * res, res, PACKET_DIM, 0.0001, 1e9, hits + y * res);
+		}
+		f64 packet = time_now() - start;
+
+		// the culling pass is part of the tile time
+		hittable_t* list = alloc(ctx, hs.count * sizeof(hittable_t));
+		u64			listed = 0;
+		start = time_now();
+		for (u64 ty = 0; ty < res; ty += TILE_SIZE) {
+			for (u64 tx = 0; tx < res; tx += TILE_SIZE) {
+				vec3_t	  corner = vec3_add(origin, rays[ty * res + tx].direction);
+				frustum_t f = frustum_create(origin, corner, vec3((f64)TILE_SIZE / res, 0, 0), vec3(0, (f64)TILE_SIZE / res, 0));
+
+				hittable_view_t tile = {.items = list, .count = tile_cull(&f, hs, list)};
+				listed += tile.count;
+				for (u64 y = ty; y < ty + TILE_SIZE; y++) {
+					for (u64 x = tx; x < tx + TILE_SIZE; x++) {
+						hits[y * res + x] = hit_many(tile, rays[y * res + x], 0.0001, 1e9);
+					}
+				}
+			}
+		}
+		f64 tile = time_now() - start;
+		for (u64 i = 0; i < res * res; i++) {
+			tile_hits += hits[i].is_hit;
+		}
+
+		// same tiles over per kind arrays, no switch per primitive
+		hittable_set_t all = hittable_set_build(ctx, hs);
+		hittable_set_t tile_set = hittable_set_build(ctx, hs);
+		u64			   set_hits = 0;
+		start = time_now();
+		for (u64 ty = 0; ty < res; ty += TILE_SIZE) {
+			for (u64 tx = 0; tx < res; tx += TILE_SIZE) {
+				vec3_t	  corner = vec3_add(origin, rays[ty * res + tx].direction);
+				frustum_t f = frustum_create(origin, corner, vec3((f64)TILE_SIZE / res, 0, 0), vec3(0, (f64)TILE_SIZE / res, 0));
+
+				tile_cull_set(&f, &all, &tile_set);
+				for (u64 y = ty; y < ty + TILE_SIZE; y++) {
+					for (u64 x = tx; x < tx + TILE_SIZE; x++) {
+						hits[y * res + x] = hit_set(&tile_set, rays[y * res + x], 0.0001, 1e9);
+					}
+				}
+			}
+		}
+		f64 sets = time_now() - start;
+		for (u64 i = 0; i < res * res; i++) {
+			set_hits += hits[i].is_hit;
+		}
+
+		u64 tile_count = (res / TILE_SIZE) * (res / TILE_SIZE);
+		printf("%7lu prims (%6.1f per tile)  bvh %6.2f  packet %6.2f  tiles %6.2f  sets %6.2f Mrays/s  (%lu/%lu/%lu hits)\n",
+			   hs.count, (f64)listed / tile_count, res * res / bvh / 1e6, res * res / packet / 1e6, res * res / tile / 1e6,
+			   res * res / sets / 1e6, bvh_hits, tile_hits, set_hits);
+
+		hittable_set_destroy(&all);
+		hittable_set_destroy(&tile_set);
+		dealloc(ctx, list);
+		dealloc(ctx, rays);
+		dealloc(ctx, hits);
+		accel_destroy(&world.accel);
+		dealloc(ctx, hs.items);
+	}
+}
+
+// :gbuffer
+static void bench_gbuffer(context_t ctx) {
+	srand(35);
+	const u64 res = 64;
+	const u64 dim = 20;	 // samples per pixel side, as in main
+	const u64 counts[] = {3, 100, 10000};
+
+	for (u64 c = 0; c < sizeof(counts) / sizeof(*counts); c++) {
+		// a few big spheres in the middle of the view, the rest is sky
+		f64				size = cbrt(counts[c]);
+		hittable_view_t hs = bench_sphere_field(ctx, counts[c], size);
+		for (u64 i = 0; i < hs.count; i++) {
+			hs.items[i].sphere.radius *= counts[c] < 1000 ? 2 : 1;
+		}
+		world_t world = {.accel = accel_build(ctx, ACCEL_BVH, hs)};
+		vec3_t	origin = vec3(0, 0, 3 * size);
+
+		ray_t* samples = alloc(ctx, res * res * dim * dim * sizeof(ray_t));
+		for (u64 p = 0; p < res * res; p++) {
+			for (u64 s = 0; s < dim * dim; s++) {
+				f64 x = (p % res + (f64)(s % dim) / dim) / res - 0.5;
+				f64 y = (p / res + (f64)(s / dim) / dim) / res - 0.5;
+				samples[p * dim * dim + s] = (ray_t){origin, vec3(x, y, -1)};
+			}
+		}
+
+		hit_t* expected = alloc(ctx, dim * dim * sizeof(hit_t));
+		hit_t* got = alloc(ctx, dim * dim * sizeof(hit_t));
+
+		f64 full = 0, probe = 0, cached = 0;
+		u64 kinds[3] = {0}, wrong = 0;
+		for (u64 p = 0; p < res * res; p++) {
+			ray_t* rays = samples + p * dim * dim;
+
+			f64 start = time_now();
+			world_hit_block(&world, rays, dim, dim, 0.0001, 1e9, expected);
+			full += time_now() - start;
+
+			start = time_now();
+			gbuffer_pixel_t px = gbuffer_probe(&world, rays, dim, dim, 0.0001, 1e9);
+			probe += time_now() - start;
+
+			start = time_now();
+			gbuffer_hit_block(&world, px, rays, dim, dim, 0.0001, 1e9, got);
+			cached += time_now() - start;
+
+			kinds[px.kind]++;
+			// the cached path intersects the primitive again, t may differ in the last bits
+			for (u64 s = 0; s < dim * dim; s++) {
+				wrong += got[s].is_hit != expected[s].is_hit || fabs(got[s].t - expected[s].t) > 64 * REAL_EPSILON * expected[s].t;
+			}
+		}
+
+		printf("%6lu prims  sky %4.1f%%  uniform %4.1f%%  mixed %4.1f%%  packets %6.3f s  g-buffer %6.3f s + %6.3f s  %.2fx  "
+			   "(%lu wrong hits)\n",
+			   hs.count, 100. * kinds[GBUFFER_SKY] / (res * res), 100. * kinds[GBUFFER_UNIFORM] / (res * res),
+			   100. * kinds[GBUFFER_MIXED] / (res * res), full, probe, cached, full / (probe + cached), wrong);
+
+		dealloc(ctx, expected);
+		dealloc(ctx, got);
+		dealloc(ctx, samples);
+		accel_destroy(&world.accel);
+		dealloc(ctx, hs.items);
+	}
+}
+
+// :scene_file
+static void bench_scene_file(context_t ctx) {
+	srand(37);
+	const u64 counts[] = {10000, 1000000};
+
+	for (u64 c = 0; c < sizeof(counts) / sizeof(*counts); c++) {
+		char  path[] = "/tmp/bench_scene_XXXXXX";
+		int	  fd = mkstemp(path);
+		FILE* f = fdopen(fd, "w");
+		fprintf(f, "camera 0 0 1  2  2\nimage 256 144\nsamples 20\nbounces 100\n");
+
+		// written the way a person or an exporter would, a few decimals per number
+		f64 size = cbrt(counts[c]);
+		for (u64 i = 0; i < counts[c]; i++) {
+			fprintf(f, "sphere %.4f %.4f %.4f %.3f\n", bench_rand(-size, size), bench_rand(-size, size),
+					bench_rand(-size, size), bench_rand(0.15, 0.25));
+		}
+		u64 bytes = ftell(f);
+		fclose(f);
+
+		// best of a few, the first one also pays for the page cache
+		f64		best = 1e9;
+		scene_t scene = {0};
+		for (u32 run = 0; run < 5; run++) {
+			f64 start = time_now();
+			try scene_load(ctx, path, &scene) or_fail("failed loading the bench scene");
+			f64 seconds = time_now() - start;
+			best = seconds < best ? seconds : best;
+
+			if (run != 4) {
+				scene_destroy(&scene);
+			}
+		}
+
+		printf("%8lu spheres (%6.1f MB)  load %8.4fs  %7.1f MB/s  %6.2f Mprims/s\n", scene.prims.count, bytes / 1e6, best,
+			   bytes / best / 1e6, scene.prims.count / best / 1e6);
+
+		scene_destroy(&scene);
+		unlink(path);
+	}
+}
+
+// :server
+typedef struct {
+	f64 start, first_tile;
+} bench_server_timing_t;
+
+static void bench_server_on_tile(void* user, const image_t* img, render_tile_t tile) {
+	(void)img;
+	bench_server_timing_t* t = user;
+	if (tile.index == 1) {
+		t->first_tile = time_now() - t->start;
+	}
+}
+
+static void bench_server(context_t ctx) {
+	srand(38);
+	const u64 count = 100000;
+
+	char  scene_path[] = "/tmp/bench_server_scene_XXXXXX";
+	FILE* f = fdopen(mkstemp(scene_path), "w");
+	fprintf(f, "camera 0 0 60  2  2\nimage 256 144\nsamples 4\nbounces 4\n");
+	f64 size = cbrt(count);
+	for (u64 i = 0; i < count; i++) {
+		fprintf(f, "sphere %.4f %.4f %.4f %.3f\n", bench_rand(-size, size), bench_rand(-size, size), bench_rand(-size, size),
+				bench_rand(0.15, 0.25));
+	}
+	fclose(f);
+
+	char socket_path[] = "/tmp/bench_server_socket_XXXXXX";
+	close(mkstemp(socket_path));
+
+	server_t server = {0};
+	try server_create(ctx, socket_path, &server) or_fail("failed to start the bench server");
+	pid_t pid = fork();
+	if (pid == 0) {
+		server_serve_one(&server);
+		_exit(0);
+	}
+	close(server.listen_fd);
+
+	int fd = -1;
+	try client_connect(socket_path, &fd) or_fail("failed to connect to the bench server");
+
+	// the first request pays for loading the scene and building its bvh, the rest find it resident
+	for (u32 i = 0; i < 4; i++) {
+		bench_server_timing_t t = {.start = time_now()};
+		image_t*			  img;
+		try client_render(ctx, fd, (server_request_t){.mode = RENDER_PACKETS, .bounces = -1}, scene_path, &img,
+						  bench_server_on_tile, &t) or_fail("bench render failed");
+		f64 total = time_now() - t.start;
+
+		printf("%-5s %lu spheres  first tile %8.2f ms  image %8.2f ms\n", i == 0 ? "cold" : "warm", count,
+			   t.first_tile * 1e3, total * 1e3);
+		image_destroy(img);
+	}
+
+	close(fd);
+	waitpid(pid, null, 0);
+	unlink(scene_path);
+	unlink(socket_path);
+}
+
+// :scheduler
+static void bench_scheduler(context_t ctx) {
+	srand(39);
+	const u64 count = 10000;
+
+	scene_t scene = scene_default(ctx);
+	f64		size = cbrt(count);
+	for (u64 i = 0; i < count; i++) {
+		vec3_t	   center = vec3(bench_rand(-size, size), bench_rand(-size, size), bench_rand(-size, size));
+		hittable_t h = {.sphere = {SPHERE, center, bench_rand(0.15, 0.25)}};
+		darr_append(&scene.prims, h);
+	}
+	scene.camera.center = vec3(0, 0, 40);
+	render_scene_t rs = render_scene_create(ctx, scene, null);
+
+	// a batch final is a quarter done when a preview comes in: queued behind it, sharing with it, ahead of it
+	const char* policies[] = {"fifo", "share", "priority"};
+	for (u32 run = 0; run < 3; run++) {
+		render_job_t batch = render_job_create(ctx, &rs, RENDER_PACKETS);
+		render_job_t preview = render_job_create(ctx, &rs, RENDER_PACKETS);
+		batch.samples = 4, batch.bounces = 4;
+		preview.samples = 1, preview.bounces = 1;
+		image_t* batch_img = image_create(ctx, 512, 288);
+		image_t* preview_img = image_create(ctx, 128, 72);
+
+		scheduler_t s = scheduler_create(ctx);
+		u64			batch_id = scheduler_submit(&s, &batch, batch_img, (sched_params_t){0});
+		while (scheduler_job(&s, batch_id)->tiles_done * 4 < scheduler_job(&s, batch_id)->tiles_total) {
+			scheduler_step(&s);
+		}
+
+		f64 arrived = time_now();
+		if (run == 0) {
+			while (scheduler_step(&s) != 0) {
+			}
+		}
+		u64			  preview_id = scheduler_submit(&s, &preview, preview_img, (sched_params_t){.priority = run == 2});
+		sched_stats_t queued = scheduler_stats(&s);
+		while (scheduler_step(&s) != 0) {
+		}
+
+		const sched_job_t* p = scheduler_job(&s, preview_id);
+		const sched_job_t* b = scheduler_job(&s, batch_id);
+		printf("%-8s queued %lu jobs %4lu tiles  preview %8.2f ms (%6.0f tiles/s)  batch %8.2f ms\n", policies[run],
+			   queued.jobs_queued, queued.tiles_queued, (p->finished - arrived) * 1e3, sched_job_throughput(p),
+			   (b->finished - b->submitted) * 1e3);
+
+		scheduler_destroy(&s);
+		image_destroy(preview_img);
+		image_destroy(batch_img);
+		render_job_destroy(&preview);
+		render_job_destroy(&batch);
+	}
+
+	// two finals at 3:1, the share holds in busy time whatever the tiles cost
+	render_job_t jobs[2];
+	image_t*	 imgs[2];
+	scheduler_t	 s = scheduler_create(ctx);
+	u64			 ids[2];
+	for (u32 i = 0; i < 2; i++) {
+		jobs[i] = render_job_create(ctx, &rs, RENDER_PACKETS);
+		jobs[i].samples = 2, jobs[i].bounces = 4;
+		imgs[i] = image_create(ctx, 512, 288);
+		ids[i] = scheduler_submit(&s, &jobs[i], imgs[i], (sched_params_t){.weight = i == 0 ? 3 : 1});
+	}
+	while (!scheduler_job(&s, ids[0])->done && !scheduler_job(&s, ids[1])->done) {
+		scheduler_step(&s);
+	}
+	const sched_job_t* a = scheduler_job(&s, ids[0]);
+	const sched_job_t* b = scheduler_job(&s, ids[1]);
+	printf("weights 3:1  busy %6.3fs : %6.3fs = %.2f  tiles %lu : %lu\n", a->busy, b->busy, a->busy / b->busy,
+		   a->tiles_done, b->tiles_done);
+
+	scheduler_destroy(&s);
+	for (u32 i = 0; i < 2; i++) {
+		image_destroy(imgs[i]);
+		render_job_destroy(&jobs[i]);
+	}
+	render_scene_destroy(&rs);
+}
+
+// :query
+static void bench_query(context_t ctx) {
+	srand(40);
+	const u64 count = 100000;
+	const u64 ray_count = 1 << 20;
+
+	// the same spheres alone go in a grid, with a ground sphere in a bvh
+	for (u32 ground = 0; ground < 2; ground++) {
+		scene_t scene = scene_default(ctx);
+		f64		size = cbrt(count);
+		for (u64 i = 0; i < count; i++) {
+			vec3_t	   center = vec3(bench_rand(-size, size), bench_rand(-size, size), bench_rand(-size, size));
+			hittable_t h = {.sphere = {SPHERE, center, bench_rand(0.15, 0.25)}};
+			darr_append(&scene.prims, h);
+		}
+		if (ground) {
+			hittable_t h = {.sphere = {SPHERE, vec3(0, -1000 - size, 0), 1000}};
+			darr_append(&scene.prims, h);
+		}
+		render_scene_t rs = render_scene_create(ctx, scene, null);
+
+		// incoherent, as line of sight checks between random points are
+		ray_t* rays = alloc(ctx, ray_count * sizeof(ray_t));
+		for (u64 i = 0; i < ray_count; i++) {
+			rays[i] = (ray_t){
+				.origin = vec3(bench_rand(-size, size), bench_rand(-size, size), bench_rand(-size, size)),
+				.direction = vec3_rand_unit(),
+			};
+		}
+		hit_t*	hits = alloc(ctx, ray_count * sizeof(hit_t));
+		real_t* t = alloc(ctx, ray_count * sizeof(real_t));
+		u32*	prim = alloc(ctx, ray_count * sizeof(u32));
+		vec3_t* normal = alloc(ctx, ray_count * sizeof(vec3_t));
+		bool*	occluded = alloc(ctx, ray_count * sizeof(bool));
+
+		// the renderer's own traversal, as wavefront_intersect runs it
+		f64 start = time_now();
+#pragma omp parallel for schedule(dynamic, 256)
+		for (u64 i = 0; i < ray_count; i++) {
+			hits[i] = world_hit(&rs.world, rays[i], RAY_MINT, 2 * size);
+		}
+		f64 world_seconds = time_now() - start;
+
+		start = time_now();
+		query_hit(&rs, rays, ray_count, RAY_MINT, 2 * size, (query_hits_t){.t = t, .prim = prim, .normal = normal});
+		f64 query_seconds = time_now() - start;
+
+		start = time_now();
+#pragma omp parallel for schedule(dynamic, 256)
+		for (u64 i = 0; i < ray_count; i++) {
+			occluded[i] = world_occluded(&rs.world, rays[i], RAY_MINT, 2 * size);
+		}
+		f64 world_occluded_seconds = time_now() - start;
+
+		start = time_now();
+		query_occluded(&rs, rays, ray_count, RAY_MINT, 2 * size, occluded);
+		f64 query_occluded_seconds = time_now() - start;
+
+		u64 agree = 0;
+		for (u64 i = 0; i < ray_count; i++) {
+			agree += hits[i].is_hit == (prim[i] != QUERY_MISS) && hits[i].is_hit == occluded[i];
+		}
+
+		printf("%-4s  closest: world_hit %6.2f Mrays/s  query_hit %6.2f Mrays/s   any: world_occluded %6.2f Mrays/s  "
+			   "query_occluded %6.2f Mrays/s  (%lu/%lu agree)\n",
+			   ground ? "bvh" : "grid", ray_count / world_seconds / 1e6, ray_count / query_seconds / 1e6,
+			   ray_count / world_occluded_seconds / 1e6, ray_count / query_occluded_seconds / 1e6, agree, ray_count);
+
+		dealloc(ctx, occluded);
+		dealloc(ctx, normal);
+		dealloc(ctx, prim);
+		dealloc(ctx, t);
+		dealloc(ctx, hits);
+		dealloc(ctx, rays);
+		render_scene_destroy(&rs);
+	}
+}
+
+// :proximity
+static void bench_proximity(context_t ctx) {
+	srand(41);
+	const u64 count = 100000;
+	const u64 point_count = 1 << 18;
+	const u32 k = 8;
+
+	for (u32 ground = 0; ground < 2; ground++) {
+		scene_t scene = scene_default(ctx);
+		f64		size = cbrt(count);
+		for (u64 i = 0; i < count; i++) {
+			vec3_t	   center = vec3(bench_rand(-size, size), bench_rand(-size, size), bench_rand(-size, size));
+			hittable_t h = {.sphere = {SPHERE, center, bench_rand(0.15, 0.25)}};
+			darr_append(&scene.prims, h);
+		}
+		if (ground) {
+			hittable_t h = {.sphere = {SPHERE, vec3(0, -1000 - size, 0), 1000}};
+			darr_append(&scene.prims, h);
+		}
+		render_scene_t rs = render_scene_create(ctx, scene, null);
+
+		vec3_t* points = alloc(ctx, point_count * sizeof(vec3_t));
+		for (u64 i = 0; i < point_count; i++) {
+			points[i] = vec3(bench_rand(-size, size), bench_rand(-size, size), bench_rand(-size, size));
+		}
+		u32*	prims = alloc(ctx, point_count * k * sizeof(u32));
+		real_t* distances = alloc(ctx, point_count * k * sizeof(real_t));
+		u64*	offsets = alloc(ctx, (point_count + 1) * sizeof(u64));
+
+		f64 start = time_now();
+		query_nearest(&rs, points, point_count, 1, REAL_MAX, prims, distances);
+		f64 nearest1_seconds = time_now() - start;
+
+		start = time_now();
+		query_nearest(&rs, points, point_count, k, REAL_MAX, prims, distances);
+		f64 nearest_seconds = time_now() - start;
+
+		start = time_now();
+		u64 total = query_within(&rs, points, point_count, 1, null, 0, offsets);
+		u32* within = alloc(ctx, total * sizeof(u32) + 1);
+		query_within(&rs, points, point_count, 1, within, total, offsets);
+		f64 within_seconds = time_now() - start;
+
+		// a separate index would have had to agree with this
+		u64 agree = 0;
+		for (u64 i = 0; i < 1000; i++) {
+			u32	   best = 0;
+			real_t best_distance = REAL_MAX;
+			for (u64 p = 0; p < rs.scene.prims.count; p++) {
+				real_t d = distance_hittable(rs.scene.prims.items[p], points[i]);
+				if (d < best_distance) {
+					best = p, best_distance = d;
+				}
+			}
+			agree += prims[i * k] == best || distances[i * k] == best_distance;
+		}
+
+		printf("%-4s  nearest %6.2f Mq/s  %u nearest %6.2f Mq/s  within 1 %6.2f Mq/s (%4.1f found each)  %lu/1000 agree with brute force\n",
+			   ground ? "bvh" : "grid", point_count / nearest1_seconds / 1e6, k, point_count / nearest_seconds / 1e6,
+			   point_count / within_seconds / 1e6, (f64)total / point_count, agree);
+
+		dealloc(ctx, within);
+		dealloc(ctx, offsets);
+		dealloc(ctx, distances);
+		dealloc(ctx, prims);
+		dealloc(ctx, points);
+		render_scene_destroy(&rs);
+	}
+}
+
+// :hit_all
+static void bench_hit_all(context_t ctx) {
+	srand(42);
+	const u64 count = 100000;
+	const u64 ray_count = 1 << 16;
+	const u32 k = 8, all = 128;
+
+	for (u32 ground = 0; ground < 2; ground++) {
+		scene_t scene = scene_default(ctx);
+		f64		size = cbrt(count);
+		for (u64 i = 0; i < count; i++) {
+			vec3_t	   center = vec3(bench_rand(-size, size), bench_rand(-size, size), bench_rand(-size, size));
+			hittable_t h = {.sphere = {SPHERE, center, bench_rand(0.5, 0.8)}};
+			darr_append(&scene.prims, h);
+		}
+		if (ground) {
+			hittable_t h = {.sphere = {SPHERE, vec3(0, -1000 - size, 0), 1000}};
+			darr_append(&scene.prims, h);
+		}
+		render_scene_t rs = render_scene_create(ctx, scene, null);
+
+		ray_t* rays = alloc(ctx, ray_count * sizeof(ray_t));
+		for (u64 i = 0; i < ray_count; i++) {
+			rays[i] = (ray_t){
+				.origin = vec3(bench_rand(-size, size), bench_rand(-size, size), bench_rand(-size, size)),
+				.direction = vec3_rand_unit(),
+			};
+		}
+		crossing_t* out = alloc(ctx, ray_count * all * sizeof(crossing_t));
+		u32*		counts = alloc(ctx, ray_count * sizeof(u32));
+		const f64	maxt = 2 * size;
+
+		f64 start = time_now();
+		query_hit_all(&rs, rays, ray_count, RAY_MINT, maxt, k, out, counts);
+		f64 kbuffer_seconds = time_now() - start;
+
+		// what a caller does with closest hits alone: cast again from each hit until k are found
+		u64 peeled = 0;
+		start = time_now();
+#pragma omp parallel for schedule(dynamic, 64) reduction(+ : peeled)
+		for (u64 i = 0; i < ray_count; i++) {
+			real_t mint = RAY_MINT;
+			for (u32 n = 0; n < k; n++) {
+				hit_t hit = world_hit(&rs.world, rays[i], mint, maxt);
+				if (!hit.is_hit) {
+					break;
+				}
+				mint = hit.t;
+				peeled++;
+			}
+		}
+		f64 peel_seconds = time_now() - start;
+
+		u64 found = 0;
+		for (u64 i = 0; i < ray_count; i++) {
+			found += counts[i];
+		}
+
+		start = time_now();
+		query_hit_all(&rs, rays, ray_count, RAY_MINT, maxt, all, out, counts);
+		f64 all_seconds = time_now() - start;
+		u64 every = 0, max = 0;
+		for (u64 i = 0; i < ray_count; i++) {
+			every += counts[i];
+			max = counts[i] > max ? counts[i] : max;
+		}
+
+		printf("%-4s  first %u: k-buffer %6.2f Mrays/s  peeling %6.2f Mrays/s  (%lu vs %lu crossings)   all: %6.2f Mrays/s "
+			   "(%.1f crossings each, %lu at most)\n",
+			   ground ? "bvh" : "grid", k, ray_count / kbuffer_seconds / 1e6, ray_count / peel_seconds / 1e6, found, peeled,
+			   ray_count / all_seconds / 1e6, (f64)every / ray_count, max);
+
+		dealloc(ctx, counts);
+		dealloc(ctx, out);
+		dealloc(ctx, rays);
+		render_scene_destroy(&rs);
+	}
+}
+
+// :stream_image
+// each size in a child of its own, so every peak rss is that render's alone
+static void bench_stream_image(context_t ctx) {
+	const u64 sizes[][2] = {{1024, 1024}, {4096, 2048}, {16384, 1024}, {70000, 256}};
+
+	for (u32 streamed = 0; streamed < 2; streamed++) {
+		for (u64 s = 0; s < sizeof(sizes) / sizeof(*sizes); s++) {
+			const u64 w = sizes[s][0], h = sizes[s][1];
+			// a tga can't hold the widest one
+			if (!streamed && w > U16_MAX) {
+				continue;
+			}
+
+			fflush(stdout);
+			pid_t pid = fork();
+			if (pid != 0) {
+				waitpid(pid, null, 0);
+				continue;
+			}
+
+			scene_t scene;
+			try scene_load(ctx, "scenes/default.scene", &scene) or_fail("failed loading scenes/default.scene");
+			render_scene_t rs = render_scene_create(ctx, scene, null);
+			render_job_t   job = render_job_create(ctx, &rs, RENDER_PACKETS);
+			job.samples = 1, job.bounces = 2;
+
+			char path[] = "/tmp/bench_stream_image_XXXXXX";
+			int	 fd = mkstemp(path);
+			f64	 start = time_now();
+			if (streamed) {
+				ppm_writer_t pw;
+				try ppm_writer_begin(fd, w, h, &pw) or_fail("failed writing ppm");
+				try render_job_stream(&job, w, h, &pw) or_fail("failed writing ppm");
+			} else {
+				image_t* img = image_create(ctx, w, h);
+				render_job_run(&job, img);
+				try image_write_tga(img, fd) or_fail("failed writing tga");
+				image_destroy(img);
+			}
+			f64 seconds = time_now() - start;
+			close(fd);
+			unlink(path);
+
+			struct rusage usage;
+			getrusage(RUSAGE_SELF, &usage);
+			printf("%-6s %6lu x %-5lu  %7.1f Mpixels  %7.2fs  %6.2f Mpixels/s  peak rss %7.1f MB\n", streamed ? "stream" : "image",
+				   w, h, w * h / 1e6, seconds, w * h / seconds / 1e6, usage.ru_maxrss / 1024.);
+			fflush(stdout);
+			_exit(0);
+		}
+	}
+}
+
+// :main
+typedef struct {
+	const char* name;
+	void (*run)(context_t ctx);
+} bench_t;
+
+static const bench_t benches[] = {
+	{"accel", bench_accel},
+	{"occlusion", bench_occlusion},
+	{"packet", bench_packet},
+	{"wavefront", bench_wavefront},
+	{"reorder", bench_reorder},
+	{"stream", bench_stream},
+	{"tile", bench_tile},
+	{"gbuffer", bench_gbuffer},
+	{"scene", bench_scene_file},
+	{"server", bench_server},
+	{"scheduler", bench_scheduler},
+	{"query", bench_query},
+	{"proximity", bench_proximity},
+	{"hit_all", bench_hit_all},
+	{"stream_image", bench_stream_image},
+};
+
+int main(int argc, char** argv) {
+	context_t ctx = context_default();
+	printf("kernels: %s\n", kernel_isa());
+
+	for (u64 i = 0; i < sizeof(benches) / sizeof(*benches); i++) {
+		if (argc > 1 && strcmp(argv[1], benches[i].name) != 0) {
+			continue;
+		}
+		printf("== %s\n", benches[i].name);
+		benches[i].run(ctx);
+	}
+
+	return 0;
+}
@@ -0,0 +1,710 @@
+#include <unistd.h>
+
+#include "rt.h"
+
+// :bvh
+#define BVH_BINS 16
+
+typedef struct {
+	const aabb_t* bounds;
+	vec3_t*		  centroids;
+	u32*		  indices;
+
+	darr_of(bvh_node_t) nodes;
+} bvh_builder_t;
+
+static u64 bvh_builder_push(bvh_builder_t* b) {
+	darr_append(&b->nodes, ((bvh_node_t){0}));
+	return b->nodes.count - 1;
+}
+
+// splits [begin, end) in half by index, used when the centroids can't be told apart
+static u64 bvh_split_median(u64 begin, u64 end) {
+	return begin + (end - begin) / 2;
+}
+
+// binned surface area heuristic, returns the index of the first primitive of the right child
+static u64 bvh_split_sah(bvh_builder_t* b, u64 begin, u64 end, aabb_t centroid_bounds, u32* out_axis) {
+	f64 best_cost = 1e300;
+	u32 best_axis = 0;
+	u32 best_bin = 0;
+
+	vec3_t extent = vec3_sub(centroid_bounds.max, centroid_bounds.min);
+
+	for (u32 axis = 0; axis < 3; axis++) {
+		f64 min = vec3_data(&centroid_bounds.min)[axis];
+		f64 len = vec3_data(&extent)[axis];
+		if (len <= 0) {
+			continue;
+		}
+
+		aabb_t bins[BVH_BINS];
+		u64	   counts[BVH_BINS] = {0};
+		for (u32 i = 0; i < BVH_BINS; i++) {
+			bins[i] = aabb_empty();
+		}
+
+		for (u64 i = begin; i < end; i++) {
+			u32 idx = b->indices[i];
+			u32 bin = (vec3_data(&b->centroids[idx])[axis] - min) / len * BVH_BINS;
+			bin = bin >= BVH_BINS ? BVH_BINS - 1 : bin;
+			bins[bin] = aabb_union(bins[bin], b->bounds[idx]);
+			counts[bin]++;
+		}
+
+		// sweep from the right to have every suffix area ready
+		f64	   right_area[BVH_BINS];
+		u64	   right_count[BVH_BINS];
+		aabb_t acc = aabb_empty();
+		u64	   n = 0;
+		for (u32 i = BVH_BINS - 1; i > 0; i--) {
+			acc = aabb_union(acc, bins[i]);
+			n += counts[i];
+			right_area[i] = aabb_area(acc);
+			right_count[i] = n;
+		}
+
+		acc = aabb_empty();
+		n = 0;
+		for (u32 i = 1; i < BVH_BINS; i++) {
+			acc = aabb_union(acc, bins[i - 1]);
+			n += counts[i - 1];
+			f64 cost = aabb_area(acc) * n + right_area[i] * right_count[i];
+			if (n != 0 && right_count[i] != 0 && cost < best_cost) {
+				best_cost = cost;
+				best_axis = axis;
+				best_bin = i;
+			}
+		}
+	}
+
+	*out_axis = best_axis;
+	if (best_bin == 0) {
+		return bvh_split_median(begin, end);
+	}
+
+	f64 min = vec3_data(&centroid_bounds.min)[best_axis];
+	f64 len = vec3_data(&extent)[best_axis];
+
+	// partition in place
+	u64 i = begin, j = end;
+	while (i < j) {
+		u32 bin = (vec3_data(&b->centroids[b->indices[i]])[best_axis] - min) / len * BVH_BINS;
+		bin = bin >= BVH_BINS ? BVH_BINS - 1 : bin;
+		if (bin < best_bin) {
+			i++;
+		} else {
+			j--;
+			u32 tmp = b->indices[i];
+			b->indices[i] = b->indices[j];
+			b->indices[j] = tmp;
+		}
+	}
+
+	if (i == begin || i == end) {
+		return bvh_split_median(begin, end);
+	}
+	return i;
+}
+
+// levels of median splits it takes to get count primitives down to leaves
+static u32 bvh_median_levels(u64 count) {
+	u32 levels = 0;
+	for (; count > BVH_MAX_LEAF; count = (count + 1) / 2) {
+		levels++;
+	}
+	return levels;
+}
+
+static void bvh_build_range(bvh_builder_t* b, u64 node, u64 begin, u64 end, u32 depth) {
+	aabb_t bounds = aabb_empty();
+	aabb_t centroid_bounds = aabb_empty();
+
+	for (u64 i = begin; i < end; i++) {
+		u32 idx = b->indices[i];
+		bounds = aabb_union(bounds, b->bounds[idx]);
+		centroid_bounds = aabb_grow(centroid_bounds, b->centroids[idx]);
+	}
+
+	b->nodes.items[node].bounds = bounds;
+
+	if (end - begin <= BVH_MAX_LEAF) {
+		b->nodes.items[node].offset = begin;
+		b->nodes.items[node].count = end - begin;
+		return;
+	}
+
+	u32 axis = 0;
+	u64 mid;
+	if (depth + 1 + bvh_median_levels(end - begin) > BVH_MAX_TREE_DEPTH) {
+		// a sah split may leave a child with all but one primitive, from here on only
+		// halving still gets every leaf within the depth the traversal stacks hold
+		mid = bvh_split_median(begin, end);
+	} else {
+		mid = bvh_split_sah(b, begin, end, centroid_bounds, &axis);
+	}
+
+	u64 left = bvh_builder_push(b);
+	bvh_build_range(b, left, begin, mid, depth + 1);
+
+	u64 right = bvh_builder_push(b);
+	bvh_build_range(b, right, mid, end, depth + 1);
+
+	b->nodes.items[node].offset = right;
+	b->nodes.items[node].count = 0;
+	b->nodes.items[node].axis = axis;
+}
+
+u64 bvh_build_nodes(context_t ctx, const aabb_t* bounds, u32* indices, u64 count, bvh_node_t** out_nodes) {
+	bvh_builder_t b = {
+		.bounds = bounds,
+		.centroids = alloc(ctx, count * sizeof(vec3_t) + 1),
+		.indices = indices,
+		.nodes = {.allocator = ctx.allocator},
+	};
+
+	for (u64 i = 0; i < count; i++) {
+		indices[i] = i;
+		b.centroids[i] = aabb_center(bounds[i]);
+	}
+
+	u64 root = bvh_builder_push(&b);
+	bvh_build_range(&b, root, 0, count, 0);
+
+	dealloc(ctx, b.centroids);
+
+	*out_nodes = b.nodes.items;
+	return b.nodes.count;
+}
+
+bvh_t bvh_build(context_t ctx, hittable_view_t hs) {
+	bvh_t bvh = {._allocator = ctx.allocator};
+
+	aabb_t* bounds = alloc(ctx, hs.count * sizeof(aabb_t) + 1);
+	u32*	indices = alloc(ctx, hs.count * sizeof(u32) + 1);
+	for (u64 i = 0; i < hs.count; i++) {
+		bounds[i] = hittable_bounds(hs.items[i]);
+	}
+
+	bvh.node_count = bvh_build_nodes(ctx, bounds, indices, hs.count, &bvh.nodes);
+
+	// store the primitives in leaf order, traversal then never goes through the indices
+	bvh.prims = alloc(ctx, hs.count * sizeof(hittable_t) + 1);
+	bvh.prim_count = hs.count;
+	for (u64 i = 0; i < hs.count; i++) {
+		bvh.prims[i] = hs.items[indices[i]];
+	}
+	bvh.prim_ids = indices;
+
+	dealloc(ctx, bounds);
+	return bvh;
+}
+
+void bvh_destroy(bvh_t* bvh) {
+	if (bvh->_mapping.data != null) {
+		file_unmap(&bvh->_mapping);
+	} else {
+		allocator_dealloc(bvh->_allocator, bvh->nodes);
+		allocator_dealloc(bvh->_allocator, bvh->prims);
+		allocator_dealloc(bvh->_allocator, bvh->prim_ids);
+	}
+	*bvh = (bvh_t){0};
+}
+
+hit_t bvh_hit(const bvh_t* bvh, ray_t r, real_t mint, real_t maxt) {
+	u32 prim;
+	return bvh_hit_prim(bvh, r, mint, maxt, &prim);
+}
+
+KERNEL hit_t bvh_hit_prim(const bvh_t* bvh, ray_t r, real_t mint, real_t maxt, u32* out_prim) {
+	hit_t result = {0};
+	*out_prim = BVH_NO_PRIM;
+	if (bvh->prim_count == 0) {
+		return result;
+	}
+
+	vec3_t inv_dir = vec3(1 / r.direction.x, 1 / r.direction.y, 1 / r.direction.z);
+
+	u32 stack[BVH_MAX_DEPTH];
+	u32 top = 0;
+	stack[top++] = 0;
+
+	while (top > 0) {
+		u32				  idx = stack[--top];
+		const bvh_node_t* node = &bvh->nodes[idx];
+
+		if (!aabb_hit(node->bounds, r.origin, inv_dir, mint, maxt) || !bvh_node_valid(bvh, idx, top)) {
+			continue;
+		}
+
+		if (node->count != 0) {
+			for (u32 i = node->offset; i < node->offset + node->count; i++) {
+				hit_t this_hit = hit_hittable(bvh->prims[i], r, mint, maxt);
+				if (this_hit.is_hit) {
+					result = this_hit;
+					maxt = this_hit.t;
+					*out_prim = i;
+				}
+			}
+			continue;
+		}
+
+		// push the far child first so the near one is popped next
+		u32 near = idx + 1;
+		u32 far = node->offset;
+		if (vec3_data(&r.direction)[node->axis] < 0) {
+			near = node->offset;
+			far = idx + 1;
+		}
+		stack[top++] = far;
+		stack[top++] = near;
+	}
+
+	return result;
+}
+
+KERNEL bool bvh_occluded(const bvh_t* bvh, ray_t r, real_t mint, real_t maxt) {
+	if (bvh->prim_count == 0) {
+		return false;
+	}
+
+	vec3_t inv_dir = vec3(1 / r.direction.x, 1 / r.direction.y, 1 / r.direction.z);
+
+	u32 stack[BVH_MAX_DEPTH];
+	u32 top = 0;
+	stack[top++] = 0;
+
+	// maxt never shrinks, so the child order doesn't matter
+	while (top > 0) {
+		u32				  idx = stack[--top];
+		const bvh_node_t* node = &bvh->nodes[idx];
+
+		if (!aabb_hit(node->bounds, r.origin, inv_dir, mint, maxt) || !bvh_node_valid(bvh, idx, top)) {
+			continue;
+		}
+
+		if (node->count != 0) {
+			for (u32 i = node->offset; i < node->offset + node->count; i++) {
+				if (occluded_hittable(bvh->prims[i], r, mint, maxt)) {
+					return true;
+				}
+			}
+			continue;
+		}
+
+		stack[top++] = node->offset;
+		stack[top++] = idx + 1;
+	}
+
+	return false;
+}
+
+// :bvh_hit_all
+void bvh_hit_all(const bvh_t* bvh, ray_t r, real_t mint, real_t maxt, kbuffer_t* b) {
+	if (bvh->prim_count == 0 || b->k == 0) {
+		return;
+	}
+
+	vec3_t inv_dir = vec3(1 / r.direction.x, 1 / r.direction.y, 1 / r.direction.z);
+
+	u32 stack[BVH_MAX_DEPTH];
+	u32 top = 0;
+	stack[top++] = 0;
+
+	while (top > 0) {
+		u32				  idx = stack[--top];
+		const bvh_node_t* node = &bvh->nodes[idx];
+
+		if (!aabb_hit(node->bounds, r.origin, inv_dir, mint, kbuffer_maxt(b, maxt)) || !bvh_node_valid(bvh, idx, top)) {
+			continue;
+		}
+
+		if (node->count != 0) {
+			for (u32 i = node->offset; i < node->offset + node->count; i++) {
+				crossing_t crossings[HITTABLE_MAX_CROSSINGS];
+				u32		   n = crossings_hittable(bvh->prims[i], r, mint, kbuffer_maxt(b, maxt), crossings);
+				for (u32 c = 0; c < n; c++) {
+					crossings[c].prim = i;
+					kbuffer_offer(b, crossings[c]);
+				}
+			}
+			continue;
+		}
+
+		// near first, as for the closest hit, so the buffer fills in order and bounds the rest early
+		u32 near = idx + 1;
+		u32 far = node->offset;
+		if (vec3_data(&r.direction)[node->axis] < 0) {
+			near = node->offset;
+			far = idx + 1;
+		}
+		stack[top++] = far;
+		stack[top++] = near;
+	}
+}
+
+// :bvh_nearest
+// Nodes wait in a min heap on their box distance, so the closest ones are opened
+// first and the search ends once the next box is farther than the k-th primitive.
+// A node that doesn't fit in the heap is searched depth first on the spot instead.
+#define BVH_NEAREST_HEAP 128
+
+typedef struct {
+	real_t distance;
+	u32	   node;
+} bvh_heap_entry_t;
+
+static void bvh_nearest_leaf(const bvh_t* bvh, const bvh_node_t* node, vec3_t p, nearest_t* n) {
+	for (u32 i = node->offset; i < node->offset + node->count; i++) {
+		real_t d = distance_hittable(bvh->prims[i], p);
+		if (d < nearest_bound(n)) {
+			nearest_offer(n, i, d);
+		}
+	}
+}
+
+static void bvh_nearest_subtree(const bvh_t* bvh, u32 root, vec3_t p, nearest_t* n) {
+	u32 stack[BVH_MAX_DEPTH];
+	u32 top = 0;
+	stack[top++] = root;
+
+	while (top > 0) {
+		u32				  idx = stack[--top];
+		const bvh_node_t* node = &bvh->nodes[idx];
+		if (aabb_distance(node->bounds, p) >= nearest_bound(n) || !bvh_node_valid(bvh, idx, top)) {
+			continue;
+		}
+		if (node->count != 0) {
+			bvh_nearest_leaf(bvh, node, p, n);
+			continue;
+		}
+
+		// the closer child is popped first
+		u32 a = idx + 1, b = node->offset;
+		if (aabb_distance(bvh->nodes[a].bounds, p) < aabb_distance(bvh->nodes[b].bounds, p)) {
+			u32 tmp = a;
+			a = b, b = tmp;
+		}
+		stack[top++] = a;
+		stack[top++] = b;
+	}
+}
+
+static void bvh_heap_push(bvh_heap_entry_t* heap, u32* size, bvh_heap_entry_t e) {
+	u32 i = (*size)++;
+	for (; i > 0 && heap[(i - 1) / 2].distance > e.distance; i = (i - 1) / 2) {
+		heap[i] = heap[(i - 1) / 2];
+	}
+	heap[i] = e;
+}
+
+static bvh_heap_entry_t bvh_heap_pop(bvh_heap_entry_t* heap, u32* size) {
+	bvh_heap_entry_t top = heap[0];
+	bvh_heap_entry_t last = heap[--*size];
+
+	u32 i = 0;
+	for (u32 child; (child = 2 * i + 1) < *size; i = child) {
+		if (child + 1 < *size && heap[child + 1].distance < heap[child].distance) {
+			child++;
+		}
+		if (heap[child].distance >= last.distance) {
+			break;
+		}
+		heap[i] = heap[child];
+	}
+	heap[i] = last;
+	return top;
+}
+
+void bvh_nearest(const bvh_t* bvh, vec3_t p, nearest_t* n) {
+	if (bvh->prim_count == 0) {
+		return;
+	}
+
+	bvh_heap_entry_t heap[BVH_NEAREST_HEAP];
+	u32				 size = 0;
+	bvh_heap_push(heap, &size, (bvh_heap_entry_t){aabb_distance(bvh->nodes[0].bounds, p), 0});
+
+	while (size > 0) {
+		bvh_heap_entry_t e = bvh_heap_pop(heap, &size);
+		if (e.distance >= nearest_bound(n)) {
+			break;
+		}
+
+		const bvh_node_t* node = &bvh->nodes[e.node];
+		if (!bvh_node_valid(bvh, e.node, 0)) {
+			continue;
+		}
+		if (node->count != 0) {
+			bvh_nearest_leaf(bvh, node, p, n);
+			continue;
+		}
+
+		u32 children[2] = {e.node + 1, node->offset};
+		for (u32 c = 0; c < 2; c++) {
+			real_t d = aabb_distance(bvh->nodes[children[c]].bounds, p);
+			if (d >= nearest_bound(n)) {
+				continue;
+			}
+			if (size < BVH_NEAREST_HEAP) {
+				bvh_heap_push(heap, &size, (bvh_heap_entry_t){d, children[c]});
+			} else {
+				bvh_nearest_subtree(bvh, children[c], p, n);
+			}
+		}
+	}
+}
+
+u64 bvh_within(const bvh_t* bvh, vec3_t p, real_t radius, u32* out, u64 capacity) {
+	if (bvh->prim_count == 0) {
+		return 0;
+	}
+
+	u32 stack[BVH_MAX_DEPTH];
+	u32 top = 0;
+	stack[top++] = 0;
+
+	u64 found = 0;
+	while (top > 0) {
+		u32				  idx = stack[--top];
+		const bvh_node_t* node = &bvh->nodes[idx];
+		if (aabb_distance(node->bounds, p) > radius || !bvh_node_valid(bvh, idx, top)) {
+			continue;
+		}
+
+		if (node->count != 0) {
+			for (u32 i = node->offset; i < node->offset + node->count; i++) {
+				if (distance_hittable(bvh->prims[i], p) <= radius) {
+					if (found < capacity) {
+						out[found] = i;
+					}
+					found++;
+				}
+			}
+			continue;
+		}
+
+		stack[top++] = node->offset;
+		stack[top++] = idx + 1;
+	}
+	return found;
+}
+
+// :bvh_stream
+// one ray in flight, a leaf that passed its box test is kept for the next turn
+// so its primitives have had time to arrive
+typedef struct {
+	ray_t  r;
+	vec3_t inv_dir;
+	real_t maxt;
+	hit_t  result;
+	u32	   prim;
+	u64	   out;	 // index of the ray in the stream
+	u32	   leaf;
+	u32	   top;
+	u32	   stack[BVH_MAX_DEPTH];
+} bvh_stream_lane_t;
+
+#define BVH_STREAM_NO_LEAF U32_MAX
+
+static void bvh_stream_lane_start(bvh_stream_lane_t* l, ray_t r, real_t maxt, u64 out) {
+	l->r = r;
+	l->inv_dir = vec3(1 / r.direction.x, 1 / r.direction.y, 1 / r.direction.z);
+	l->maxt = maxt;
+	l->result = (hit_t){0};
+	l->prim = BVH_NO_PRIM;
+	l->out = out;
+	l->leaf = BVH_STREAM_NO_LEAF;
+	l->top = 0;
+	l->stack[l->top++] = 0;
+}
+
+// one node or one leaf worth of work, then the next node is requested before switching away
+static void bvh_stream_lane_step(const bvh_t* bvh, bvh_stream_lane_t* l, real_t mint) {
+	if (l->leaf != BVH_STREAM_NO_LEAF) {
+		const bvh_node_t* node = &bvh->nodes[l->leaf];
+		for (u32 i = node->offset; i < node->offset + node->count; i++) {
+			hit_t this_hit = hit_hittable(bvh->prims[i], l->r, mint, l->maxt);
+			if (this_hit.is_hit) {
+				l->result = this_hit;
+				l->maxt = this_hit.t;
+				l->prim = i;
+			}
+		}
+		l->leaf = BVH_STREAM_NO_LEAF;
+	} else {
+		u32				  idx = l->stack[--l->top];
+		const bvh_node_t* node = &bvh->nodes[idx];
+
+		if (aabb_hit(node->bounds, l->r.origin, l->inv_dir, mint, l->maxt) && bvh_node_valid(bvh, idx, l->top)) {
+			if (node->count != 0) {
+				l->leaf = idx;
+				__builtin_prefetch(&bvh->prims[node->offset]);
+				return;
+			}
+
+			u32 near = idx + 1;
+			u32 far = node->offset;
+			if (vec3_data(&l->r.direction)[node->axis] < 0) {
+				near = node->offset;
+				far = idx + 1;
+			}
+			l->stack[l->top++] = far;
+			l->stack[l->top++] = near;
+		}
+	}
+
+	if (l->top > 0) {
+		__builtin_prefetch(&bvh->nodes[l->stack[l->top - 1]]);
+	}
+}
+
+void bvh_hit_stream(const bvh_t* bvh, const ray_t* rays, u64 count, real_t mint, real_t maxt, hit_t* out) {
+	bvh_hit_stream_prim(bvh, rays, count, mint, maxt, out, null);
+}
+
+KERNEL void bvh_hit_stream_prim(const bvh_t* bvh, const ray_t* rays, u64 count, real_t mint, real_t maxt, hit_t* out,
+								u32* out_prims) {
+	if (bvh->prim_count == 0) {
+		for (u64 i = 0; i < count; i++) {
+			out[i] = (hit_t){0};
+			if (out_prims != null) {
+				out_prims[i] = BVH_NO_PRIM;
+			}
+		}
+		return;
+	}
+
+	bvh_stream_lane_t lanes[BVH_STREAM_WIDTH];
+	u32				  active = 0;
+	u64				  next = 0;
+	for (; active < BVH_STREAM_WIDTH && next < count; active++, next++) {
+		bvh_stream_lane_start(&lanes[active], rays[next], maxt, next);
+	}
+
+	// round robin over the lanes, a finished lane takes the next ray of the stream
+	while (active > 0) {
+		for (u32 i = 0; i < active; i++) {
+			bvh_stream_lane_t* l = &lanes[i];
+			bvh_stream_lane_step(bvh, l, mint);
+			if (l->top > 0 || l->leaf != BVH_STREAM_NO_LEAF) {
+				continue;
+			}
+
+			out[l->out] = l->result;
+			if (out_prims != null) {
+				out_prims[l->out] = l->prim;
+			}
+			if (next < count) {
+				bvh_stream_lane_start(l, rays[next], maxt, next);
+				next++;
+			} else {
+				// the last lane moves into the hole, it is stepped again in this same pass
+				lanes[i--] = lanes[--active];
+			}
+		}
+	}
+}
+
+// :bvh_cache
+#define BVH_CACHE_ALIGN 64
+
+static u64 align_up(u64 v, u64 align) {
+	return (v + align - 1) / align * align;
+}
+
+static error_t write_padding(int fd, u64 from, u64 to) {
+	const u8 zeros[BVH_CACHE_ALIGN] = {0};
+	return file_write_all(fd, zeros, to - from);
+}
+
+error_t bvh_cache_write(const bvh_t* bvh, u64 key, int fd) {
+	bvh_cache_header_t header = {
+		.magic = BVH_CACHE_MAGIC,
+		.version = BVH_CACHE_VERSION,
+		.endian = 0x01020304,
+		.node_size = sizeof(bvh_node_t),
+		.prim_size = sizeof(hittable_t),
+		.key = key,
+		.node_count = bvh->node_count,
+		.prim_count = bvh->prim_count,
+	};
+
+	u64 nodes_size = bvh->node_count * sizeof(bvh_node_t);
+	u64 prims_size = bvh->prim_count * sizeof(hittable_t);
+	header.node_offset = align_up(sizeof(header), BVH_CACHE_ALIGN);
+	header.prim_offset = align_up(header.node_offset + nodes_size, BVH_CACHE_ALIGN);
+	header.id_offset = align_up(header.prim_offset + prims_size, BVH_CACHE_ALIGN);
+
+	error_t err;
+	try (err = file_write_all(fd, &header, sizeof(header))) or_return err;
+	try (err = write_padding(fd, sizeof(header), header.node_offset)) or_return err;
+	try (err = file_write_all(fd, bvh->nodes, nodes_size)) or_return err;
+	try (err = write_padding(fd, header.node_offset + nodes_size, header.prim_offset)) or_return err;
+	try (err = file_write_all(fd, bvh->prims, prims_size)) or_return err;
+	try (err = write_padding(fd, header.prim_offset + prims_size, header.id_offset)) or_return err;
+	try (err = file_write_all(fd, bvh->prim_ids, bvh->prim_count * sizeof(u32))) or_return err;
+
+	return NO_ERROR;
+}
+
+// Only what the header promises is checked, so a load costs the same whatever the
+// size: the sections are in order without overlapping, the counts are those of a tree
+// bvh_build could have made, and the root opens. Every other node is checked as a
+// traversal reaches it, see bvh_node_valid.
+static bool bvh_cache_valid(const bvh_cache_header_t* h, const bvh_t* bvh) {
+	bool ordered = h->node_offset >= sizeof(*h) && h->prim_offset >= h->node_offset + h->node_count * sizeof(bvh_node_t) &&
+				   h->id_offset >= h->prim_offset + h->prim_count * sizeof(hittable_t);
+	// an empty scene is a single empty leaf, any other has at most one node per primitive and
+	// one between every two
+	bool counts = bvh->prim_count == 0 ? bvh->node_count == 1 : bvh->node_count >= 1 && bvh->node_count < 2 * bvh->prim_count;
+	return ordered && counts && (bvh->prim_count == 0 || bvh_node_valid(bvh, 0, 1));
+}
+
+error_t bvh_cache_load(const char* path, u64 key, bvh_t* out) {
+	mapped_file_t file;
+	error_t		  err;
+	// not populated, traversal pages in only the nodes rays reach
+	try (err = file_map(path, &file)) or_return err;
+
+	const bvh_cache_header_t* header = (const bvh_cache_header_t*)file.data;
+
+	err = NO_ERROR;
+	if (file.size < sizeof(*header) || header->magic != BVH_CACHE_MAGIC) {
+		err = CACHE_BAD_MAGIC;
+	} else if (header->version != BVH_CACHE_VERSION) {
+		err = CACHE_BAD_VERSION;
+	} else if (header->endian != 0x01020304 || header->node_size != sizeof(bvh_node_t) ||
+			   header->prim_size != sizeof(hittable_t) || header->node_offset % BVH_CACHE_ALIGN != 0 ||
+			   header->prim_offset % BVH_CACHE_ALIGN != 0 || header->id_offset % BVH_CACHE_ALIGN != 0) {
+		err = CACHE_BAD_LAYOUT;
+	} else if (header->key != key) {
+		err = CACHE_STALE;
+	} else if (header->node_offset > file.size || header->prim_offset > file.size || header->id_offset > file.size ||
+			   header->node_count > (file.size - header->node_offset) / sizeof(bvh_node_t) ||
+			   header->prim_count > (file.size - header->prim_offset) / sizeof(hittable_t) ||
+			   header->prim_count > (file.size - header->id_offset) / sizeof(u32)) {
+		err = CACHE_TRUNCATED;
+	}
+
+	if (err != NO_ERROR) {
+		file_unmap(&file);
+		return err;
+	}
+
+	// the structure is used straight from the mapping, nothing is parsed or patched
+	bvh_t bvh = {
+		.nodes = (bvh_node_t*)(file.data + header->node_offset),
+		.node_count = header->node_count,
+		.prims = (hittable_t*)(file.data + header->prim_offset),
+		.prim_count = header->prim_count,
+		.prim_ids = (u32*)(file.data + header->id_offset),
+		._mapping = file,
+	};
+	if (!bvh_cache_valid(header, &bvh)) {
+		file_unmap(&file);
+		return CACHE_CORRUPT;
+	}
+	*out = bvh;
+	return NO_ERROR;
+}
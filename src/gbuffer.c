@@ -0,0 +1,115 @@
+#include <unistd.h>
+
+#include "rt.h"
+
+// :gbuffer
+// how many primitives may be hit from inside the frustum, stops counting at 2
+static u32 gbuffer_frustum_prims(const bvh_t* bvh, const frustum_t* f, u32* out_prim) {
+	u32 found = 0;
+
+	u32 stack[BVH_MAX_DEPTH];
+	u32 top = 0;
+	stack[top++] = 0;
+
+	while (top > 0 && found < 2) {
+		u32				  idx = stack[--top];
+		const bvh_node_t* node = &bvh->nodes[idx];
+
+		if (frustum_culls_aabb(f, node->bounds) || !bvh_node_valid(bvh, idx, top)) {
+			continue;
+		}
+
+		if (node->count != 0) {
+			for (u32 i = node->offset; i < node->offset + node->count && found < 2; i++) {
+				if (!frustum_culls_hittable(f, bvh->prims[i])) {
+					*out_prim = i;
+					found++;
+				}
+			}
+			continue;
+		}
+
+		stack[top++] = node->offset;
+		stack[top++] = idx + 1;
+	}
+
+	return found;
+}
+
+KERNEL gbuffer_pixel_t gbuffer_probe(const world_t* w, const ray_t* rays, u64 width, u64 height, real_t mint, real_t maxt) {
+	const gbuffer_pixel_t mixed = {.kind = GBUFFER_MIXED, .prim = BVH_NO_PRIM};
+	if (w->accel.type != ACCEL_BVH || w->tlas.instance_count != 0 || w->accel.bvh.prim_count == 0) {
+		return mixed;
+	}
+
+	// the corners bound the block, the center catches whatever sits in the middle
+	const u64 probes[] = {0, width - 1, (height - 1) * width, height * width - 1, (height / 2) * width + width / 2};
+	const u32 probe_count = sizeof(probes) / sizeof(*probes);
+
+	gbuffer_pixel_t px = {.prim = BVH_NO_PRIM, .tmin = REAL_MAX, .tmax = -REAL_MAX};
+	u32				hits = 0;
+	for (u32 i = 0; i < probe_count; i++) {
+		u32	  prim;
+		hit_t hit = bvh_hit_prim(&w->accel.bvh, rays[probes[i]], mint, maxt, &prim);
+		if (!hit.is_hit) {
+			continue;
+		}
+
+		if (hits++ != 0 && prim != px.prim) {
+			return mixed;
+		}
+		px.prim = prim;
+		px.tmin = min_real(px.tmin, hit.t);
+		px.tmax = max_real(px.tmax, hit.t);
+	}
+	if (hits != 0 && hits != probe_count) {
+		return mixed;
+	}
+
+	// the probes agree, check nothing else fits between them
+	for (u64 i = 0; i < width * height; i++) {
+		if (vec3_len2(vec3_sub(rays[i].origin, rays[0].origin)) != 0) {
+			return mixed;
+		}
+	}
+	vec3_t	  corner = vec3_add(rays[0].origin, rays[0].direction);
+	vec3_t	  edge_u = vec3_sub(rays[width - 1].direction, rays[0].direction);
+	vec3_t	  edge_v = vec3_sub(rays[(height - 1) * width].direction, rays[0].direction);
+	frustum_t f = frustum_create(rays[0].origin, corner, edge_u, edge_v);
+
+	u32 prim = BVH_NO_PRIM;
+	u32 found = gbuffer_frustum_prims(&w->accel.bvh, &f, &prim);
+	if (hits == 0 && found == 0) {
+		px.kind = GBUFFER_SKY;
+		return px;
+	}
+	if (hits != 0 && found == 1 && prim == px.prim) {
+		px.kind = GBUFFER_UNIFORM;
+		return px;
+	}
+	return mixed;
+}
+
+KERNEL void gbuffer_hit_block(const world_t* w, gbuffer_pixel_t px, const ray_t* rays, u64 width, u64 height, real_t mint, real_t maxt,
+					   hit_t* out) {
+	switch (px.kind) {
+		case GBUFFER_MIXED:
+			world_hit_block(w, rays, width, height, mint, maxt, out);
+			return;
+
+		case GBUFFER_SKY:
+			for (u64 i = 0; i < width * height; i++) {
+				out[i] = (hit_t){0};
+			}
+			return;
+
+		case GBUFFER_UNIFORM: {
+			// nothing else is in the way, a sample that slips off the edge of the primitive is a miss
+			hittable_t prim = w->accel.bvh.prims[px.prim];
+			for (u64 i = 0; i < width * height; i++) {
+				out[i] = hit_hittable(prim, rays[i], mint, maxt);
+			}
+			return;
+		}
+	}
+}
@@ -0,0 +1,333 @@
+#include <unistd.h>
+
+#include "rt.h"
+
+// :grid
+static u32 grid_axis_res(f64 extent, f64 cells_per_unit) {
+	f64 res = extent * cells_per_unit;
+	return res < 1 ? 1 : res > GRID_MAX_RES ? GRID_MAX_RES : (u32)res;
+}
+
+static u32 grid_cell_coord(const grid_t* grid, real_t v, u32 axis) {
+	real_t c = (v - vec3_at(grid->bounds.min, axis)) * vec3_at(grid->inv_cell_size, axis);
+	return c < 0 ? 0 : c >= grid->res[axis] ? grid->res[axis] - 1 : (u32)c;
+}
+
+static u64 grid_cell_index(const grid_t* grid, u32 x, u32 y, u32 z) {
+	return x + (u64)grid->res[0] * (y + (u64)grid->res[1] * z);
+}
+
+grid_t grid_build(context_t ctx, hittable_view_t hs) {
+	grid_t grid = {._allocator = ctx.allocator, .bounds = aabb_empty()};
+
+	aabb_t* bounds = alloc(ctx, hs.count * sizeof(aabb_t) + 1);
+	for (u64 i = 0; i < hs.count; i++) {
+		bounds[i] = hittable_bounds(hs.items[i]);
+		grid.bounds = aabb_union(grid.bounds, bounds[i]);
+	}
+
+	// cubic cells, about GRID_DENSITY of them per primitive
+	vec3_t extent = vec3_max(vec3_sub(grid.bounds.max, grid.bounds.min), vec3(1e-9, 1e-9, 1e-9));
+	f64	   cells_per_unit = cbrt(GRID_DENSITY * hs.count / (extent.x * extent.y * extent.z));
+
+	grid.res[0] = grid_axis_res(extent.x, cells_per_unit);
+	grid.res[1] = grid_axis_res(extent.y, cells_per_unit);
+	grid.res[2] = grid_axis_res(extent.z, cells_per_unit);
+
+	grid.cell_size = vec3(extent.x / grid.res[0], extent.y / grid.res[1], extent.z / grid.res[2]);
+	grid.inv_cell_size = vec3(1 / grid.cell_size.x, 1 / grid.cell_size.y, 1 / grid.cell_size.z);
+
+	u64 cell_count = (u64)grid.res[0] * grid.res[1] * grid.res[2];
+	grid.cell_start = alloc(ctx, (cell_count + 1) * sizeof(u32));
+
+	// first pass counts the references per cell, second one fills them in
+	for (u32 pass = 0; pass < 2; pass++) {
+		for (u64 i = 0; i < hs.count; i++) {
+			u32 x0 = grid_cell_coord(&grid, bounds[i].min.x, 0), x1 = grid_cell_coord(&grid, bounds[i].max.x, 0);
+			u32 y0 = grid_cell_coord(&grid, bounds[i].min.y, 1), y1 = grid_cell_coord(&grid, bounds[i].max.y, 1);
+			u32 z0 = grid_cell_coord(&grid, bounds[i].min.z, 2), z1 = grid_cell_coord(&grid, bounds[i].max.z, 2);
+
+			for (u32 z = z0; z <= z1; z++) {
+				for (u32 y = y0; y <= y1; y++) {
+					for (u32 x = x0; x <= x1; x++) {
+						u64 cell = grid_cell_index(&grid, x, y, z);
+						if (pass == 0) {
+							grid.cell_start[cell + 1]++;
+						} else {
+							grid.refs[grid.cell_start[cell]++] = i;
+						}
+					}
+				}
+			}
+		}
+
+		if (pass == 0) {
+			for (u64 c = 0; c < cell_count; c++) {
+				grid.cell_start[c + 1] += grid.cell_start[c];
+			}
+			grid.ref_count = grid.cell_start[cell_count];
+			grid.refs = alloc(ctx, grid.ref_count * sizeof(u32) + 1);
+		}
+	}
+
+	// filling advanced every start to the next cell's, shift them back
+	for (u64 c = cell_count; c > 0; c--) {
+		grid.cell_start[c] = grid.cell_start[c - 1];
+	}
+	grid.cell_start[0] = 0;
+
+	grid.prims = alloc(ctx, hs.count * sizeof(hittable_t) + 1);
+	grid.prim_count = hs.count;
+	for (u64 i = 0; i < hs.count; i++) {
+		grid.prims[i] = hs.items[i];
+	}
+
+	dealloc(ctx, bounds);
+	return grid;
+}
+
+void grid_destroy(grid_t* grid) {
+	allocator_dealloc(grid->_allocator, grid->cell_start);
+	allocator_dealloc(grid->_allocator, grid->refs);
+	allocator_dealloc(grid->_allocator, grid->prims);
+	*grid = (grid_t){0};
+}
+
+// 3D-DDA state, one cell of the grid at a time
+typedef struct {
+	i32 cell[3], step[3], end[3];
+	real_t tnext[3], tdelta[3];
+	real_t texit;
+} grid_walk_t;
+
+// clips the ray to the grid, false when it misses it entirely
+static inline bool grid_walk_start(const grid_t* grid, ray_t r, real_t mint, real_t maxt, grid_walk_t* w) {
+	real_t* origin = vec3_data(&r.origin);
+	real_t* dir = vec3_data(&r.direction);
+
+	real_t tenter = mint, texit = maxt;
+	for (u32 axis = 0; axis < 3; axis++) {
+		real_t inv = 1 / dir[axis];
+		real_t t0 = (vec3_at(grid->bounds.min, axis) - origin[axis]) * inv;
+		real_t t1 = (vec3_at(grid->bounds.max, axis) - origin[axis]) * inv;
+		tenter = max_real(tenter, min_real(t0, t1));
+		texit = min_real(texit, max_real(t0, t1));
+	}
+	if (tenter > texit) {
+		return false;
+	}
+	w->texit = texit;
+
+	for (u32 axis = 0; axis < 3; axis++) {
+		real_t p = origin[axis] + dir[axis] * tenter;
+		real_t size = vec3_at(grid->cell_size, axis);
+		real_t min = vec3_at(grid->bounds.min, axis);
+
+		w->cell[axis] = grid_cell_coord(grid, p, axis);
+		if (dir[axis] > 0) {
+			w->step[axis] = 1;
+			w->end[axis] = grid->res[axis];
+			w->tnext[axis] = (min + (w->cell[axis] + 1) * size - origin[axis]) / dir[axis];
+			w->tdelta[axis] = size / dir[axis];
+		} else if (dir[axis] < 0) {
+			w->step[axis] = -1;
+			w->end[axis] = -1;
+			w->tnext[axis] = (min + w->cell[axis] * size - origin[axis]) / dir[axis];
+			w->tdelta[axis] = -size / dir[axis];
+		} else {
+			w->step[axis] = 0;
+			w->end[axis] = -1;
+			w->tnext[axis] = REAL_MAX;
+			w->tdelta[axis] = 0;
+		}
+	}
+	return true;
+}
+
+static u32 grid_walk_axis(const grid_walk_t* w) {
+	return w->tnext[0] < w->tnext[1] ? (w->tnext[0] < w->tnext[2] ? 0 : 2) : (w->tnext[1] < w->tnext[2] ? 1 : 2);
+}
+
+// moves to the next cell along axis, false when the ray leaves the grid
+static bool grid_walk_next(grid_walk_t* w, u32 axis) {
+	if (w->texit < w->tnext[axis]) {
+		return false;
+	}
+	w->cell[axis] += w->step[axis];
+	if (w->cell[axis] == w->end[axis]) {
+		return false;
+	}
+	w->tnext[axis] += w->tdelta[axis];
+	return true;
+}
+
+hit_t grid_hit(const grid_t* grid, ray_t r, real_t mint, real_t maxt) {
+	u32 prim;
+	return grid_hit_prim(grid, r, mint, maxt, &prim);
+}
+
+KERNEL hit_t grid_hit_prim(const grid_t* grid, ray_t r, real_t mint, real_t maxt, u32* out_prim) {
+	hit_t		result = {0};
+	grid_walk_t w;
+	*out_prim = BVH_NO_PRIM;
+	if (grid->prim_count == 0 || !grid_walk_start(grid, r, mint, maxt, &w)) {
+		return result;
+	}
+
+	while (true) {
+		u64 c = grid_cell_index(grid, w.cell[0], w.cell[1], w.cell[2]);
+		for (u32 i = grid->cell_start[c]; i < grid->cell_start[c + 1]; i++) {
+			hit_t this_hit = hit_hittable(grid->prims[grid->refs[i]], r, mint, maxt);
+			if (this_hit.is_hit) {
+				result = this_hit;
+				maxt = this_hit.t;
+				*out_prim = grid->refs[i];
+			}
+		}
+
+		u32 axis = grid_walk_axis(&w);
+
+		// a hit inside the current cell can't be beaten by any cell further along
+		if (maxt <= w.tnext[axis] || !grid_walk_next(&w, axis)) {
+			break;
+		}
+	}
+
+	return result;
+}
+
+// a crossing is kept by the cell whose stretch of the ray [tin, tout) it is in
+void grid_hit_all(const grid_t* grid, ray_t r, real_t mint, real_t maxt, kbuffer_t* b) {
+	grid_walk_t w;
+	if (grid->prim_count == 0 || b->k == 0 || !grid_walk_start(grid, r, mint, maxt, &w)) {
+		return;
+	}
+
+	real_t tin = mint;
+	while (true) {
+		u32	   axis = grid_walk_axis(&w);
+		bool   last = w.texit < w.tnext[axis] || w.cell[axis] + w.step[axis] == w.end[axis];
+		real_t tout = last ? maxt : w.tnext[axis];
+
+		u64 c = grid_cell_index(grid, w.cell[0], w.cell[1], w.cell[2]);
+		for (u32 i = grid->cell_start[c]; i < grid->cell_start[c + 1]; i++) {
+			crossing_t crossings[HITTABLE_MAX_CROSSINGS];
+			u32		   n = crossings_hittable(grid->prims[grid->refs[i]], r, mint, kbuffer_maxt(b, maxt), crossings);
+			for (u32 j = 0; j < n; j++) {
+				if (tin <= crossings[j].t && crossings[j].t < tout) {
+					crossings[j].prim = grid->refs[i];
+					kbuffer_offer(b, crossings[j]);
+				}
+			}
+		}
+
+		// crossings further along can't make it into a full buffer
+		if (kbuffer_maxt(b, maxt) <= tout || !grid_walk_next(&w, axis)) {
+			break;
+		}
+		tin = tout;
+	}
+}
+
+KERNEL bool grid_occluded(const grid_t* grid, ray_t r, real_t mint, real_t maxt) {
+	grid_walk_t w;
+	if (grid->prim_count == 0 || !grid_walk_start(grid, r, mint, maxt, &w)) {
+		return false;
+	}
+
+	do {
+		u64 c = grid_cell_index(grid, w.cell[0], w.cell[1], w.cell[2]);
+		for (u32 i = grid->cell_start[c]; i < grid->cell_start[c + 1]; i++) {
+			if (occluded_hittable(grid->prims[grid->refs[i]], r, mint, maxt)) {
+				return true;
+			}
+		}
+	} while (grid_walk_next(&w, grid_walk_axis(&w)));
+
+	return false;
+}
+
+// :grid_nearest
+// a primitive is in every cell its bounds touch, it counts in the first of them inside [lo, hi]
+static bool grid_first_cell(const grid_t* grid, u32 prim, const u32 lo[3], u32 x, u32 y, u32 z) {
+	aabb_t b = hittable_bounds(grid->prims[prim]);
+	u32	   first[3] = {grid_cell_coord(grid, b.min.x, 0), grid_cell_coord(grid, b.min.y, 1), grid_cell_coord(grid, b.min.z, 2)};
+	return (first[0] > lo[0] ? first[0] : lo[0]) == x && (first[1] > lo[1] ? first[1] : lo[1]) == y &&
+		   (first[2] > lo[2] ? first[2] : lo[2]) == z;
+}
+
+u64 grid_within(const grid_t* grid, vec3_t p, real_t radius, u32* out, u64 capacity) {
+	if (grid->prim_count == 0) {
+		return 0;
+	}
+
+	u32 lo[3], hi[3];
+	for (u32 axis = 0; axis < 3; axis++) {
+		lo[axis] = grid_cell_coord(grid, vec3_at(p, axis) - radius, axis);
+		hi[axis] = grid_cell_coord(grid, vec3_at(p, axis) + radius, axis);
+	}
+
+	u64 found = 0;
+	for (u32 z = lo[2]; z <= hi[2]; z++) {
+		for (u32 y = lo[1]; y <= hi[1]; y++) {
+			for (u32 x = lo[0]; x <= hi[0]; x++) {
+				u64 c = grid_cell_index(grid, x, y, z);
+				for (u32 i = grid->cell_start[c]; i < grid->cell_start[c + 1]; i++) {
+					u32 prim = grid->refs[i];
+					if (distance_hittable(grid->prims[prim], p) <= radius && grid_first_cell(grid, prim, lo, x, y, z)) {
+						if (found < capacity) {
+							out[found] = prim;
+						}
+						found++;
+					}
+				}
+			}
+		}
+	}
+	return found;
+}
+
+static void grid_nearest_cell(const grid_t* grid, vec3_t p, u32 x, u32 y, u32 z, nearest_t* n) {
+	u64 c = grid_cell_index(grid, x, y, z);
+	for (u32 i = grid->cell_start[c]; i < grid->cell_start[c + 1]; i++) {
+		real_t d = distance_hittable(grid->prims[grid->refs[i]], p);
+		if (d < nearest_bound(n)) {
+			nearest_offer(n, grid->refs[i], d);
+		}
+	}
+}
+
+// Shell d is every cell d steps away from p's cell along some axis. p's cell is
+// the one its closest point in the grid falls in, and distances from p are no
+// shorter than from there, so nothing in shell d is closer than d - 1 cells.
+void grid_nearest(const grid_t* grid, vec3_t p, nearest_t* n) {
+	if (grid->prim_count == 0) {
+		return;
+	}
+
+	i64	   center[3] = {grid_cell_coord(grid, p.x, 0), grid_cell_coord(grid, p.y, 1), grid_cell_coord(grid, p.z, 2)};
+	real_t cell = min_real(grid->cell_size.x, min_real(grid->cell_size.y, grid->cell_size.z));
+	i64	   shells = grid->res[0] > grid->res[1] ? grid->res[0] : grid->res[1];
+	shells = shells > grid->res[2] ? shells : grid->res[2];
+
+	for (i64 d = 0; d < shells && (d - 1) * cell < nearest_bound(n); d++) {
+		for (i64 z = center[2] - d; z <= center[2] + d; z++) {
+			if (z < 0 || z >= grid->res[2]) {
+				continue;
+			}
+			for (i64 y = center[1] - d; y <= center[1] + d; y++) {
+				if (y < 0 || y >= grid->res[1]) {
+					continue;
+				}
+				// inside the shell's faces only its two ends along x
+				bool face = z == center[2] - d || z == center[2] + d || y == center[1] - d || y == center[1] + d;
+				i64	 step = face || d == 0 ? 1 : 2 * d;
+				for (i64 x = center[0] - d; x <= center[0] + d; x += step) {
+					if (x >= 0 && x < grid->res[0]) {
+						grid_nearest_cell(grid, p, x, y, z, n);
+					}
+				}
+			}
+		}
+	}
+}
@@ -1,4 +1,8 @@
+#include <fcntl.h>
 #include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "msk.h"
@@ -134,9 +138,112 @@ void dealloc(context_t ctx, void* data) {
 	return allocator_dealloc(ctx.allocator, data);
 }
 
+// :time
+f64 time_now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// :dispatch
+const char* kernel_isa() {
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(__TINYC__)
+	// same order the target_clones resolver checks them in
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("x86-64-v4")) {
+		return "x86-64-v4 (avx512)";
+	}
+	if (__builtin_cpu_supports("x86-64-v3")) {
+		return "x86-64-v3 (avx2)";
+	}
+#endif
+	return "default";
+}
+
+// :file
+static error_t file_map_flags(const char* path, int flags, mapped_file_t* out) {
+	const int fd = open(path, O_RDONLY);
+	try fd < 0 or_return FILE_OPEN_ERROR;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		return FILE_MAP_ERROR;
+	}
+
+	// mmap refuses a length of 0, an empty file is an empty buffer that is still a valid pointer
+	static u8 empty[1];
+	if (st.st_size == 0) {
+		close(fd);
+		*out = (mapped_file_t){.data = empty, .size = 0};
+		return NO_ERROR;
+	}
+
+	// the mapping outlives the descriptor
+	void* data = mmap(null, st.st_size, PROT_READ, MAP_PRIVATE | flags, fd, 0);
+	close(fd);
+	try data == MAP_FAILED or_return FILE_MAP_ERROR;
+
+	out->data = data;
+	out->size = st.st_size;
+	return NO_ERROR;
+}
+
+error_t file_map(const char* path, mapped_file_t* out) {
+	return file_map_flags(path, 0, out);
+}
+
+error_t file_map_populate(const char* path, mapped_file_t* out) {
+	return file_map_flags(path, MAP_POPULATE, out);
+}
+
+error_t file_write_all(int fd, const void* data, u64 len) {
+	const u8* bytes = data;
+	while (len > 0) {
+		ssize_t written = write(fd, bytes, len);
+		try written <= 0 or_return WRITE_ERROR;
+		bytes += written;
+		len -= written;
+	}
+	return NO_ERROR;
+}
+
+// sockets and pipes hand data over in pieces, the end of the stream before len is an error
+error_t file_read_all(int fd, void* data, u64 len) {
+	u8* bytes = data;
+	while (len > 0) {
+		ssize_t got = read(fd, bytes, len);
+		try got <= 0 or_return READ_ERROR;
+		bytes += got;
+		len -= got;
+	}
+	return NO_ERROR;
+}
+
+void file_unmap(mapped_file_t* file) {
+	if (file->size != 0) {
+		munmap(file->data, file->size);
+	}
+	*file = (mapped_file_t){0};
+}
+
+// :hash
+u64 hash_fnv1a(const void* data, u64 len, u64 seed) {
+	const u8* bytes = data;
+	u64		  h = seed;
+	for (u64 i = 0; i < len; i++) {
+		h ^= bytes[i];
+		h *= 0x100000001b3u;
+	}
+	return h;
+}
+
 // :image
 image_t* image_create(context_t ctx, u64 w, u64 h) {
 	image_t* img = alloc(ctx, sizeof(image_t) + (w * h * sizeof(color_t)));
+	if (img == null) {
+		return null;
+	}
 	img->w = w;
 	img->h = h;
 	img->data = (color_t*)(img + 1);
@@ -187,6 +294,30 @@ error_t image_write_ppm(image_t* img, int fd) {
 	return NO_ERROR;
 }
 
+error_t ppm_writer_begin(int fd, u64 w, u64 h, ppm_writer_t* out) {
+	const u64 cap = 64;
+	u8		  buffer[cap];
+	u64		  i = 0;
+
+	i += fmt_str_to_buf("P6\n", buffer + i, cap - i);
+	i += fmt_u64_to_buf(w, buffer + i, cap - i);
+	i += fmt_str_to_buf(" ", buffer + i, cap - i);
+	i += fmt_u64_to_buf(h, buffer + i, cap - i);
+	i += fmt_str_to_buf("\n255\n", buffer + i, cap - i);	// color depth
+
+	*out = (ppm_writer_t){.fd = fd, .w = w, .h = h};
+	return file_write_all(fd, buffer, i);
+}
+
+error_t ppm_writer_rows(ppm_writer_t* pw, const color_t* rows, u64 count) {
+	try pw->rows + count > pw->h or_return PPM_TOO_MANY_ROWS;
+
+	error_t err;
+	try (err = file_write_all(pw->fd, rows, pw->w * count * sizeof(color_t))) or_return err;
+	pw->rows += count;
+	return NO_ERROR;
+}
+
 error_t image_write_tga(image_t* img, int fd) {
 	try img->w > U16_MAX or_return TGA_WIDTH_TOO_LARGE;
 	try img->h > U16_MAX or_return TGA_HEIGHT_TOO_LARGE;
@@ -21,12 +21,14 @@ typedef float  f32;
 
 #define U8_MAX ((1 << 8) - 1)
 #define U16_MAX ((1 << 16) - 1)
-#define U32_MAX ((1 << 32) - 1)
-#define U64_MAX ((1 << 64) - 1)
+#define U32_MAX (0xffffffffu)
+#define U64_MAX (0xffffffffffffffffu)
 
 #define null (void*)(0)
 
 f64	 sqrt(f64);	 // avoid including math.h
+f32	 sqrtf(f32);
+f64	 cbrt(f64);
 void exit(i32);	 // avoid including stdlib.h
 
 // :fmt
@@ -68,6 +70,19 @@ void* alloc(context_t ctx, u64 size);
 void* ralloc(context_t ctx, void* data, u64 size);
 void  dealloc(context_t ctx, void* data);
 
+// :time
+f64 time_now();	 // monotonic, in seconds
+
+// :dispatch
+// hot kernels are compiled once per isa level, the loader picks one through cpuid
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(__TINYC__)
+#define KERNEL __attribute__((target_clones("default", "arch=x86-64-v3", "arch=x86-64-v4")))
+#else
+#define KERNEL
+#endif
+
+const char* kernel_isa();  // the variant the loader picked, for logs
+
 // :view
 #define view_of(type) \
 	struct {          \
@@ -106,22 +121,168 @@ void  dealloc(context_t ctx, void* data);
 typedef enum {
 	NO_ERROR = 0,
 	WRITE_ERROR,
+	READ_ERROR,
+	ALLOC_ERROR,
 
 	TGA_WIDTH_TOO_LARGE,
 	TGA_HEIGHT_TOO_LARGE,
+	PPM_TOO_MANY_ROWS,
+
+	FILE_OPEN_ERROR,
+	FILE_MAP_ERROR,
+
+	CACHE_BAD_MAGIC,
+	CACHE_BAD_VERSION,
+	CACHE_BAD_LAYOUT,
+	CACHE_STALE,
+	CACHE_TRUNCATED,
+	CACHE_CORRUPT,
+
+	SCENE_UNKNOWN_KEYWORD,
+	SCENE_SYNTAX_ERROR,
+
+	SOCKET_ERROR,
+	SERVER_BAD_REQUEST,
+
+	RENDER_STOPPED,
 } error_t;
 
+// :file
+typedef struct {
+	u8* data;
+	u64 size;
+} mapped_file_t;
+
+// pages are read in as they are touched
+error_t file_map(const char* path, mapped_file_t* out);
+// for callers that read all of it: the pages are faulted in up front rather than one at a time
+error_t file_map_populate(const char* path, mapped_file_t* out);
+void	file_unmap(mapped_file_t* file);
+
+error_t file_write_all(int fd, const void* data, u64 len);
+error_t file_read_all(int fd, void* data, u64 len);
+
+// :hash
+#define HASH_FNV1A_SEED 0xcbf29ce484222325u
+
+u64 hash_fnv1a(const void* data, u64 len, u64 seed);
+
+// :real
+// Scalar of vectors, rays and every kernel built on them. Defaults to f64,
+// building with -DMSK_F32 switches all of them to f32 at once.
+#ifdef MSK_F32
+typedef f32 real_t;
+#define REAL_EPSILON 1.1920929e-7f
+#define REAL_MAX 1e38f
+#define real_sqrt sqrtf
+#else
+typedef f64 real_t;
+#define REAL_EPSILON 2.220446049250313e-16
+#define REAL_MAX 1e300
+#define real_sqrt sqrt
+#endif
+
+static inline real_t min_real(real_t a, real_t b) {
+	return a < b ? a : b;
+}
+
+static inline real_t max_real(real_t a, real_t b) {
+	return a > b ? a : b;
+}
+
 // :linalg
+#ifdef MSK_SIMD
+#include <immintrin.h>
+
+// Padded to four lanes so each helper below is a handful of vector ops, _w is
+// always 0. The lanes alias the fields, so a vec3_t stays in one register
+// across inlined calls. Aligned to 16 only, what malloc guarantees.
+typedef real_t vec3_lanes_t __attribute__((vector_size(4 * sizeof(real_t)), aligned(16)));
+
+typedef union {
+	struct {
+		real_t x, y, z, _w;
+	};
+	vec3_lanes_t v;
+} vec3_t;
+
+#ifdef MSK_F32
+#define lanes_fmsub(a, b, c) ((vec3_lanes_t)_mm_fmsub_ps((__m128)(a), (__m128)(b), (__m128)(c)))
+#define lanes_min(a, b) ((vec3_lanes_t)_mm_min_ps((__m128)(a), (__m128)(b)))
+#define lanes_max(a, b) ((vec3_lanes_t)_mm_max_ps((__m128)(a), (__m128)(b)))
+
+static inline real_t lanes_dot3(vec3_lanes_t a, vec3_lanes_t b) {
+	return _mm_cvtss_f32(_mm_dp_ps((__m128)a, (__m128)b, 0x71));
+}
+
+#define lanes_yzx(v) ((vec3_lanes_t)_mm_shuffle_ps((__m128)(v), (__m128)(v), _MM_SHUFFLE(3, 0, 2, 1)))
+#define lanes_zxy(v) ((vec3_lanes_t)_mm_shuffle_ps((__m128)(v), (__m128)(v), _MM_SHUFFLE(3, 1, 0, 2)))
+#else
+#define lanes_fmsub(a, b, c) ((vec3_lanes_t)_mm256_fmsub_pd((__m256d)(a), (__m256d)(b), (__m256d)(c)))
+#define lanes_min(a, b) ((vec3_lanes_t)_mm256_min_pd((__m256d)(a), (__m256d)(b)))
+#define lanes_max(a, b) ((vec3_lanes_t)_mm256_max_pd((__m256d)(a), (__m256d)(b)))
+
+// a horizontal add across the ymm halves measured slower than three scalar adds
+static inline real_t lanes_dot3(vec3_lanes_t a, vec3_lanes_t b) {
+	vec3_lanes_t m = a * b;
+	return m[0] + m[1] + m[2];
+}
+
+#define lanes_yzx(v) ((vec3_lanes_t)_mm256_permute4x64_pd((__m256d)(v), _MM_SHUFFLE(3, 0, 2, 1)))
+#define lanes_zxy(v) ((vec3_lanes_t)_mm256_permute4x64_pd((__m256d)(v), _MM_SHUFFLE(3, 1, 0, 2)))
+#endif
+#else
 typedef struct {
-	f64 x, y, z;
+	real_t x, y, z;
 } vec3_t;
+#endif
+
+// designated, so it fills the same fields of either layout and leaves _w 0
+#define vec3(x_, y_, z_) ((vec3_t){.x = (x_), .y = (y_), .z = (z_)})
 
 #define vecmath(expression) ((vec3_t){})
+#define vecmath_lanes(count, ...) \
+	do {                          \
+	} while (0)
+
+static inline real_t* vec3_data(vec3_t* a) {
+	return (real_t*)a;
+}
 
-static inline f64* vec3_data(vec3_t* a) {
-	return (f64*)a;
+static inline real_t vec3_at(vec3_t a, u32 axis) {
+	return vec3_data(&a)[axis];
 }
 
+#ifdef MSK_SIMD
+static inline vec3_t vec3_add(vec3_t a, vec3_t b) {
+	return (vec3_t){.v = a.v + b.v};
+}
+
+static inline vec3_t vec3_sub(vec3_t a, vec3_t b) {
+	return (vec3_t){.v = a.v - b.v};
+}
+
+static inline vec3_t vec3_neg(vec3_t a) {
+	return (vec3_t){.v = -a.v};
+}
+
+static inline vec3_t vec3_mul(vec3_t a, real_t s) {
+	return (vec3_t){.v = a.v * s};
+}
+
+// a.yzx * b.zxy - a.zxy * b.yzx, the subtraction fused into the first product
+static inline vec3_t vec3_cross(vec3_t a, vec3_t b) {
+	return (vec3_t){.v = lanes_fmsub(lanes_yzx(a.v), lanes_zxy(b.v), lanes_zxy(a.v) * lanes_yzx(b.v))};
+}
+
+static inline real_t vec3_dot(vec3_t a, vec3_t b) {
+	return lanes_dot3(a.v, b.v);
+}
+
+static inline vec3_t vec3_muladd(vec3_t a, real_t s, vec3_t b) {
+	return (vec3_t){.v = a.v * s + b.v};
+}
+#else
 static inline vec3_t vec3_add(vec3_t a, vec3_t b) {
 	return (vec3_t){.x = a.x + b.x, .y = a.y + b.y, .z = a.z + b.z};
 }
@@ -134,28 +295,34 @@ static inline vec3_t vec3_neg(vec3_t a) {
 	return (vec3_t){.x = -a.x, .y = -a.y, .z = -a.z};
 }
 
-static inline vec3_t vec3_mul(vec3_t a, f64 s) {
+static inline vec3_t vec3_mul(vec3_t a, real_t s) {
 	return (vec3_t){.x = a.x * s, .y = a.y * s, .z = a.z * s};
 }
 
-static inline vec3_t vec3_div(vec3_t a, f64 s) {
-	return vec3_mul(a, 1. / s);
-}
-
 static inline vec3_t vec3_cross(vec3_t a, vec3_t b) {
-	return (vec3_t){a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x};
+	return vec3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
 }
 
-static inline f64 vec3_dot(vec3_t a, vec3_t b) {
+static inline real_t vec3_dot(vec3_t a, vec3_t b) {
 	return a.x * b.x + a.y * b.y + a.z * b.z;
 }
 
-static inline f64 vec3_len2(vec3_t a) {
+// a * s + b, contracted to one fma per component where the target has it
+static inline vec3_t vec3_muladd(vec3_t a, real_t s, vec3_t b) {
+	return (vec3_t){.x = a.x * s + b.x, .y = a.y * s + b.y, .z = a.z * s + b.z};
+}
+#endif
+
+static inline vec3_t vec3_div(vec3_t a, real_t s) {
+	return vec3_mul(a, 1 / s);
+}
+
+static inline real_t vec3_len2(vec3_t a) {
 	return vec3_dot(a, a);
 }
 
-static inline f64 vec3_len(vec3_t a) {
-	return sqrt(vec3_len2(a));
+static inline real_t vec3_len(vec3_t a) {
+	return real_sqrt(vec3_len2(a));
 }
 
 static inline vec3_t vec3_norm(vec3_t a) {
@@ -174,12 +341,12 @@ static inline void vec3p_neg(vec3_t* a) {
 	*a = vec3_neg(*a);
 }
 
-static inline void vec3p_mul(vec3_t* a, f64 s) {
+static inline void vec3p_mul(vec3_t* a, real_t s) {
 	*a = vec3_mul(*a, s);
 }
 
-static inline void vec3p_div(vec3_t* a, f64 s) {
-	vec3p_mul(a, 1. / s);
+static inline void vec3p_div(vec3_t* a, real_t s) {
+	vec3p_mul(a, 1 / s);
 }
 
 static inline void vec3p_cross(vec3_t* a, vec3_t b) {
@@ -190,10 +357,101 @@ static inline void vec3p_norm(vec3_t* a) {
 	vec3_div(*a, vec3_len(*a));
 }
 
+static inline f64 min_f64(f64 a, f64 b) {
+	return a < b ? a : b;
+}
+
+static inline f64 max_f64(f64 a, f64 b) {
+	return a > b ? a : b;
+}
+
+#ifdef MSK_SIMD
+static inline vec3_t vec3_min(vec3_t a, vec3_t b) {
+	return (vec3_t){.v = lanes_min(a.v, b.v)};
+}
+
+static inline vec3_t vec3_max(vec3_t a, vec3_t b) {
+	return (vec3_t){.v = lanes_max(a.v, b.v)};
+}
+#else
+static inline vec3_t vec3_min(vec3_t a, vec3_t b) {
+	return (vec3_t){.x = min_real(a.x, b.x), .y = min_real(a.y, b.y), .z = min_real(a.z, b.z)};
+}
+
+static inline vec3_t vec3_max(vec3_t a, vec3_t b) {
+	return (vec3_t){.x = max_real(a.x, b.x), .y = max_real(a.y, b.y), .z = max_real(a.z, b.z)};
+}
+#endif
+
 static inline f64 clamp_f64(f64 v, f64 min, f64 max) {
 	return v > max ? max : v < min ? min : v;
 }
 
+// :affine
+typedef struct {
+	vec3_t r0, r1, r2;	// rows of the linear part
+	vec3_t t;
+} affine_t;
+
+static inline affine_t affine_identity() {
+	return (affine_t){.r0 = vec3(1, 0, 0), .r1 = vec3(0, 1, 0), .r2 = vec3(0, 0, 1)};
+}
+
+static inline affine_t affine_translate(vec3_t t) {
+	affine_t m = affine_identity();
+	m.t = t;
+	return m;
+}
+
+static inline affine_t affine_scale(real_t s) {
+	return (affine_t){.r0 = vec3(s, 0, 0), .r1 = vec3(0, s, 0), .r2 = vec3(0, 0, s)};
+}
+
+static inline vec3_t affine_vector(affine_t m, vec3_t v) {
+	return vec3(vec3_dot(m.r0, v), vec3_dot(m.r1, v), vec3_dot(m.r2, v));
+}
+
+static inline vec3_t affine_point(affine_t m, vec3_t p) {
+	return vec3_add(affine_vector(m, p), m.t);
+}
+
+// multiplies by the transposed linear part, normals go through the inverse this way
+static inline vec3_t affine_vector_transposed(affine_t m, vec3_t v) {
+	return vec3_add(vec3_add(vec3_mul(m.r0, v.x), vec3_mul(m.r1, v.y)), vec3_mul(m.r2, v.z));
+}
+
+// a * b, b is applied first
+static inline affine_t affine_mul(affine_t a, affine_t b) {
+	affine_t bt = {
+		.r0 = vec3(b.r0.x, b.r1.x, b.r2.x),
+		.r1 = vec3(b.r0.y, b.r1.y, b.r2.y),
+		.r2 = vec3(b.r0.z, b.r1.z, b.r2.z),
+	};
+	return (affine_t){
+		.r0 = affine_vector(bt, a.r0),
+		.r1 = affine_vector(bt, a.r1),
+		.r2 = affine_vector(bt, a.r2),
+		.t = affine_point(a, b.t),
+	};
+}
+
+static inline affine_t affine_inverse(affine_t m) {
+	// columns of the linear part
+	vec3_t a = vec3(m.r0.x, m.r1.x, m.r2.x);
+	vec3_t b = vec3(m.r0.y, m.r1.y, m.r2.y);
+	vec3_t c = vec3(m.r0.z, m.r1.z, m.r2.z);
+
+	real_t inv_det = 1 / vec3_dot(a, vec3_cross(b, c));
+
+	affine_t inv = {
+		.r0 = vec3_mul(vec3_cross(b, c), inv_det),
+		.r1 = vec3_mul(vec3_cross(c, a), inv_det),
+		.r2 = vec3_mul(vec3_cross(a, b), inv_det),
+	};
+	inv.t = vec3_neg(affine_vector(inv, m.t));
+	return inv;
+}
+
 // :color
 typedef struct {
 	u8 r, g, b;
@@ -217,11 +475,24 @@ typedef struct {
 	allocator_t _allocator;
 } image_t;
 
-image_t* image_create(context_t ctx, u64 w, u64 h);
+image_t* image_create(context_t ctx, u64 w, u64 h);  // null when there is no memory for it
 void	 image_destroy(image_t* img);
 error_t	 image_write_ppm(image_t* img, int fd);
 error_t	 image_write_tga(image_t* img, int fd);
 
+// Binary ppm written a band of rows at a time, top to bottom, for images never
+// held whole. The size is text in the header, so unlike tga neither side is
+// limited to 16 bits, and color_t is already its pixel layout.
+typedef struct {
+	int fd;
+	u64 w, h;
+	u64 rows;  // written so far
+} ppm_writer_t;
+
+error_t ppm_writer_begin(int fd, u64 w, u64 h, ppm_writer_t* out);
+// the next count rows of w pixels
+error_t ppm_writer_rows(ppm_writer_t* pw, const color_t* rows, u64 count);
+
 // :error :macro
 #define try if ((
 #define or_return )) return
@@ -0,0 +1,273 @@
+#include <unistd.h>
+
+#include "rt.h"
+
+// a cached tree's ids are used as they are on disk, one past the primitives is a miss
+// rather than an index the caller can't use
+static u32 query_prim_id(const bvh_t* bvh, u32 i) {
+	u32 id = bvh->prim_ids[i];
+	return id < bvh->prim_count ? id : QUERY_MISS;
+}
+
+// :query_baked
+// A baked accelerator answers hit and occluded only, with no primitive ids. It
+// is only chosen for scenes small enough to unroll, so the other queries go
+// through the render scene's own copy of the primitives one by one.
+static hit_t query_baked_hit(hittable_view_t hs, ray_t r, real_t mint, real_t maxt, u32* prim) {
+	hit_t best = {0};
+	*prim = QUERY_MISS;
+	for (u64 i = 0; i < hs.count; i++) {
+		hit_t hit = hit_hittable(hs.items[i], r, mint, maxt);
+		if (hit.is_hit) {
+			best = hit;
+			maxt = hit.t;
+			*prim = i;
+		}
+	}
+	return best;
+}
+
+static void query_baked_hit_all(hittable_view_t hs, ray_t r, real_t mint, real_t maxt, kbuffer_t* b) {
+	for (u64 i = 0; i < hs.count; i++) {
+		crossing_t crossings[HITTABLE_MAX_CROSSINGS];
+		u32		   n = crossings_hittable(hs.items[i], r, mint, kbuffer_maxt(b, maxt), crossings);
+		for (u32 j = 0; j < n; j++) {
+			crossings[j].prim = i;
+			kbuffer_offer(b, crossings[j]);
+		}
+	}
+}
+
+static void query_baked_nearest(hittable_view_t hs, vec3_t p, nearest_t* n) {
+	for (u64 i = 0; i < hs.count; i++) {
+		real_t d = distance_hittable(hs.items[i], p);
+		if (d < nearest_bound(n)) {
+			nearest_offer(n, i, d);
+		}
+	}
+}
+
+static u64 query_baked_within(hittable_view_t hs, vec3_t p, real_t radius, u32* out, u64 capacity) {
+	u64 found = 0;
+	for (u64 i = 0; i < hs.count; i++) {
+		if (distance_hittable(hs.items[i], p) <= radius) {
+			if (found < capacity) {
+				out[found] = i;
+			}
+			found++;
+		}
+	}
+	return found;
+}
+
+// :query
+// one chunk of rays, prims are left as the scene's indices
+static void query_chunk_hit(const render_scene_t* rs, const ray_t* rays, u64 count, real_t mint, real_t maxt, hit_t* hits,
+							u32* prims) {
+	const accel_t* accel = &rs->world.accel;
+	switch (accel->type) {
+		case ACCEL_BVH:
+			if (accel->bvh.node_count * sizeof(bvh_node_t) >= QUERY_STREAM_BYTES) {
+				bvh_hit_stream_prim(&accel->bvh, rays, count, mint, maxt, hits, prims);
+			} else {
+				for (u64 i = 0; i < count; i++) {
+					hits[i] = bvh_hit_prim(&accel->bvh, rays[i], mint, maxt, &prims[i]);
+				}
+			}
+			for (u64 i = 0; i < count; i++) {
+				prims[i] = prims[i] == BVH_NO_PRIM ? QUERY_MISS : query_prim_id(&accel->bvh, prims[i]);
+			}
+			return;
+		case ACCEL_GRID:
+			for (u64 i = 0; i < count; i++) {
+				hits[i] = grid_hit_prim(&accel->grid, rays[i], mint, maxt, &prims[i]);
+				prims[i] = prims[i] == BVH_NO_PRIM ? QUERY_MISS : prims[i];
+			}
+			return;
+		case ACCEL_BAKED:
+			for (u64 i = 0; i < count; i++) {
+				hits[i] = query_baked_hit((hittable_view_t)view_darr(rs->scene.prims), rays[i], mint, maxt, &prims[i]);
+			}
+			return;
+	}
+	unreachable;
+}
+
+KERNEL void query_hit(const render_scene_t* rs, const ray_t* rays, u64 count, real_t mint, real_t maxt, query_hits_t out) {
+#pragma omp parallel for schedule(dynamic, 1)
+	for (u64 start = 0; start < count; start += QUERY_CHUNK) {
+		hit_t hits[QUERY_CHUNK];
+		u32	  prims[QUERY_CHUNK];
+		u64	  n = count - start < QUERY_CHUNK ? count - start : QUERY_CHUNK;
+		query_chunk_hit(rs, rays + start, n, mint, maxt, hits, prims);
+
+		// written out as separate arrays, only the ones asked for
+		for (u64 i = 0; i < n; i++) {
+			if (out.t != null) {
+				out.t[start + i] = hits[i].is_hit ? hits[i].t : maxt;
+			}
+			if (out.prim != null) {
+				out.prim[start + i] = prims[i];
+			}
+			if (out.normal != null) {
+				out.normal[start + i] = hits[i].is_hit ? hits[i].normal : (vec3_t){0};
+			}
+		}
+	}
+}
+
+KERNEL void query_occluded(const render_scene_t* rs, const ray_t* rays, u64 count, real_t mint, real_t maxt, bool* out) {
+#pragma omp parallel for schedule(dynamic, QUERY_CHUNK)
+	for (u64 i = 0; i < count; i++) {
+		out[i] = accel_occluded(&rs->world.accel, rays[i], mint, maxt);
+	}
+}
+
+// :nearest
+void nearest_offer(nearest_t* n, u32 prim, real_t distance) {
+	if (distance >= nearest_bound(n)) {
+		return;
+	}
+	for (u32 i = 0; i < n->count; i++) {
+		if (n->prims[i] == prim) {
+			return;
+		}
+	}
+
+	// the last one falls off once there are k
+	u32 i = n->count < n->k ? n->count++ : n->count - 1;
+	for (; i > 0 && n->distances[i - 1] > distance; i--) {
+		n->prims[i] = n->prims[i - 1];
+		n->distances[i] = n->distances[i - 1];
+	}
+	n->prims[i] = prim;
+	n->distances[i] = distance;
+}
+
+// :kbuffer
+void kbuffer_offer(kbuffer_t* b, crossing_t c) {
+	if (c.t >= kbuffer_maxt(b, REAL_MAX)) {
+		return;
+	}
+
+	// the last one falls off once there are k
+	u32 i = b->count < b->k ? b->count++ : b->count - 1;
+	for (; i > 0 && b->items[i - 1].t > c.t; i--) {
+		b->items[i] = b->items[i - 1];
+	}
+	b->items[i] = c;
+}
+
+// :query_hit_all
+static void query_ray_hit_all(const render_scene_t* rs, ray_t r, real_t mint, real_t maxt, kbuffer_t* b) {
+	const accel_t* accel = &rs->world.accel;
+	switch (accel->type) {
+		case ACCEL_BVH:
+			bvh_hit_all(&accel->bvh, r, mint, maxt, b);
+			for (u32 i = 0; i < b->count; i++) {
+				b->items[i].prim = query_prim_id(&accel->bvh, b->items[i].prim);
+			}
+			return;
+		case ACCEL_GRID:
+			grid_hit_all(&accel->grid, r, mint, maxt, b);
+			return;
+		case ACCEL_BAKED:
+			query_baked_hit_all((hittable_view_t)view_darr(rs->scene.prims), r, mint, maxt, b);
+			return;
+	}
+	unreachable;
+}
+
+KERNEL void query_hit_all(const render_scene_t* rs, const ray_t* rays, u64 count, real_t mint, real_t maxt, u32 k,
+						  crossing_t* out, u32* out_counts) {
+#pragma omp parallel for schedule(dynamic, 64)
+	for (u64 i = 0; i < count; i++) {
+		kbuffer_t b = {.items = out + i * k, .k = k};
+		query_ray_hit_all(rs, rays[i], mint, maxt, &b);
+		out_counts[i] = b.count;
+	}
+}
+
+// :query_nearest
+static void query_point_nearest(const render_scene_t* rs, vec3_t p, nearest_t* n) {
+	const accel_t* accel = &rs->world.accel;
+	switch (accel->type) {
+		case ACCEL_BVH:
+			bvh_nearest(&accel->bvh, p, n);
+			for (u32 i = 0; i < n->count; i++) {
+				n->prims[i] = query_prim_id(&accel->bvh, n->prims[i]);
+			}
+			return;
+		case ACCEL_GRID:
+			grid_nearest(&accel->grid, p, n);
+			return;
+		case ACCEL_BAKED:
+			query_baked_nearest((hittable_view_t)view_darr(rs->scene.prims), p, n);
+			return;
+	}
+	unreachable;
+}
+
+static u64 query_point_within(const render_scene_t* rs, vec3_t p, real_t radius, u32* out, u64 capacity) {
+	const accel_t* accel = &rs->world.accel;
+	switch (accel->type) {
+		case ACCEL_BVH: {
+			u64 found = bvh_within(&accel->bvh, p, radius, out, capacity);
+			for (u64 i = 0; i < found && i < capacity; i++) {
+				out[i] = query_prim_id(&accel->bvh, out[i]);
+			}
+			return found;
+		}
+		case ACCEL_GRID:
+			return grid_within(&accel->grid, p, radius, out, capacity);
+		case ACCEL_BAKED:
+			return query_baked_within((hittable_view_t)view_darr(rs->scene.prims), p, radius, out, capacity);
+	}
+	unreachable;
+}
+
+void query_nearest(const render_scene_t* rs, const vec3_t* points, u64 count, u32 k, real_t max_distance, u32* out_prims,
+				   real_t* out_distances) {
+	if (k == 0) {
+		return;
+	}
+
+#pragma omp parallel for schedule(dynamic, 64)
+	for (u64 i = 0; i < count; i++) {
+		nearest_t n = {
+			.prims = out_prims + i * k,
+			.distances = out_distances + i * k,
+			.k = k,
+			.max_distance = max_distance,
+		};
+		query_point_nearest(rs, points[i], &n);
+
+		for (u32 j = n.count; j < k; j++) {
+			n.prims[j] = QUERY_MISS;
+			n.distances[j] = max_distance;
+		}
+	}
+}
+
+// the first pass counts, the second one writes every point's ids where the counts put them
+u64 query_within(const render_scene_t* rs, const vec3_t* points, u64 count, real_t radius, u32* out_prims, u64 capacity,
+				 u64* out_offsets) {
+#pragma omp parallel for schedule(dynamic, 64)
+	for (u64 i = 0; i < count; i++) {
+		out_offsets[i + 1] = query_point_within(rs, points[i], radius, null, 0);
+	}
+
+	out_offsets[0] = 0;
+	for (u64 i = 0; i < count; i++) {
+		out_offsets[i + 1] += out_offsets[i];
+	}
+	if (out_offsets[count] > capacity) {
+		return out_offsets[count];
+	}
+
+#pragma omp parallel for schedule(dynamic, 64)
+	for (u64 i = 0; i < count; i++) {
+		query_point_within(rs, points[i], radius, out_prims + out_offsets[i], out_offsets[i + 1] - out_offsets[i]);
+	}
+	return out_offsets[count];
+}
@@ -0,0 +1,343 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "rt.h"
+
+// :render
+// written beside it and renamed over, another process may have the old one mapped
+static error_t render_cache_write(const bvh_t* bvh, u64 key, const char* path) {
+	char tmp_path[4096];
+	snprintf(tmp_path, sizeof(tmp_path), "%s.%d.tmp", path, getpid());
+	const int fd = open(tmp_path, O_CREAT | O_WRONLY | O_TRUNC, 0644);
+	try fd < 0 or_return FILE_OPEN_ERROR;
+
+	error_t err = bvh_cache_write(bvh, key, fd);
+	if (close(fd) != 0 && err == NO_ERROR) {
+		err = WRITE_ERROR;
+	}
+	if (err == NO_ERROR && rename(tmp_path, path) != 0) {
+		err = WRITE_ERROR;
+	}
+	if (err != NO_ERROR) {
+		unlink(tmp_path);
+	}
+	return err;
+}
+
+render_scene_t render_scene_create(context_t ctx, scene_t scene, const char* cache_path) {
+	render_scene_t	rs = {.scene = scene, ._allocator = ctx.allocator};
+	hittable_view_t prims = view_darr(scene.prims);
+
+	// a bvh is reused from the cache while the primitives are unchanged
+	rs.world.accel.type = accel_choose(prims);
+	if (rs.world.accel.type != ACCEL_BVH) {
+		rs.world.accel = accel_build(ctx, rs.world.accel.type, prims);
+	} else if (cache_path == null || bvh_cache_load(cache_path, hittables_hash(prims), &rs.world.accel.bvh) != NO_ERROR) {
+		rs.world.accel.bvh = bvh_build(ctx, prims);
+
+		// the bvh just built is used either way, a cache that can't be written only costs the next run
+		if (cache_path != null) {
+			rs.cache_error = render_cache_write(&rs.world.accel.bvh, hittables_hash(prims), cache_path);
+		}
+	}
+
+	rs.set = hittable_set_build(ctx, prims);
+	return rs;
+}
+
+void render_scene_destroy(render_scene_t* rs) {
+	accel_destroy(&rs->world.accel);
+	hittable_set_destroy(&rs->set);
+	scene_destroy(&rs->scene);
+	*rs = (render_scene_t){0};
+}
+
+render_job_t render_job_create(context_t ctx, const render_scene_t* rs, render_mode_t mode) {
+	return (render_job_t){
+		.scene = rs,
+		.mode = mode,
+		.camera = rs->scene.camera,
+		.samples = rs->scene.samples,
+		.bounces = rs->scene.bounces,
+		.tile_w = TILE_SIZE,
+		.tile_h = TILE_SIZE,
+		._allocator = ctx.allocator,
+	};
+}
+
+static void render_job_free_scratch(render_job_t* job) {
+	allocator_dealloc(job->_allocator, job->_samples);
+	allocator_dealloc(job->_allocator, job->_hits);
+	allocator_dealloc(job->_allocator, job->_gbuffer);
+	allocator_dealloc(job->_allocator, job->_paths);
+	allocator_dealloc(job->_allocator, job->_path_pixels);
+	allocator_dealloc(job->_allocator, job->_tile_colors);
+	if (job->_wf.capacity != 0) {
+		wavefront_destroy(&job->_wf);
+	}
+	if (job->_tile_set._allocator.alloc != null) {
+		hittable_set_destroy(&job->_tile_set);
+	}
+	job->_samples = null, job->_hits = null, job->_gbuffer = null;
+	job->_paths = null, job->_path_pixels = null, job->_tile_colors = null;
+	job->_spp = 0, job->_tile_pixels = 0;
+}
+
+void render_job_destroy(render_job_t* job) {
+	render_job_free_scratch(job);
+	*job = (render_job_t){0};
+}
+
+// scratch sized for one tile, kept from run to run while the settings fit in it
+static void render_job_reserve(render_job_t* job, u64 spp, u64 tile_pixels) {
+	if (job->_spp >= spp && job->_tile_pixels >= tile_pixels && job->_mode == job->mode) {
+		return;
+	}
+	render_job_free_scratch(job);
+
+	context_t ctx = {.allocator = job->_allocator};
+	job->_samples = alloc(ctx, spp * sizeof(ray_t));
+	job->_hits = alloc(ctx, spp * sizeof(hit_t));
+	job->_tile_colors = alloc(ctx, tile_pixels * sizeof(vec3_t));
+
+	switch (job->mode) {
+		case RENDER_PACKETS:
+			job->_gbuffer = alloc(ctx, tile_pixels * sizeof(gbuffer_pixel_t));
+			break;
+		case RENDER_WAVEFRONT: {
+			u64 paths = tile_pixels * spp < RENDER_WAVEFRONT_PATHS ? tile_pixels * spp : RENDER_WAVEFRONT_PATHS;
+			paths = paths > spp ? paths : spp;
+			job->_wf = wavefront_create(ctx, paths);
+			job->_paths = alloc(ctx, paths * sizeof(ray_t));
+			job->_path_pixels = alloc(ctx, paths * sizeof(u32));
+			break;
+		}
+		case RENDER_TILES:
+			job->_tile_set = hittable_set_build(ctx, (hittable_view_t)view_darr(job->scene->scene.prims));
+			break;
+	}
+
+	job->_spp = spp;
+	job->_tile_pixels = tile_pixels;
+	job->_mode = job->mode;
+}
+
+static render_view_t render_view_create(camera_t camera, u64 width, u64 height) {
+	vec3_t focal_length = vec3(0, 0, camera.focal_length);
+
+	f64	   viewport_height = camera.viewport_height;
+	f64	   viewport_width = viewport_height * ((f64)width / height);
+	vec3_t viewport_u = vec3(viewport_width, 0, 0);
+	vec3_t viewport_v = vec3(0, -viewport_height, 0);
+
+	render_view_t view = {.center = camera.center};
+	view.pix_delta_u = vecmath(viewport_u / width);
+	view.pix_delta_v = vecmath(viewport_v / height);
+
+	vec3_t viewport_upper_left = vecmath(camera.center - focal_length - (viewport_u + viewport_v) / 2);
+	view.pix00 = vecmath(viewport_upper_left + (view.pix_delta_u + view.pix_delta_v) / 2);
+	return view;
+}
+
+// rows step along pix_delta_u and columns along pix_delta_v, as main always laid the image out
+static vec3_t render_pixel_center(const render_view_t* view, real_t row, real_t col) {
+	vec3_t center = view->pix00;
+	vec3p_add(&center, vec3_mul(view->pix_delta_u, row + view->y));
+	vec3p_add(&center, vec3_mul(view->pix_delta_v, col));
+	return center;
+}
+
+// the n x n samples of a pixel, row by row
+static void render_pixel_samples(const render_view_t* view, u64 row, u64 col, u32 n, ray_t* samples) {
+	vec3_t	  pix_center = render_pixel_center(view, row, col);
+	const f64 ysamples = n;
+	const f64 xsamples = n;
+
+	for (i64 ry = 0; ry < n; ry++) {
+		for (i64 rx = 0; rx < n; rx++) {
+			vec3_t center = pix_center;
+			vec3p_add(&center, vec3_mul(view->pix_delta_u, ry / ysamples - 0.5));
+			vec3p_add(&center, vec3_mul(view->pix_delta_v, rx / xsamples - 0.5));
+
+			samples[ry * n + rx] = (ray_t){
+				.origin = view->center,
+				.direction = vec3_sub(center, view->center),
+			};
+		}
+	}
+}
+
+static color_t render_resolve(vec3_t sum, u64 spp) {
+	vec3_t v = vec3_div(sum, spp);
+	return vec3_to_color((vec3_t){
+		.x = v.x > 0 ? sqrt(v.x) : 0,
+		.y = v.y > 0 ? sqrt(v.y) : 0,
+		.z = v.z > 0 ? sqrt(v.z) : 0,
+	});
+}
+
+// primary rays are coherent, they go through the world together unless the g-buffer says otherwise
+static void render_tile_packets(render_job_t* job, const render_view_t* view, render_tile_t tile, image_t* img) {
+	const world_t* world = &job->scene->world;
+	const u32	   n = job->samples;
+
+	// g-buffer pass, a few probe rays per pixel decide how the rest of its samples are traced
+	for (u64 y = 0; y < tile.h; y++) {
+		for (u64 x = 0; x < tile.w; x++) {
+			render_pixel_samples(view, tile.y + y, tile.x + x, n, job->_samples);
+			job->_gbuffer[y * tile.w + x] = gbuffer_probe(world, job->_samples, n, n, RAY_MINT, RAY_MAXT);
+		}
+	}
+
+	for (u64 y = 0; y < tile.h; y++) {
+		for (u64 x = 0; x < tile.w; x++) {
+			render_pixel_samples(view, tile.y + y, tile.x + x, n, job->_samples);
+			gbuffer_hit_block(world, job->_gbuffer[y * tile.w + x], job->_samples, n, n, RAY_MINT, RAY_MAXT, job->_hits);
+
+			vec3_t color = {0};
+			for (u64 s = 0; s < n * n; s++) {
+				vec3p_add(&color, ray_color_hit(job->_samples[s], job->_hits[s], world, job->bounces));
+			}
+			img->data[(tile.y + y) * img->w + tile.x + x] = render_resolve(color, n * n);
+		}
+	}
+}
+
+// the paths of as many of the tile's pixels as the scratch holds at once, breadth first
+static void render_tile_wavefront(render_job_t* job, const render_view_t* view, render_tile_t tile, image_t* img) {
+	const u64 spp = job->samples * job->samples;
+	const u64 pixels = tile.w * tile.h;
+	const u64 batch = job->_wf.capacity / spp;
+
+	for (u64 first = 0; first < pixels; first += batch) {
+		u64 count = pixels - first < batch ? pixels - first : batch;
+		for (u64 i = 0; i < count; i++) {
+			u64 pixel = first + i;
+			render_pixel_samples(view, tile.y + pixel / tile.w, tile.x + pixel % tile.w, job->samples, job->_paths + i * spp);
+			for (u64 s = 0; s < spp; s++) {
+				job->_path_pixels[i * spp + s] = pixel;
+			}
+			job->_tile_colors[pixel] = (vec3_t){0};
+		}
+
+		wavefront_render(&job->_wf, &job->scene->world, job->_paths, job->_path_pixels, count * spp, job->bounces,
+						 job->_tile_colors);
+	}
+
+	for (u64 y = 0; y < tile.h; y++) {
+		for (u64 x = 0; x < tile.w; x++) {
+			img->data[(tile.y + y) * img->w + tile.x + x] = render_resolve(job->_tile_colors[y * tile.w + x], spp);
+		}
+	}
+}
+
+// camera rays against the primitives the tile's frustum can see, bounces against the whole world
+static void render_tile_culled(render_job_t* job, const render_view_t* view, render_tile_t tile, image_t* img) {
+	const u32 n = job->samples;
+
+	// the samples stay within half a pixel of the centers
+	vec3_t	  corner = render_pixel_center(view, tile.y - 0.5, tile.x - 0.5);
+	frustum_t f = frustum_create(view->center, corner, vec3_mul(view->pix_delta_u, tile.h), vec3_mul(view->pix_delta_v, tile.w));
+	tile_cull_set(&f, &job->scene->set, &job->_tile_set);
+
+	for (u64 y = tile.y; y < tile.y + tile.h; y++) {
+		for (u64 x = tile.x; x < tile.x + tile.w; x++) {
+			render_pixel_samples(view, y, x, n, job->_samples);
+
+			vec3_t color = {0};
+			for (u64 s = 0; s < n * n; s++) {
+				hit_t hit = hit_set(&job->_tile_set, job->_samples[s], RAY_MINT, RAY_MAXT);
+				vec3p_add(&color, ray_color_hit(job->_samples[s], hit, &job->scene->world, job->bounces));
+			}
+			img->data[y * img->w + x] = render_resolve(color, n * n);
+		}
+	}
+}
+
+void render_job_begin(render_job_t* job, image_t* img) {
+	render_job_begin_rows(job, img, img->h, 0);
+}
+
+void render_job_begin_rows(render_job_t* job, image_t* img, u64 height, u64 y) {
+	render_job_reserve(job, (u64)job->samples * job->samples, job->tile_w * job->tile_h);
+
+	const u64 tiles_x = (img->w + job->tile_w - 1) / job->tile_w;
+	const u64 tiles_y = (img->h + job->tile_h - 1) / job->tile_h;
+
+	job->stop = false;
+	job->_img = img;
+	job->_next = (render_tile_t){.count = tiles_x * tiles_y};
+
+	// the whole image's view, rows counted from the band's first
+	job->_view = render_view_create(job->camera, img->w, height);
+	job->_view.y = y;
+}
+
+bool render_job_step(render_job_t* job) {
+	image_t*	  img = job->_img;
+	render_tile_t tile = job->_next;
+	if (job->stop || tile.index == tile.count) {
+		return false;
+	}
+
+	// tiles in rows, left to right
+	tile.w = img->w - tile.x < job->tile_w ? img->w - tile.x : job->tile_w;
+	tile.h = img->h - tile.y < job->tile_h ? img->h - tile.y : job->tile_h;
+
+	switch (job->mode) {
+		case RENDER_PACKETS:
+			render_tile_packets(job, &job->_view, tile, img);
+			break;
+		case RENDER_WAVEFRONT:
+			render_tile_wavefront(job, &job->_view, tile, img);
+			break;
+		case RENDER_TILES:
+			render_tile_culled(job, &job->_view, tile, img);
+			break;
+	}
+
+	tile.index++;
+	job->_next = tile;
+	job->_next.x += job->tile_w;
+	if (job->_next.x >= img->w) {
+		job->_next.x = 0;
+		job->_next.y += job->tile_h;
+	}
+
+	if (job->on_tile != null) {
+		job->on_tile(job->user, img, tile);
+	}
+	return !job->stop && tile.index != tile.count;
+}
+
+void render_job_run(render_job_t* job, image_t* img) {
+	render_job_begin(job, img);
+	while (render_job_step(job)) {
+	}
+}
+
+error_t render_job_stream(render_job_t* job, u64 width, u64 height, ppm_writer_t* out) {
+	context_t ctx = {.allocator = job->_allocator};
+	image_t*  band = image_create(ctx, width, job->tile_h);
+	try band == null or_return ALLOC_ERROR;
+
+	error_t err = NO_ERROR;
+	for (u64 y = 0; y < height && err == NO_ERROR; y += job->tile_h) {
+		// the last band is only what is left of the image
+		band->h = height - y < job->tile_h ? height - y : job->tile_h;
+		render_job_begin_rows(job, band, height, y);
+		while (render_job_step(job)) {
+		}
+
+		// stopped, the band is unfinished and the image is short of it
+		if (job->stop) {
+			err = RENDER_STOPPED;
+			break;
+		}
+		err = ppm_writer_rows(out, band->data, band->h);
+	}
+
+	image_destroy(band);
+	return err;
+}
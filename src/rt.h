@@ -0,0 +1,843 @@
+#ifndef RT_H
+#define RT_H
+
+#include "msk.h"
+
+// :ray
+typedef struct {
+	vec3_t origin, direction;
+} ray_t;
+
+typedef struct {
+	real_t t;
+	vec3_t point;
+	vec3_t normal;
+	bool   is_hit, is_front_face;
+} hit_t;
+
+// range used for every camera and bounce ray
+#define RAY_MINT 0.00001
+#define RAY_MAXT 10.
+
+// Bounce origins are pushed off the surface along the normal by a few ulps of
+// the point's largest coordinate, enough for the rounding of either precision.
+#define RAY_OFFSET_ULPS 64
+
+static inline vec3_t ray_offset_origin(vec3_t point, vec3_t normal) {
+	real_t scale = max_real(max_real(max_real(point.x, -point.x), max_real(point.y, -point.y)), max_real(point.z, -point.z));
+	return vec3_add(point, vec3_mul(normal, (scale + 1) * REAL_EPSILON * RAY_OFFSET_ULPS));
+}
+
+// :sampling
+real_t rand_real();
+vec3_t vec3_rand(real_t min, real_t max);
+vec3_t vec3_rand_unit();
+vec3_t vec3_rand_hemisphere(vec3_t normal);
+
+// background seen by rays that leave the world
+vec3_t sky_color(vec3_t direction);
+
+// :hittable
+// Every kind of primitive, X(KIND, name). Each one has a name_t starting with
+// its hittable_type_t and hit_name, occluded_name, crossings_name,
+// name_distance, name_bounds, name_hash, frustum_culls_name, and in packet.c
+// packet_hit_name and packet_resolve_name; the enum, the union, every switch
+// and the per kind loops of hittable_set_t are generated from this list.
+#define HITTABLE_KINDS(X) X(SPHERE, sphere)
+
+typedef enum {
+#define X(kind, name) kind,
+	HITTABLE_KINDS(X)
+#undef X
+} hittable_type_t;
+
+typedef struct {
+	hittable_type_t type;
+
+	vec3_t center;
+	real_t radius;
+} sphere_t;
+
+typedef union {
+	hittable_type_t type;
+#define X(kind, name) name##_t name;
+	HITTABLE_KINDS(X)
+#undef X
+} hittable_t;
+
+typedef view_of(hittable_t) hittable_view_t;
+
+// Primitives split by kind into packed arrays, so each loop over them is
+// homogeneous: no per primitive switch and no padding to the largest kind.
+typedef struct {
+#define X(kind, name) \
+	name##_t* name##s;  \
+	u64		  name##_count;
+	HITTABLE_KINDS(X)
+#undef X
+
+	allocator_t _allocator;
+} hittable_set_t;
+
+hittable_set_t hittable_set_build(context_t ctx, hittable_view_t hs);
+void		   hittable_set_destroy(hittable_set_t* set);
+hit_t		   hit_set(const hittable_set_t* set, ray_t r, real_t mint, real_t maxt);
+bool		   occluded_set(const hittable_set_t* set, ray_t r, real_t mint, real_t maxt);
+
+hit_t hit_sphere(sphere_t s, ray_t r, real_t mint, real_t maxt);
+hit_t hit_hittable(hittable_t h, ray_t r, real_t mint, real_t maxt);
+hit_t hit_many(hittable_view_t hs, ray_t r, real_t mint, real_t maxt);
+
+// any-hit queries: true as soon as something is found in (mint, maxt), no hit_t is built
+bool occluded_sphere(sphere_t s, ray_t r, real_t mint, real_t maxt);
+bool occluded_hittable(hittable_t h, ray_t r, real_t mint, real_t maxt);
+bool occluded_many(hittable_view_t hs, ray_t r, real_t mint, real_t maxt);
+
+// one place where a ray goes through the surface of a primitive
+typedef struct {
+	real_t t;
+	vec3_t normal;	// outward
+	u32	   prim;
+	bool   entering;  // into the primitive, false on the way out
+} crossing_t;
+
+// a ray crosses a sphere at most twice
+#define HITTABLE_MAX_CROSSINGS 2
+
+// every crossing in (mint, maxt) nearest first, prim left for the caller; returns how many
+u32 crossings_sphere(sphere_t s, ray_t r, real_t mint, real_t maxt, crossing_t* out);
+u32 crossings_hittable(hittable_t h, ray_t r, real_t mint, real_t maxt, crossing_t* out);
+
+// from p to the closest point of the primitive, 0 inside it
+real_t sphere_distance(sphere_t s, vec3_t p);
+real_t distance_hittable(hittable_t h, vec3_t p);
+
+// hashes the primitive fields only, padding inside the union is never read
+u64 hittables_hash(hittable_view_t hs);
+
+// :aabb
+typedef struct {
+	vec3_t min, max;
+} aabb_t;
+
+static inline aabb_t aabb_empty() {
+	return (aabb_t){
+		.min = vec3(REAL_MAX, REAL_MAX, REAL_MAX),
+		.max = vec3(-REAL_MAX, -REAL_MAX, -REAL_MAX),
+	};
+}
+
+static inline aabb_t aabb_union(aabb_t a, aabb_t b) {
+	return (aabb_t){.min = vec3_min(a.min, b.min), .max = vec3_max(a.max, b.max)};
+}
+
+static inline aabb_t aabb_grow(aabb_t a, vec3_t p) {
+	return (aabb_t){.min = vec3_min(a.min, p), .max = vec3_max(a.max, p)};
+}
+
+static inline vec3_t aabb_center(aabb_t a) {
+	return vec3_mul(vec3_add(a.min, a.max), 0.5);
+}
+
+static inline real_t aabb_area(aabb_t a) {
+	vec3_t d = vec3_sub(a.max, a.min);
+	if (d.x < 0 || d.y < 0 || d.z < 0) {
+		return 0;
+	}
+	return 2 * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+// slab test, inv_dir is 1 / ray.direction precomputed once per ray
+static inline bool aabb_hit(aabb_t a, vec3_t origin, vec3_t inv_dir, real_t mint, real_t maxt) {
+	real_t t0x = (a.min.x - origin.x) * inv_dir.x, t1x = (a.max.x - origin.x) * inv_dir.x;
+	real_t t0y = (a.min.y - origin.y) * inv_dir.y, t1y = (a.max.y - origin.y) * inv_dir.y;
+	real_t t0z = (a.min.z - origin.z) * inv_dir.z, t1z = (a.max.z - origin.z) * inv_dir.z;
+
+	mint = max_real(mint, max_real(min_real(t0x, t1x), max_real(min_real(t0y, t1y), min_real(t0z, t1z))));
+	maxt = min_real(maxt, min_real(max_real(t0x, t1x), min_real(max_real(t0y, t1y), max_real(t0z, t1z))));
+	return mint <= maxt;
+}
+
+// from p to the closest point of the box, 0 inside it
+static inline real_t aabb_distance(aabb_t a, vec3_t p) {
+	vec3_t d = vec3_max(vec3_max(vec3_sub(a.min, p), vec3_sub(p, a.max)), (vec3_t){0});
+	return vec3_len(d);
+}
+
+aabb_t hittable_bounds(hittable_t h);
+
+// :nearest
+// The k closest primitives found so far, nearest first. Kept sorted by
+// insertion, k is expected to be small next to what a search visits.
+typedef struct {
+	u32*	prims;
+	real_t* distances;
+	u32		k, count;
+	real_t	max_distance;  // nothing this far or farther is kept
+} nearest_t;
+
+// how close a primitive has to be to make it in
+static inline real_t nearest_bound(const nearest_t* n) {
+	return n->count < n->k ? n->max_distance : n->distances[n->count - 1];
+}
+
+// keeps prim if it is among the k closest, a prim already kept is ignored
+void nearest_offer(nearest_t* n, u32 prim, real_t distance);
+
+// :kbuffer
+// The k nearest crossings of one ray found so far, nearest first. Once it is
+// full its last entry bounds the search the way the closest hit bounds maxt,
+// so a full buffer may have left more crossings out. Searches that go near
+// first hand crossings over mostly in order, and those insert at the end.
+typedef struct {
+	crossing_t* items;
+	u32			k, count;
+} kbuffer_t;
+
+static inline real_t kbuffer_maxt(const kbuffer_t* b, real_t maxt) {
+	return b->count < b->k ? maxt : b->items[b->count - 1].t;
+}
+
+void kbuffer_offer(kbuffer_t* b, crossing_t c);
+
+// :bvh
+// Flat bounding volume hierarchy. Nodes only reference each other and the
+// primitives by index, so the whole structure can be written to disk and
+// mapped back without any fixups.
+typedef struct {
+	aabb_t bounds;
+	u32	   offset;	// first primitive for leaves, second child for inner nodes
+	u32	   count;	// primitives in the leaf, 0 for inner nodes
+	u32	   axis;	// split axis, the near child is visited first
+	u32	   _pad;
+} bvh_node_t;
+
+typedef struct {
+	bvh_node_t* nodes;
+	u64			node_count;
+
+	// reordered so every leaf references a contiguous range
+	hittable_t* prims;
+	u64			prim_count;
+	u32*		prim_ids;  // index each of prims had in the primitives it was built from
+
+	allocator_t	  _allocator;
+	mapped_file_t _mapping;	 // set when loaded from a cache file
+} bvh_t;
+
+#define BVH_MAX_LEAF 4
+#define BVH_MAX_DEPTH 64  // entries of a traversal stack
+// deepest a node is built, a traversal then never holds more than one
+// pending sibling per level plus the root on its stack
+#define BVH_MAX_TREE_DEPTH (BVH_MAX_DEPTH - 2)
+
+// A cached tree is used without reading it through first, so traversals check each
+// node they open: a leaf stays inside the prims, an inner node's children come after
+// it and inside the nodes, and there is room on the stack (top entries in use) for both.
+// Built trees always pass; a corrupt cache loses the nodes that don't instead of
+// sending a traversal outside the mapping.
+static inline bool bvh_node_valid(const bvh_t* bvh, u32 idx, u32 top) {
+	const bvh_node_t* n = &bvh->nodes[idx];
+	if (n->count != 0) {
+		return n->count <= bvh->prim_count && n->offset <= bvh->prim_count - n->count;
+	}
+	return idx + 1 < n->offset && n->offset < bvh->node_count && n->axis < 3 && top + 2 <= BVH_MAX_DEPTH;
+}
+
+bvh_t bvh_build(context_t ctx, hittable_view_t hs);
+void  bvh_destroy(bvh_t* bvh);
+hit_t bvh_hit(const bvh_t* bvh, ray_t r, real_t mint, real_t maxt);
+bool  bvh_occluded(const bvh_t* bvh, ray_t r, real_t mint, real_t maxt);
+
+// same as bvh_hit, also telling which of bvh->prims was hit, BVH_NO_PRIM on a miss
+#define BVH_NO_PRIM U32_MAX
+hit_t bvh_hit_prim(const bvh_t* bvh, ray_t r, real_t mint, real_t maxt, u32* out_prim);
+
+// Closest hits for a stream of independent rays. BVH_STREAM_WIDTH of them are
+// traversed at once, one node each in turn, and every ray prefetches its next
+// node before the switch so the memory accesses of the others overlap the wait.
+#define BVH_STREAM_WIDTH 8
+
+void bvh_hit_stream(const bvh_t* bvh, const ray_t* rays, u64 count, real_t mint, real_t maxt, hit_t* out);
+// also telling which of bvh->prims each ray hit, BVH_NO_PRIM on a miss; out_prims may be null
+void bvh_hit_stream_prim(const bvh_t* bvh, const ray_t* rays, u64 count, real_t mint, real_t maxt, hit_t* out,
+						 u32* out_prims);
+
+// every crossing in (mint, maxt) into b, prims as indices of bvh->prims
+void bvh_hit_all(const bvh_t* bvh, ray_t r, real_t mint, real_t maxt, kbuffer_t* b);
+
+// proximity queries over the primitives' distances to p, prims as indices of bvh->prims.
+// nearest visits nodes best first, within writes up to capacity and returns how many there are
+void bvh_nearest(const bvh_t* bvh, vec3_t p, nearest_t* n);
+u64	 bvh_within(const bvh_t* bvh, vec3_t p, real_t radius, u32* out, u64 capacity);
+
+// builds the node array over arbitrary bounds, indices is reordered to match the leaves
+u64 bvh_build_nodes(context_t ctx, const aabb_t* bounds, u32* indices, u64 count, bvh_node_t** out_nodes);
+
+// :grid
+// Uniform grid traversed with a 3D-DDA. Cells store primitive indices in a
+// compressed row layout: cell i owns refs[cell_start[i] .. cell_start[i + 1]].
+typedef struct {
+	aabb_t bounds;
+	u32	   res[3];
+	vec3_t cell_size, inv_cell_size;
+
+	u32* cell_start;
+	u32* refs;
+	u64	 ref_count;
+
+	hittable_t* prims;
+	u64			prim_count;
+
+	allocator_t _allocator;
+} grid_t;
+
+#define GRID_DENSITY 2.	// cells per primitive
+#define GRID_MAX_RES 512
+
+grid_t grid_build(context_t ctx, hittable_view_t hs);
+void   grid_destroy(grid_t* grid);
+hit_t  grid_hit(const grid_t* grid, ray_t r, real_t mint, real_t maxt);
+// same as grid_hit, also telling which of grid->prims was hit, BVH_NO_PRIM on a miss
+hit_t  grid_hit_prim(const grid_t* grid, ray_t r, real_t mint, real_t maxt, u32* out_prim);
+bool   grid_occluded(const grid_t* grid, ray_t r, real_t mint, real_t maxt);
+// same as bvh_hit_all, a crossing counts in the cell it is in so primitives in several cells give it once
+void grid_hit_all(const grid_t* grid, ray_t r, real_t mint, real_t maxt, kbuffer_t* b);
+// same as bvh_nearest and bvh_within, nearest searches shells of cells outwards from p
+void grid_nearest(const grid_t* grid, vec3_t p, nearest_t* n);
+u64	 grid_within(const grid_t* grid, vec3_t p, real_t radius, u32* out, u64 capacity);
+
+// :accel
+typedef enum {
+	ACCEL_BVH,
+	ACCEL_GRID,
+	ACCEL_BAKED,  // queries compiled for one scene, never chosen or built from primitives
+} accel_type_t;
+
+typedef struct {
+	hit_t (*hit)(ray_t r, real_t mint, real_t maxt);
+	bool (*occluded)(ray_t r, real_t mint, real_t maxt);
+} baked_t;
+
+typedef struct {
+	accel_type_t type;
+	union {
+		bvh_t	bvh;
+		grid_t	grid;
+		baked_t baked;
+	};
+} accel_t;
+
+// grids win when primitives are many and alike in size, anything else goes in a bvh
+accel_type_t accel_choose(hittable_view_t hs);
+
+accel_t accel_build(context_t ctx, accel_type_t type, hittable_view_t hs);
+void	accel_destroy(accel_t* accel);
+hit_t	accel_hit(const accel_t* accel, ray_t r, real_t mint, real_t maxt);
+bool	accel_occluded(const accel_t* accel, ray_t r, real_t mint, real_t maxt);
+
+// :scene
+// Scene files, one statement per line and # to the end of a line is a comment:
+//   camera   x y z  focal_length viewport_height  centered, looking down -z
+//   image    width height
+//   samples  n  an n x n grid of rays per pixel
+//   bounces  n
+//   sphere   x y z  radius
+// Anything a file leaves out keeps the value of scene_default.
+#define SCENE_MAX_IMAGE_SIZE (1 << 20)
+#define SCENE_MAX_SAMPLES 256
+#define SCENE_MAX_BOUNCES 10000
+
+typedef struct {
+	vec3_t center;
+	real_t focal_length, viewport_height;
+} camera_t;
+
+typedef struct {
+	camera_t camera;
+	u64		 width, height;
+	u32		 samples;
+	i32		 bounces;
+
+	darr_of(hittable_t) prims;
+
+	u64 error_line;	 // of the statement a load failed on
+} scene_t;
+
+scene_t scene_default(context_t ctx);
+error_t scene_parse(context_t ctx, const u8* data, u64 size, scene_t* out);
+error_t scene_load(context_t ctx, const char* path, scene_t* out);
+void	scene_destroy(scene_t* scene);
+
+// Generated by nob from scenes/default.scene into build/src/baked_scene.c and
+// only linked into main. The primitives as data, and the same scene compiled
+// into scene_hit and scene_occluded with every sphere an immediate, unrolled
+// nearest first unless there are too many for that. main only swaps them in for a
+// scene whose primitives hash the same as scene_prims.
+extern hittable_t scene_prims[];
+extern const u64  scene_prim_count;
+extern const bool scene_unrolled;
+extern const char scene_baked_path[];  // the scene file it was generated from
+
+hit_t scene_hit(ray_t r, real_t mint, real_t maxt);
+bool  scene_occluded(ray_t r, real_t mint, real_t maxt);
+
+// :packet
+// Coherent rays traced together through a bvh. Lanes are stored as arrays so
+// the per-lane loops vectorize, traversal decisions are shared by the packet
+// and nodes outside the frustum spanned by the corner rays are culled early.
+#define PACKET_DIM 4
+#define PACKET_SIZE (PACKET_DIM * PACKET_DIM)
+#define PACKET_MISS U32_MAX
+
+typedef struct {
+	real_t ox[PACKET_SIZE], oy[PACKET_SIZE], oz[PACKET_SIZE];
+	real_t dx[PACKET_SIZE], dy[PACKET_SIZE], dz[PACKET_SIZE];
+	real_t idx[PACKET_SIZE], idy[PACKET_SIZE], idz[PACKET_SIZE];
+
+	real_t t[PACKET_SIZE];		// closest hit so far
+	u32 prim[PACKET_SIZE];	// index into bvh prims, PACKET_MISS until something is hit
+
+	// side planes through the shared origin, only valid when has_frustum
+	vec3_t planes[4];
+	bool   has_frustum;
+} packet_t;
+
+// rays is a PACKET_DIM x PACKET_DIM block in row order
+void  packet_init(packet_t* p, const ray_t* rays, real_t maxt);
+void  packet_hit_bvh(const bvh_t* bvh, packet_t* p, real_t mint);
+hit_t packet_lane_hit(const bvh_t* bvh, const packet_t* p, u32 lane, real_t mint, real_t maxt);
+void  packet_resolve(const bvh_t* bvh, const packet_t* p, hit_t* out);	// every lane, PACKET_SIZE hits
+
+typedef struct world_t world_t;
+
+// closest hits for a w x h block of rays in row order, in packets whenever the world allows it
+void world_hit_block(const world_t* w, const ray_t* rays, u64 width, u64 height, real_t mint, real_t maxt, hit_t* out);
+
+// :tile
+// Camera rays of one image tile can only reach what is inside the pyramid
+// spanned by the tile's corners, so each tile gets its own primitive list and
+// its rays test only that. Pays off when the scene is small enough to scan.
+#define TILE_SIZE 16  // pixels
+#define FRUSTUM_PLANES 5
+
+typedef struct {
+	vec3_t origin;
+	vec3_t planes[FRUSTUM_PLANES];	// unit normals through origin, pointing inside
+} frustum_t;
+
+// the pyramid from origin through the parallelogram corner, corner + edge_u, corner + edge_u + edge_v, corner + edge_v
+frustum_t frustum_create(vec3_t origin, vec3_t corner, vec3_t edge_u, vec3_t edge_v);
+bool	  frustum_culls_aabb(const frustum_t* f, aabb_t b);
+bool	  frustum_culls_hittable(const frustum_t* f, hittable_t h);
+
+// copies the primitives of hs that can be inside the frustum to out, returns how many
+u64 tile_cull(const frustum_t* f, hittable_view_t hs, hittable_t* out);
+// same for a set, out must be built from the same primitives so every array is large enough
+u64 tile_cull_set(const frustum_t* f, const hittable_set_t* set, hittable_set_t* out);
+
+// :gbuffer
+// What the camera rays of a pixel see, from a handful of probe rays traced
+// before rendering. A pixel whose probes all miss is sky and its samples are
+// never traced, one whose probes all hit the same primitive intersects just it.
+// Probes alone can step over a small primitive, so both verdicts are only kept
+// when the pixel's frustum overlaps no other primitive.
+typedef enum {
+	GBUFFER_MIXED,
+	GBUFFER_SKY,
+	GBUFFER_UNIFORM,
+} gbuffer_kind_t;
+
+typedef struct {
+	gbuffer_kind_t kind;
+	u32			   prim;		// index into the bvh prims, only for uniform pixels
+	real_t		   tmin, tmax;	// depth range of the probes that hit
+} gbuffer_pixel_t;
+
+// probes the corners and center of a w x h block of camera rays through a parallelogram of the image plane,
+// worlds other than a plain bvh are always mixed
+gbuffer_pixel_t gbuffer_probe(const world_t* w, const ray_t* rays, u64 width, u64 height, real_t mint, real_t maxt);
+
+// same results as world_hit_block, skipping the traversal the pixel's kind allows
+void gbuffer_hit_block(const world_t* w, gbuffer_pixel_t px, const ray_t* rays, u64 width, u64 height, real_t mint, real_t maxt,
+					   hit_t* out);
+
+// :instance
+// A shared bottom level bvh placed in the world by a transform. Only the world
+// to object transform is kept: rays go through it and normals come back through
+// its transpose, so each copy costs one instance_t instead of its geometry.
+typedef struct {
+	affine_t to_object;
+	u32		 blas;	// index into the tlas blases
+	u32		 _pad;
+} instance_t;
+
+typedef view_of(instance_t) instance_view_t;
+typedef view_of(bvh_t) bvh_view_t;
+
+instance_t instance_create(affine_t to_world, u32 blas);
+
+typedef struct {
+	bvh_node_t* nodes;
+	u64			node_count;
+
+	// reordered to match the leaves
+	instance_t* instances;
+	u64			instance_count;
+
+	// not owned, must outlive the tlas
+	const bvh_t* blases;
+	u64			 blas_count;
+
+	allocator_t _allocator;
+} tlas_t;
+
+tlas_t tlas_build(context_t ctx, instance_view_t instances, bvh_view_t blases);
+void   tlas_destroy(tlas_t* tlas);
+hit_t  tlas_hit(const tlas_t* tlas, ray_t r, real_t mint, real_t maxt);
+bool   tlas_occluded(const tlas_t* tlas, ray_t r, real_t mint, real_t maxt);
+
+// :world
+struct world_t {
+	accel_t accel;	// loose primitives
+	tlas_t	tlas;	// instanced geometry
+};
+
+hit_t world_hit(const world_t* w, ray_t r, real_t mint, real_t maxt);
+bool  world_occluded(const world_t* w, ray_t r, real_t mint, real_t maxt);
+
+// :integrator
+// depth first reference integrator, one path at a time
+vec3_t ray_color(ray_t ray, const world_t* world, i32 max_bouces);
+
+// shading once the closest hit of ray is known
+vec3_t ray_color_hit(ray_t ray, hit_t hit, const world_t* world, i32 max_bouces);
+
+// :wavefront
+// Breadth first integrator. Every live path sits in a structure of arrays
+// queue; each bounce runs intersection, shading and ray generation as separate
+// passes over the whole queue and survivors are compacted into the other one.
+typedef struct {
+	real_t *ox, *oy, *oz;
+	real_t *dx, *dy, *dz;
+	real_t* weight;  // product of the albedos along the path so far
+	u32* pixel;	  // accumulator the path adds to
+	u64	 count;
+} ray_queue_t;
+
+typedef struct {
+	ray_queue_t queues[2];
+	hit_t*		hits;
+	u64			capacity;
+
+	// sort secondary rays by ray_sort_key before intersecting them
+	bool		reorder;
+	ray_queue_t sorted;
+	u32*		keys;  // twice the capacity, the radix passes ping pong between halves
+	u32*		order;
+	f64			sort_seconds;  // time spent reordering, for benchmarks
+
+	allocator_t _allocator;
+} wavefront_t;
+
+wavefront_t wavefront_create(context_t ctx, u64 capacity);
+void		wavefront_destroy(wavefront_t* wf);
+
+// direction octant in the top 3 bits, then the morton code of the origin inside bounds
+#define RAY_SORT_BITS 9	 // per axis
+u32 ray_sort_key(ray_t r, aabb_t bounds);
+
+// traces count rays to completion, adding the radiance of ray i to accum[pixels[i]]
+void wavefront_render(wavefront_t* wf, const world_t* w, const ray_t* rays, const u32* pixels, u64 count,
+					  i32 max_bounces, vec3_t* accum);
+
+// :render
+// The renderer as a library. A render_scene_t is everything renders of one
+// scene share, read only once it is created: the primitives, the accelerator
+// and the set tiles are culled from. Any number of jobs render it, each with
+// its own camera, settings and scratch, into images their callers own.
+typedef enum {
+	RENDER_PACKETS,	   // g-buffer probes, then coherent packets of camera rays
+	RENDER_WAVEFRONT,  // breadth first, the paths of as many pixels of a tile as fit at once
+	RENDER_TILES,	   // camera rays against per tile culled lists instead of the accelerator
+} render_mode_t;
+
+// paths a wavefront job keeps in flight, at least one pixel's worth; a 16 x 16 tile
+// at 256 samples would otherwise hold 16M of them
+#define RENDER_WAVEFRONT_PATHS (1 << 17)
+
+typedef struct {
+	scene_t		   scene;
+	world_t		   world;
+	hittable_set_t set;
+	error_t		   cache_error;	 // why the bvh built could not be written to the cache, NO_ERROR otherwise
+
+	allocator_t _allocator;
+} render_scene_t;
+
+// takes the scene over; the bvh is read from cache_path while it matches the primitives and written there
+// otherwise, a null path always builds it. A cache that can't be written is left as it was and reported
+// in cache_error, the scene is usable either way.
+render_scene_t render_scene_create(context_t ctx, scene_t scene, const char* cache_path);
+void		   render_scene_destroy(render_scene_t* rs);
+
+typedef struct {
+	u64 x, y, w, h;		// pixels of the image
+	u64 index, count;	// tiles finished counting this one, out of all of the run's
+} render_tile_t;
+
+// the camera's image plane for one image size
+typedef struct {
+	vec3_t center;
+	vec3_t pix00, pix_delta_u, pix_delta_v;
+	u64	   y;  // image row of the band's first
+} render_view_t;
+
+// called once a tile is in the image
+typedef void (*render_progress_t)(void* user, const image_t* img, render_tile_t tile);
+
+typedef struct {
+	const render_scene_t* scene;
+	render_mode_t		  mode;
+
+	// the scene's to start with, free to change between runs
+	camera_t camera;
+	u32		 samples;
+	i32		 bounces;
+	u64		 tile_w, tile_h;
+
+	render_progress_t on_tile;
+	void*			  user;
+	bool			  stop;	 // set from on_tile to end the run after that tile
+
+	// scratch for one tile, kept while the settings fit in it
+	ray_t*			 _samples;
+	hit_t*			 _hits;
+	gbuffer_pixel_t* _gbuffer;
+	wavefront_t		 _wf;
+	ray_t*			 _paths;
+	u32*			 _path_pixels;
+	vec3_t*			 _tile_colors;
+	hittable_set_t	 _tile_set;
+	u64				 _spp, _tile_pixels;
+	render_mode_t	 _mode;
+
+	// the run in progress
+	image_t*	  _img;
+	render_view_t _view;
+	render_tile_t _next;
+
+	allocator_t _allocator;
+} render_job_t;
+
+render_job_t render_job_create(context_t ctx, const render_scene_t* rs, render_mode_t mode);
+void		 render_job_destroy(render_job_t* job);
+// renders all of img, whatever its size, tile by tile
+void render_job_run(render_job_t* job, image_t* img);
+
+// the same run a tile at a time, so other work can go between tiles: begin
+// sets it up and every step renders the next tile, false once none is left
+void render_job_begin(render_job_t* job, image_t* img);
+bool render_job_step(render_job_t* job);
+// begins a run of rows [y, y + img->h) of an image img->w x height into img
+void render_job_begin_rows(render_job_t* job, image_t* img, u64 height, u64 y);
+
+// Renders a width x height image a row of tiles at a time into out, top to
+// bottom, so only one band of tile_h rows is ever in memory whatever the height.
+// The tiles come in the same order as render_job_run's, so is the image.
+// RENDER_STOPPED when on_tile stopped it, out then only has the bands before.
+error_t render_job_stream(render_job_t* job, u64 width, u64 height, ppm_writer_t* out);
+
+// :query
+// Batches of rays cast against a render scene's world for callers other than
+// the renderer: line of sight, visibility. Rays are independent, so a batch is
+// split across threads in chunks. A chunk goes through a bvh as a stream once
+// its nodes are too many to stay in cache, before that one ray at a time is faster.
+#define QUERY_CHUNK 256
+#define QUERY_STREAM_BYTES (16 << 20)
+#define QUERY_MISS U32_MAX
+
+// where each ray hit, any of the arrays may be null when it isn't wanted
+typedef struct {
+	real_t* t;		 // maxt on a miss
+	u32*	prim;	 // index into the scene's prims, QUERY_MISS on a miss
+	vec3_t* normal;	 // of the surface at the hit, zero on a miss
+} query_hits_t;
+
+void query_hit(const render_scene_t* rs, const ray_t* rays, u64 count, real_t mint, real_t maxt, query_hits_t out);
+// true where something is in (mint, maxt)
+void query_occluded(const render_scene_t* rs, const ray_t* rays, u64 count, real_t mint, real_t maxt, bool* out);
+
+// The first k crossings of every ray, nearest first, with k entries per ray in
+// out and how many are filled in in out_counts. Nothing is allocated per ray;
+// a count of k may have left more out, a k as large as the scene can cross
+// keeps them all.
+void query_hit_all(const render_scene_t* rs, const ray_t* rays, u64 count, real_t mint, real_t maxt, u32 k,
+				   crossing_t* out, u32* out_counts);
+
+// Proximity to points, measured to the closest point of each primitive and
+// searched in the same bvh or grid the scene renders with. A baked scene has
+// neither, so its queries other than occluded go over the primitives one by one.
+// The k nearest within max_distance of every point, nearest first: k entries
+// per point in both arrays, the ones past what was found are QUERY_MISS and max_distance.
+void query_nearest(const render_scene_t* rs, const vec3_t* points, u64 count, u32 k, real_t max_distance, u32* out_prims,
+				   real_t* out_distances);
+// Every primitive within radius of each point, in no particular order, in compressed
+// rows: point i owns out_prims[out_offsets[i] .. out_offsets[i + 1]], out_offsets has
+// count + 1 entries. Returns the total; when it is over capacity only the offsets are written.
+u64 query_within(const render_scene_t* rs, const vec3_t* points, u64 count, real_t radius, u32* out_prims, u64 capacity,
+				 u64* out_offsets);
+
+// :scheduler
+// Several jobs in one process, one tile at a time, so a job is preempted
+// between its tiles and never loses one. The next tile goes to:
+//   - the highest priority with tiles left, batch work just waits below
+//   - within it, jobs that would miss their deadline at the rate they render,
+//     earliest deadline first
+//   - then a weighted fair share of render time: each tile's seconds are
+//     charged to its job as seconds / weight and the lowest total goes next
+#define SCHED_DEADLINE_MARGIN 2	 // remaining time estimates are doubled before they are compared
+
+typedef struct {
+	u32 priority;  // higher first
+	u32 weight;	   // of the share among its priority, 0 counts as 1
+	f64 deadline;  // time_now() the image is wanted by, 0 for none
+} sched_params_t;
+
+typedef struct {
+	u64			   id;
+	render_job_t*  job;
+	sched_params_t params;
+
+	f64	 vtime;	 // seconds rendered over weight
+	f64	 submitted, started, finished;	// time_now(), 0 until it happens
+	f64	 busy;	// seconds spent on its tiles
+	u64	 tiles_done, tiles_total;
+	bool done;
+} sched_job_t;
+
+typedef struct {
+	darr_of(sched_job_t) jobs;	// finished ones stay, for their stats, until removed
+	u64 next_id;
+
+	u64 tiles_done;
+	f64 busy;
+} scheduler_t;
+
+typedef struct {
+	u64 jobs_queued, tiles_queued;	// with tiles left
+	u64 tiles_done;
+	f64 busy;
+} sched_stats_t;
+
+scheduler_t scheduler_create(context_t ctx);
+void		scheduler_destroy(scheduler_t* s);
+// begins a run of job into img, both must outlive its entry; returns the entry's id, never 0
+u64	 scheduler_submit(scheduler_t* s, render_job_t* job, image_t* img, sched_params_t params);
+void scheduler_remove(scheduler_t* s, u64 id);
+// null once removed
+const sched_job_t* scheduler_job(const scheduler_t* s, u64 id);
+
+// renders one tile of the job that goes next, returns its id or 0 when no job has tiles left
+u64 scheduler_step(scheduler_t* s);
+
+sched_stats_t scheduler_stats(const scheduler_t* s);
+// tiles per second since the job started, the share of the time it actually gets
+f64 sched_job_throughput(const sched_job_t* j);
+
+// :server
+// Scenes stay loaded, with their accelerators, between the requests clients
+// send over a unix stream socket. Both ends are on the same machine, so
+// everything is in host layout:
+//   client  server_request_t, then path_len bytes of the scene's path
+//   server  SERVER_IMAGE with the size in tile.w and tile.h, then a
+//           SERVER_TILE and its w * h colors row by row as each tile is
+//           finished, then SERVER_DONE with the error
+// A connection sends any number of requests one after the other.
+#define SERVER_MAGIC 0x56535452u  // "RTSV"
+#define SERVER_MAX_PATH 4096
+#define SERVER_BACKLOG 16
+
+typedef struct {
+	u32 magic;
+	u32 mode;			// render_mode_t
+	u64 width, height;	// 0 keeps the scene's
+	u32 samples;		// 0 keeps the scene's
+	i32 bounces;		// negative keeps the scene's
+	u32 path_len;
+	u32 _pad;
+} server_request_t;
+
+typedef enum {
+	SERVER_IMAGE,
+	SERVER_TILE,
+	SERVER_DONE,
+} server_reply_type_t;
+
+typedef struct {
+	u32			  type;	  // server_reply_type_t
+	u32			  error;  // error_t, for SERVER_DONE
+	render_tile_t tile;
+} server_reply_t;
+
+typedef struct {
+	char*		   path;
+	i64			   mtime;  // of the file when it was loaded, in ns
+	render_scene_t rs;
+	render_job_t   job;	 // reused by every request for the scene, with its scratch
+} server_scene_t;
+
+typedef struct {
+	int listen_fd;
+	darr_of(server_scene_t*) scenes;  // jobs point at their scene, so each one stays where it was allocated
+
+	u64 requests, scene_loads;
+
+	allocator_t _allocator;
+} server_t;
+
+error_t server_create(context_t ctx, const char* socket_path, server_t* out);
+void	server_destroy(server_t* server);
+// accepts one client and serves its requests until it hangs up
+error_t server_serve_one(server_t* server);
+
+error_t client_connect(const char* socket_path, int* out_fd);
+// sends request, magic and path_len are filled in, and receives the image into a new *out; on_tile runs after
+// every tile that arrives
+error_t client_render(context_t ctx, int fd, server_request_t request, const char* scene_path, image_t** out,
+					  render_progress_t on_tile, void* user);
+
+// :bvh_cache
+// On disk layout, every offset is relative to the start of the file:
+//   bvh_cache_header_t | nodes | prims | prim ids, each 64 byte aligned
+#define BVH_CACHE_MAGIC 0x48564254414f4d52u	 // "RMOATBVH"
+#define BVH_CACHE_VERSION 2
+
+typedef struct {
+	u64 magic;
+	u32 version;
+	u32 endian;	 // 0x01020304 as written by the host
+	u32 node_size, prim_size;
+	u64 key;  // hash of the scene the structure was built from
+
+	u64 node_offset, node_count;
+	u64 prim_offset, prim_count;
+	u64 id_offset;
+} bvh_cache_header_t;
+
+// node and primitive layouts differ per build, each gets its own cache file
+#ifdef MSK_F32
+#define BVH_CACHE_REAL "f32"
+#else
+#define BVH_CACHE_REAL "f64"
+#endif
+#ifdef MSK_SIMD
+#define BVH_CACHE_LAYOUT BVH_CACHE_REAL ".simd"
+#else
+#define BVH_CACHE_LAYOUT BVH_CACHE_REAL
+#endif
+
+error_t bvh_cache_write(const bvh_t* bvh, u64 key, int fd);
+error_t bvh_cache_load(const char* path, u64 key, bvh_t* out);
+
+#endif	// RT_H
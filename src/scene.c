@@ -0,0 +1,243 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "rt.h"
+
+// :scene
+// Tokens are slices of the mapping, nothing is copied or terminated; the same
+// one character at a time walk as the vecmath lexer in nob.c, but a line is
+// the unit of a statement so newlines are tokens of their own.
+typedef struct {
+	const u8* ptr;
+	const u8* end;
+	u64		  line;
+} scene_lexer_t;
+
+typedef struct {
+	const u8* data;
+	u64		  len;
+} scene_token_t;
+
+static bool scene_is_space(u8 c) {
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+// skips blanks and comments, stops at the end of the line
+static void scene_skip_blank(scene_lexer_t* lx) {
+	while (lx->ptr < lx->end && scene_is_space(*lx->ptr)) {
+		lx->ptr++;
+	}
+	if (lx->ptr < lx->end && *lx->ptr == '#') {
+		while (lx->ptr < lx->end && *lx->ptr != '\n') {
+			lx->ptr++;
+		}
+	}
+}
+
+// the next word of the current line, empty once the line is done
+static scene_token_t scene_next_word(scene_lexer_t* lx) {
+	scene_skip_blank(lx);
+
+	scene_token_t token = {.data = lx->ptr};
+	while (lx->ptr < lx->end && *lx->ptr != '\n' && *lx->ptr != '#' && !scene_is_space(*lx->ptr)) {
+		lx->ptr++;
+	}
+	token.len = lx->ptr - token.data;
+	return token;
+}
+
+// past the newline, false at the end of the file
+static bool scene_next_line(scene_lexer_t* lx) {
+	while (lx->ptr < lx->end && *lx->ptr != '\n') {
+		lx->ptr++;
+	}
+	if (lx->ptr == lx->end) {
+		return false;
+	}
+	lx->ptr++;
+	lx->line++;
+	return true;
+}
+
+static bool scene_token_is(scene_token_t token, const char* word) {
+	u64 len = strlen(word);
+	return token.len == len && memcmp(token.data, word, len) == 0;
+}
+
+// Decimal numbers with at most 19 significant digits and a power of ten up to
+// 1e22 are a single correctly rounded mul or div of two exact doubles, which
+// is every number a scene is usually written with. Anything else goes through
+// strtod on a terminated copy of the token.
+static bool scene_parse_number(scene_token_t token, f64* out) {
+	static const f64 pow10[] = {1e0,  1e1,	1e2,  1e3,	1e4,  1e5,	1e6,  1e7,	1e8,  1e9,	1e10, 1e11,
+								1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+	const u8* p = token.data;
+	const u8* end = token.data + token.len;
+
+	bool negative = p < end && *p == '-';
+	if (p < end && (*p == '-' || *p == '+')) {
+		p++;
+	}
+
+	u64 mantissa = 0;
+	i64 exponent = 0;
+	u32 digits = 0;
+	for (; p < end && *p >= '0' && *p <= '9'; p++, digits++) {
+		mantissa = mantissa * 10 + (*p - '0');
+	}
+	if (p < end && *p == '.') {
+		for (p++; p < end && *p >= '0' && *p <= '9'; p++, digits++) {
+			mantissa = mantissa * 10 + (*p - '0');
+			exponent--;
+		}
+	}
+
+	bool fast = digits > 0 && digits <= 19 && mantissa < (1ull << 53);
+	if (p < end && (*p == 'e' || *p == 'E')) {
+		p++;
+		bool negative_exponent = p < end && *p == '-';
+		if (p < end && (*p == '-' || *p == '+')) {
+			p++;
+		}
+
+		i64 e = 0;
+		if (p == end) {
+			fast = false;
+		}
+		for (; p < end && *p >= '0' && *p <= '9'; p++) {
+			e = e < 10000 ? e * 10 + (*p - '0') : e;
+		}
+		exponent += negative_exponent ? -e : e;
+	}
+
+	if (fast && p == end && exponent >= -22 && exponent <= 22) {
+		f64 value = exponent < 0 ? mantissa / pow10[-exponent] : mantissa * pow10[exponent];
+		*out = negative ? -value : value;
+		return true;
+	}
+
+	char buffer[64];
+	if (token.len == 0 || token.len >= sizeof(buffer)) {
+		return false;
+	}
+	memcpy(buffer, token.data, token.len);
+	buffer[token.len] = '\0';
+
+	char* parsed = null;
+	*out = strtod(buffer, &parsed);
+
+	// nan, inf and anything too large for a double; by the exponent bits, -Ofast assumes isfinite is always true
+	u64 bits;
+	memcpy(&bits, out, sizeof(bits));
+	return *parsed == '\0' && (bits >> 52 & 0x7ff) != 0x7ff;
+}
+
+static bool scene_next_number(scene_lexer_t* lx, f64* out) {
+	return scene_parse_number(scene_next_word(lx), out);
+}
+
+// whole numbers within [min, max]
+static bool scene_next_count(scene_lexer_t* lx, f64 min, f64 max, u64* out) {
+	f64 value;
+	if (!scene_next_number(lx, &value) || value < min || value > max || value != (u64)value) {
+		return false;
+	}
+	*out = value;
+	return true;
+}
+
+static bool scene_next_vec3(scene_lexer_t* lx, vec3_t* out) {
+	f64 x, y, z;
+	if (!scene_next_number(lx, &x) || !scene_next_number(lx, &y) || !scene_next_number(lx, &z)) {
+		return false;
+	}
+	*out = vec3(x, y, z);
+	return true;
+}
+
+scene_t scene_default(context_t ctx) {
+	return (scene_t){
+		.camera = {.center = vec3(0, 0, 1), .focal_length = 2, .viewport_height = 2},
+		.width = 256,
+		.height = 144,
+		.samples = 20,
+		.bounces = 100,
+		.prims = {.allocator = ctx.allocator},
+	};
+}
+
+error_t scene_parse(context_t ctx, const u8* data, u64 size, scene_t* out) {
+	*out = scene_default(ctx);
+
+	// a statement per line at most, one allocation up front instead of a doubling per million spheres
+	u64 lines = 1;
+	for (const u8* p = data; (p = memchr(p, '\n', data + size - p)) != null; p++) {
+		lines++;
+	}
+	out->prims.items = alloc(ctx, lines * sizeof(hittable_t));
+	out->prims.cap = lines;
+
+	scene_lexer_t lx = {.ptr = data, .end = data + size, .line = 1};
+	do {
+		scene_token_t keyword = scene_next_word(&lx);
+		bool		  ok = true;
+		u64			  value = 0;
+
+		if (keyword.len == 0) {
+			continue;
+		} else if (scene_token_is(keyword, "sphere")) {
+			sphere_t s = {.type = SPHERE};
+			f64		 radius = 0;
+			ok = scene_next_vec3(&lx, &s.center) && scene_next_number(&lx, &radius) && radius > 0;
+			s.radius = radius;
+			out->prims.items[out->prims.count++].sphere = s;
+		} else if (scene_token_is(keyword, "camera")) {
+			f64 focal_length = 0, viewport_height = 0;
+			ok = scene_next_vec3(&lx, &out->camera.center) && scene_next_number(&lx, &focal_length) &&
+				 scene_next_number(&lx, &viewport_height) && focal_length > 0 && viewport_height > 0;
+			out->camera.focal_length = focal_length;
+			out->camera.viewport_height = viewport_height;
+		} else if (scene_token_is(keyword, "image")) {
+			ok = scene_next_count(&lx, 1, SCENE_MAX_IMAGE_SIZE, &out->width) &&
+				 scene_next_count(&lx, 1, SCENE_MAX_IMAGE_SIZE, &out->height);
+		} else if (scene_token_is(keyword, "samples")) {
+			ok = scene_next_count(&lx, 1, SCENE_MAX_SAMPLES, &value);
+			out->samples = value;
+		} else if (scene_token_is(keyword, "bounces")) {
+			ok = scene_next_count(&lx, 0, SCENE_MAX_BOUNCES, &value);
+			out->bounces = value;
+		} else {
+			out->error_line = lx.line;
+			scene_destroy(out);
+			return SCENE_UNKNOWN_KEYWORD;
+		}
+
+		// a statement takes the whole line, anything left over is as wrong as something missing
+		if (!ok || scene_next_word(&lx).len != 0) {
+			out->error_line = lx.line;
+			scene_destroy(out);
+			return SCENE_SYNTAX_ERROR;
+		}
+	} while (scene_next_line(&lx));
+
+	return NO_ERROR;
+}
+
+error_t scene_load(context_t ctx, const char* path, scene_t* out) {
+	mapped_file_t file;
+	error_t		  err;
+	// the parser reads every byte once, front to back
+	try (err = file_map_populate(path, &file)) or_return err;
+
+	err = scene_parse(ctx, file.data, file.size, out);
+	file_unmap(&file);
+	return err;
+}
+
+void scene_destroy(scene_t* scene) {
+	u64 error_line = scene->error_line;
+	darr_free(scene->prims);
+	*scene = (scene_t){.error_line = error_line};
+}
@@ -0,0 +1,143 @@
+#include <unistd.h>
+
+#include "rt.h"
+
+// :scheduler
+scheduler_t scheduler_create(context_t ctx) {
+	return (scheduler_t){.jobs = {.allocator = ctx.allocator}, .next_id = 1};
+}
+
+void scheduler_destroy(scheduler_t* s) {
+	darr_free(s->jobs);
+	*s = (scheduler_t){0};
+}
+
+static sched_job_t* scheduler_find(scheduler_t* s, u64 id) {
+	for (u64 i = 0; i < s->jobs.count; i++) {
+		if (s->jobs.items[i].id == id) {
+			return &s->jobs.items[i];
+		}
+	}
+	return null;
+}
+
+const sched_job_t* scheduler_job(const scheduler_t* s, u64 id) {
+	return scheduler_find((scheduler_t*)s, id);
+}
+
+u64 scheduler_submit(scheduler_t* s, render_job_t* job, image_t* img, sched_params_t params) {
+	render_job_begin(job, img);
+
+	// joins at the front of its priority's virtual clock, neither owed the time it
+	// wasn't queued for nor behind the jobs already sharing
+	f64 vtime = -1;
+	for (u64 i = 0; i < s->jobs.count; i++) {
+		const sched_job_t* other = &s->jobs.items[i];
+		if (!other->done && other->params.priority == params.priority && (vtime < 0 || other->vtime < vtime)) {
+			vtime = other->vtime;
+		}
+	}
+
+	sched_job_t entry = {
+		.id = s->next_id++,
+		.job = job,
+		.params = params,
+		.vtime = vtime < 0 ? 0 : vtime,
+		.submitted = time_now(),
+		.tiles_total = job->_next.count,
+	};
+	entry.params.weight = entry.params.weight == 0 ? 1 : entry.params.weight;
+	darr_append(&s->jobs, entry);
+	return entry.id;
+}
+
+void scheduler_remove(scheduler_t* s, u64 id) {
+	for (u64 i = 0; i < s->jobs.count; i++) {
+		if (s->jobs.items[i].id == id) {
+			s->jobs.items[i] = s->jobs.items[--s->jobs.count];
+			return;
+		}
+	}
+}
+
+// time its remaining tiles take at the rate it has rendered so far, or at everyone's before its first
+static f64 scheduler_remaining(const scheduler_t* s, const sched_job_t* j) {
+	f64 per_tile = j->tiles_done != 0 ? j->busy / j->tiles_done : s->tiles_done != 0 ? s->busy / s->tiles_done : 0;
+	return (j->tiles_total - j->tiles_done) * per_tile;
+}
+
+// true when a runs before b
+static bool scheduler_before(const scheduler_t* s, const sched_job_t* a, const sched_job_t* b, f64 now) {
+	if (a->params.priority != b->params.priority) {
+		return a->params.priority > b->params.priority;
+	}
+
+	bool a_late = a->params.deadline != 0 && now + SCHED_DEADLINE_MARGIN * scheduler_remaining(s, a) >= a->params.deadline;
+	bool b_late = b->params.deadline != 0 && now + SCHED_DEADLINE_MARGIN * scheduler_remaining(s, b) >= b->params.deadline;
+	if (a_late != b_late) {
+		return a_late;
+	}
+	if (a_late) {
+		return a->params.deadline < b->params.deadline;
+	}
+
+	// ties keep submission order
+	return a->vtime != b->vtime ? a->vtime < b->vtime : a->id < b->id;
+}
+
+u64 scheduler_step(scheduler_t* s) {
+	f64			 now = time_now();
+	sched_job_t* next = null;
+	for (u64 i = 0; i < s->jobs.count; i++) {
+		sched_job_t* j = &s->jobs.items[i];
+		if (!j->done && (next == null || scheduler_before(s, j, next, now))) {
+			next = j;
+		}
+	}
+	if (next == null) {
+		return 0;
+	}
+
+	// the job is looked up again after the tile, on_tile may submit or remove others
+	u64 id = next->id;
+	if (next->started == 0) {
+		next->started = now;
+	}
+	render_job_t* job = next->job;
+
+	bool more = render_job_step(job);
+	f64	 end = time_now();
+
+	s->busy += end - now;
+	s->tiles_done++;
+
+	sched_job_t* j = scheduler_find(s, id);
+	if (j == null) {
+		return id;
+	}
+	j->busy += end - now;
+	j->tiles_done = job->_next.index;
+	j->vtime += (end - now) / j->params.weight;
+	if (!more) {
+		j->done = true;
+		j->finished = end;
+	}
+	return id;
+}
+
+sched_stats_t scheduler_stats(const scheduler_t* s) {
+	sched_stats_t stats = {.tiles_done = s->tiles_done, .busy = s->busy};
+	for (u64 i = 0; i < s->jobs.count; i++) {
+		const sched_job_t* j = &s->jobs.items[i];
+		if (!j->done) {
+			stats.jobs_queued++;
+			stats.tiles_queued += j->tiles_total - j->tiles_done;
+		}
+	}
+	return stats;
+}
+
+f64 sched_job_throughput(const sched_job_t* j) {
+	f64 end = j->done ? j->finished : time_now();
+	return j->started != 0 && end > j->started ? j->tiles_done / (end - j->started) : 0;
+}
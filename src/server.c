@@ -0,0 +1,295 @@
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "rt.h"
+
+// :server
+// a client that hangs up mid render must not take the server down with SIGPIPE
+static error_t server_send_all(int fd, const void* data, u64 len) {
+	const u8* bytes = data;
+	while (len > 0) {
+		ssize_t sent = send(fd, bytes, len, MSG_NOSIGNAL);
+		try sent <= 0 or_return WRITE_ERROR;
+		bytes += sent;
+		len -= sent;
+	}
+	return NO_ERROR;
+}
+
+static error_t server_address(const char* socket_path, struct sockaddr_un* out) {
+	*out = (struct sockaddr_un){.sun_family = AF_UNIX};
+	try strlen(socket_path) >= sizeof(out->sun_path) or_return SOCKET_ERROR;
+	strcpy(out->sun_path, socket_path);
+	return NO_ERROR;
+}
+
+error_t server_create(context_t ctx, const char* socket_path, server_t* out) {
+	struct sockaddr_un addr;
+	error_t			   err;
+	try (err = server_address(socket_path, &addr)) or_return err;
+
+	const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	try fd < 0 or_return SOCKET_ERROR;
+
+	// whatever a previous server left behind
+	unlink(socket_path);
+	if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, SERVER_BACKLOG) != 0) {
+		close(fd);
+		return SOCKET_ERROR;
+	}
+
+	*out = (server_t){
+		.listen_fd = fd,
+		.scenes = {.allocator = ctx.allocator},
+		._allocator = ctx.allocator,
+	};
+	return NO_ERROR;
+}
+
+void server_destroy(server_t* server) {
+	for (u64 i = 0; i < server->scenes.count; i++) {
+		server_scene_t* s = server->scenes.items[i];
+		render_job_destroy(&s->job);
+		render_scene_destroy(&s->rs);
+		allocator_dealloc(server->_allocator, s->path);
+		allocator_dealloc(server->_allocator, s);
+	}
+	darr_free(server->scenes);
+	close(server->listen_fd);
+	*server = (server_t){0};
+}
+
+// the resident scene for path, loaded again only when the file changed since
+static error_t server_scene(server_t* server, const char* path, server_scene_t** out) {
+	struct stat st;
+	try stat(path, &st) != 0 or_return FILE_OPEN_ERROR;
+	i64 mtime = st.st_mtim.tv_sec * 1000000000ll + st.st_mtim.tv_nsec;
+
+	server_scene_t* found = null;
+	for (u64 i = 0; i < server->scenes.count; i++) {
+		if (strcmp(server->scenes.items[i]->path, path) == 0) {
+			found = server->scenes.items[i];
+		}
+	}
+	if (found != null && found->mtime == mtime) {
+		*out = found;
+		return NO_ERROR;
+	}
+
+	context_t ctx = {.allocator = server->_allocator};
+	scene_t	  scene;
+	error_t	  err;
+	try (err = scene_load(ctx, path, &scene)) or_return err;
+	server->scene_loads++;
+
+	if (found == null) {
+		found = alloc(ctx, sizeof(server_scene_t));
+		*found = (server_scene_t){.path = alloc(ctx, strlen(path) + 1)};
+		strcpy(found->path, path);
+		darr_append(&server->scenes, found);
+	} else {
+		render_job_destroy(&found->job);
+		render_scene_destroy(&found->rs);
+	}
+
+	// resident, so there is no point in a bvh cache file
+	found->mtime = mtime;
+	found->rs = render_scene_create(ctx, scene, null);
+	found->job = render_job_create(ctx, &found->rs, RENDER_PACKETS);
+	*out = found;
+	return NO_ERROR;
+}
+
+typedef struct {
+	int		 fd;
+	error_t	 err;
+	color_t* pixels;
+	bool*	 stop;
+	u64		 y, tiles_before, tile_count;  // of the band, in the whole image
+} server_stream_t;
+
+// every finished tile goes out right away, the client sees the image fill in
+static void server_send_tile(void* user, const image_t* band, render_tile_t tile) {
+	server_stream_t* stream = user;
+	for (u64 y = 0; y < tile.h; y++) {
+		memcpy(stream->pixels + y * tile.w, band->data + (tile.y + y) * band->w + tile.x, tile.w * sizeof(color_t));
+	}
+
+	// the job only knows the band, the client gets the tile's place in the image
+	tile.y += stream->y;
+	tile.index += stream->tiles_before;
+	tile.count = stream->tile_count;
+
+	server_reply_t reply = {.type = SERVER_TILE, .tile = tile};
+	if ((stream->err = server_send_all(stream->fd, &reply, sizeof(reply))) == NO_ERROR) {
+		stream->err = server_send_all(stream->fd, stream->pixels, tile.w * tile.h * sizeof(color_t));
+	}
+	// nobody left to send the rest to
+	*stream->stop = stream->err != NO_ERROR;
+}
+
+// Rendered a row of tiles at a time, like render_job_stream; every tile is sent as
+// soon as it is done, so the server never needs the whole image, whatever its size.
+static error_t server_render(server_t* server, int fd, server_request_t request, const char* path) {
+	server_scene_t* s;
+	error_t			err;
+	try (err = server_scene(server, path, &s)) or_return err;
+
+	render_job_t* job = &s->job;
+	job->mode = request.mode;
+	job->camera = s->rs.scene.camera;
+	job->samples = request.samples != 0 ? request.samples : s->rs.scene.samples;
+	job->bounces = request.bounces >= 0 ? request.bounces : s->rs.scene.bounces;
+
+	const u64 width = request.width != 0 ? request.width : s->rs.scene.width;
+	const u64 height = request.height != 0 ? request.height : s->rs.scene.height;
+
+	context_t		ctx = {.allocator = server->_allocator};
+	image_t*		band = image_create(ctx, width, job->tile_h);
+	server_stream_t stream = {
+		.fd = fd,
+		.pixels = alloc(ctx, job->tile_w * job->tile_h * sizeof(color_t)),
+		.stop = &job->stop,
+		.tile_count = (width + job->tile_w - 1) / job->tile_w * ((height + job->tile_h - 1) / job->tile_h),
+	};
+	if (band == null || stream.pixels == null) {
+		dealloc(ctx, stream.pixels);
+		if (band != null) {
+			image_destroy(band);
+		}
+		return ALLOC_ERROR;
+	}
+	job->on_tile = server_send_tile;
+	job->user = &stream;
+
+	// the size first, so the client can allocate the image before any tile arrives
+	server_reply_t start = {.type = SERVER_IMAGE, .tile = {.w = width, .h = height}};
+	stream.err = server_send_all(fd, &start, sizeof(start));
+	for (u64 y = 0; y < height && stream.err == NO_ERROR && !job->stop; y += job->tile_h) {
+		// the last band is only what is left of the image
+		band->h = height - y < job->tile_h ? height - y : job->tile_h;
+		stream.y = y;
+		render_job_begin_rows(job, band, height, y);
+		while (render_job_step(job)) {
+		}
+		stream.tiles_before += job->_next.count;
+	}
+
+	dealloc(ctx, stream.pixels);
+	image_destroy(band);
+	return stream.err;
+}
+
+error_t server_serve_one(server_t* server) {
+	const int fd = accept(server->listen_fd, null, null);
+	try fd < 0 or_return SOCKET_ERROR;
+
+	error_t err = NO_ERROR;
+	while (true) {
+		server_request_t request;
+		char			 path[SERVER_MAX_PATH + 1];
+
+		// a clean hang up between requests ends the connection
+		if (file_read_all(fd, &request, sizeof(request)) != NO_ERROR) {
+			break;
+		}
+		if (request.magic != SERVER_MAGIC || request.mode > RENDER_TILES || request.path_len > SERVER_MAX_PATH ||
+			request.samples > SCENE_MAX_SAMPLES || request.bounces > SCENE_MAX_BOUNCES ||
+			request.width > SCENE_MAX_IMAGE_SIZE || request.height > SCENE_MAX_IMAGE_SIZE) {
+			server_reply_t done = {.type = SERVER_DONE, .error = SERVER_BAD_REQUEST};
+			server_send_all(fd, &done, sizeof(done));
+			err = SERVER_BAD_REQUEST;
+			break;
+		}
+		if ((err = file_read_all(fd, path, request.path_len)) != NO_ERROR) {
+			break;
+		}
+		path[request.path_len] = '\0';
+
+		server->requests++;
+		err = server_render(server, fd, request, path);
+
+		// a write that failed means the client is gone, anything else it is told about
+		server_reply_t done = {.type = SERVER_DONE, .error = err};
+		if (err == WRITE_ERROR || server_send_all(fd, &done, sizeof(done)) != NO_ERROR) {
+			break;
+		}
+	}
+
+	close(fd);
+	return err;
+}
+
+// :client
+error_t client_connect(const char* socket_path, int* out_fd) {
+	struct sockaddr_un addr;
+	error_t			   err;
+	try (err = server_address(socket_path, &addr)) or_return err;
+
+	const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	try fd < 0 or_return SOCKET_ERROR;
+	if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+		close(fd);
+		return SOCKET_ERROR;
+	}
+
+	*out_fd = fd;
+	return NO_ERROR;
+}
+
+error_t client_render(context_t ctx, int fd, server_request_t request, const char* scene_path, image_t** out,
+					  render_progress_t on_tile, void* user) {
+	*out = null;
+	request.magic = SERVER_MAGIC;
+	request.path_len = strlen(scene_path);
+
+	error_t err;
+	try (err = file_write_all(fd, &request, sizeof(request))) or_return err;
+	try (err = file_write_all(fd, scene_path, request.path_len)) or_return err;
+
+	while (true) {
+		server_reply_t reply;
+		if ((err = file_read_all(fd, &reply, sizeof(reply))) != NO_ERROR) {
+			break;
+		}
+
+		if (reply.type == SERVER_DONE) {
+			err = reply.error;
+			break;
+		}
+		if (reply.type == SERVER_IMAGE && *out == null) {
+			*out = image_create(ctx, reply.tile.w, reply.tile.h);
+			if (*out == null) {
+				err = ALLOC_ERROR;
+				break;
+			}
+			continue;
+		}
+
+		// tiles only ever come after the image and inside it
+		render_tile_t tile = reply.tile;
+		if (reply.type != SERVER_TILE || *out == null || tile.x + tile.w > (*out)->w || tile.y + tile.h > (*out)->h) {
+			err = SERVER_BAD_REQUEST;
+			break;
+		}
+		for (u64 y = 0; y < tile.h && err == NO_ERROR; y++) {
+			err = file_read_all(fd, (*out)->data + (tile.y + y) * (*out)->w + tile.x, tile.w * sizeof(color_t));
+		}
+		if (err != NO_ERROR) {
+			break;
+		}
+		if (on_tile != null) {
+			on_tile(user, *out, tile);
+		}
+	}
+
+	if (err != NO_ERROR && *out != null) {
+		image_destroy(*out);
+		*out = null;
+	}
+	return err;
+}
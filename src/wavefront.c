@@ -0,0 +1,203 @@
+#include <unistd.h>
+
+#include "rt.h"
+
+// :wavefront
+static ray_queue_t ray_queue_create(context_t ctx, u64 capacity) {
+	return (ray_queue_t){
+		.ox = alloc(ctx, capacity * sizeof(real_t)),
+		.oy = alloc(ctx, capacity * sizeof(real_t)),
+		.oz = alloc(ctx, capacity * sizeof(real_t)),
+		.dx = alloc(ctx, capacity * sizeof(real_t)),
+		.dy = alloc(ctx, capacity * sizeof(real_t)),
+		.dz = alloc(ctx, capacity * sizeof(real_t)),
+		.weight = alloc(ctx, capacity * sizeof(real_t)),
+		.pixel = alloc(ctx, capacity * sizeof(u32)),
+	};
+}
+
+static void ray_queue_destroy(allocator_t allocator, ray_queue_t* q) {
+	allocator_dealloc(allocator, q->ox);
+	allocator_dealloc(allocator, q->oy);
+	allocator_dealloc(allocator, q->oz);
+	allocator_dealloc(allocator, q->dx);
+	allocator_dealloc(allocator, q->dy);
+	allocator_dealloc(allocator, q->dz);
+	allocator_dealloc(allocator, q->weight);
+	allocator_dealloc(allocator, q->pixel);
+	*q = (ray_queue_t){0};
+}
+
+static inline void ray_queue_set(ray_queue_t* q, u64 i, ray_t r, real_t weight, u32 pixel) {
+	q->ox[i] = r.origin.x, q->oy[i] = r.origin.y, q->oz[i] = r.origin.z;
+	q->dx[i] = r.direction.x, q->dy[i] = r.direction.y, q->dz[i] = r.direction.z;
+	q->weight[i] = weight;
+	q->pixel[i] = pixel;
+}
+
+static inline ray_t ray_queue_get(const ray_queue_t* q, u64 i) {
+	return (ray_t){
+		.origin = vec3(q->ox[i], q->oy[i], q->oz[i]),
+		.direction = vec3(q->dx[i], q->dy[i], q->dz[i]),
+	};
+}
+
+wavefront_t wavefront_create(context_t ctx, u64 capacity) {
+	return (wavefront_t){
+		.queues = {ray_queue_create(ctx, capacity), ray_queue_create(ctx, capacity)},
+		.hits = alloc(ctx, capacity * sizeof(hit_t)),
+		.capacity = capacity,
+		.sorted = ray_queue_create(ctx, capacity),
+		.keys = alloc(ctx, 2 * capacity * sizeof(u32)),
+		.order = alloc(ctx, 2 * capacity * sizeof(u32)),
+		._allocator = ctx.allocator,
+	};
+}
+
+void wavefront_destroy(wavefront_t* wf) {
+	ray_queue_destroy(wf->_allocator, &wf->queues[0]);
+	ray_queue_destroy(wf->_allocator, &wf->queues[1]);
+	ray_queue_destroy(wf->_allocator, &wf->sorted);
+	allocator_dealloc(wf->_allocator, wf->hits);
+	allocator_dealloc(wf->_allocator, wf->keys);
+	allocator_dealloc(wf->_allocator, wf->order);
+	*wf = (wavefront_t){0};
+}
+
+// spreads the low 10 bits of v so there are two zero bits between each of them
+static u32 morton_spread(u32 v) {
+	v &= 0x3ff;
+	v = (v | (v << 16)) & 0x030000ff;
+	v = (v | (v << 8)) & 0x0300f00f;
+	v = (v | (v << 4)) & 0x030c30c3;
+	v = (v | (v << 2)) & 0x09249249;
+	return v;
+}
+
+static u32 morton_quantize(real_t v, real_t min, real_t max) {
+	const u32 cells = 1u << RAY_SORT_BITS;
+
+	real_t c = (v - min) / (max - min) * cells;
+	return c < 0 ? 0 : c >= cells ? cells - 1 : (u32)c;
+}
+
+u32 ray_sort_key(ray_t r, aabb_t bounds) {
+	u32 octant = (r.direction.x < 0) << 2 | (r.direction.y < 0) << 1 | (r.direction.z < 0);
+
+	vec3_t extent = vec3_max(vec3_sub(bounds.max, bounds.min), vec3(1e-9, 1e-9, 1e-9));
+	bounds.max = vec3_add(bounds.min, extent);
+
+	u32 x = morton_quantize(r.origin.x, bounds.min.x, bounds.max.x);
+	u32 y = morton_quantize(r.origin.y, bounds.min.y, bounds.max.y);
+	u32 z = morton_quantize(r.origin.z, bounds.min.z, bounds.max.z);
+	return octant << (3 * RAY_SORT_BITS) | morton_spread(x) << 2 | morton_spread(y) << 1 | morton_spread(z);
+}
+
+// rays going the same way from nearby origins end up next to each other, so
+// consecutive traversals touch the same nodes while they are still in cache
+static void wavefront_sort(wavefront_t* wf, ray_queue_t* q) {
+	f64 start = time_now();
+
+	aabb_t bounds = aabb_empty();
+	for (u64 i = 0; i < q->count; i++) {
+		bounds = aabb_grow(bounds, vec3(q->ox[i], q->oy[i], q->oz[i]));
+	}
+
+	u32* keys[2] = {wf->keys, wf->keys + wf->capacity};
+	u32* order[2] = {wf->order, wf->order + wf->capacity};
+	for (u64 i = 0; i < q->count; i++) {
+		keys[0][i] = ray_sort_key(ray_queue_get(q, i), bounds);
+		order[0][i] = i;
+	}
+
+	// lsd radix sort, a byte at a time; stable, so equal keys keep their queue order
+	const u32 key_bits = 3 * RAY_SORT_BITS + 3;
+	u32		  from = 0;
+	for (u32 shift = 0; shift < key_bits; shift += 8, from ^= 1) {
+		u64 offsets[257] = {0};
+		for (u64 i = 0; i < q->count; i++) {
+			offsets[((keys[from][i] >> shift) & 0xff) + 1]++;
+		}
+		for (u32 b = 0; b < 256; b++) {
+			offsets[b + 1] += offsets[b];
+		}
+		for (u64 i = 0; i < q->count; i++) {
+			u64 dst = offsets[(keys[from][i] >> shift) & 0xff]++;
+			keys[from ^ 1][dst] = keys[from][i];
+			order[from ^ 1][dst] = order[from][i];
+		}
+	}
+
+	for (u64 i = 0; i < q->count; i++) {
+		u32 src = order[from][i];
+		ray_queue_set(&wf->sorted, i, ray_queue_get(q, src), q->weight[src], q->pixel[src]);
+	}
+	wf->sorted.count = q->count;
+
+	ray_queue_t tmp = *q;
+	*q = wf->sorted;
+	wf->sorted = tmp;
+
+	wf->sort_seconds += time_now() - start;
+}
+
+// the only stage without shared state, so the only one split across threads
+KERNEL static void wavefront_intersect(const world_t* w, const ray_queue_t* q, hit_t* hits) {
+#pragma omp parallel for schedule(dynamic, 256)
+	for (u64 i = 0; i < q->count; i++) {
+		hits[i] = world_hit(w, ray_queue_get(q, i), RAY_MINT, RAY_MAXT);
+	}
+}
+
+// paths that escaped pick up the sky
+static void wavefront_shade(const ray_queue_t* q, const hit_t* hits, vec3_t* accum) {
+	for (u64 i = 0; i < q->count; i++) {
+		if (!hits[i].is_hit) {
+			vec3_t sky = sky_color(vec3(q->dx[i], q->dy[i], q->dz[i]));
+			vec3p_add(&accum[q->pixel[i]], vec3_mul(sky, q->weight[i]));
+		}
+	}
+}
+
+// paths that hit something bounce, written densely to the next queue
+static void wavefront_generate(const ray_queue_t* q, const hit_t* hits, ray_queue_t* next) {
+	u64 n = 0;
+	for (u64 i = 0; i < q->count; i++) {
+		if (hits[i].is_hit) {
+			ray_t bounce = {
+				.origin = ray_offset_origin(hits[i].point, hits[i].normal),
+				.direction = vec3_rand_hemisphere(hits[i].normal),
+			};
+			ray_queue_set(next, n++, bounce, q->weight[i] / 2, q->pixel[i]);
+		}
+	}
+	next->count = n;
+}
+
+void wavefront_render(wavefront_t* wf, const world_t* w, const ray_t* rays, const u32* pixels, u64 count,
+					  i32 max_bounces, vec3_t* accum) {
+	for (u64 start = 0; start < count; start += wf->capacity) {
+		ray_queue_t* current = &wf->queues[0];
+		ray_queue_t* next = &wf->queues[1];
+
+		current->count = count - start < wf->capacity ? count - start : wf->capacity;
+		for (u64 i = 0; i < current->count; i++) {
+			ray_queue_set(current, i, rays[start + i], 1, pixels[start + i]);
+		}
+
+		// every path in a queue is at the same depth
+		for (i32 depth = max_bounces; depth > 0 && current->count > 0; depth--) {
+			// camera rays already arrive in a coherent order
+			if (wf->reorder && depth != max_bounces) {
+				wavefront_sort(wf, current);
+			}
+			wavefront_intersect(w, current, wf->hits);
+			wavefront_shade(current, wf->hits, accum);
+			wavefront_generate(current, wf->hits, next);
+
+			ray_queue_t* tmp = current;
+			current = next;
+			next = tmp;
+		}
+	}
+}
@@ -0,0 +1,275 @@
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+#define FT_TEST_DEBUG
+#include "ft_test.h"
+
+#include "../src/rt.h"
+
+static f64 test_rand(f64 min, f64 max) {
+	return min + (max - min) * ((f64)rand() / RAND_MAX);
+}
+
+static hittable_view_t random_spheres(u64 count) {
+	hittable_view_t hs = {.items = calloc(count, sizeof(hittable_t)), .count = count};
+	for (u64 i = 0; i < count; i++) {
+		hs.items[i].sphere = (sphere_t){
+			.type = SPHERE,
+			.center = {test_rand(-10, 10), test_rand(-10, 10), test_rand(-10, 10)},
+			.radius = test_rand(0.05, 0.5),
+		};
+	}
+	return hs;
+}
+
+static ray_t random_ray() {
+	return (ray_t){
+		.origin = {test_rand(-12, 12), test_rand(-12, 12), test_rand(-12, 12)},
+		.direction = {test_rand(-1, 1), test_rand(-1, 1), test_rand(-1, 1)},
+	};
+}
+
+FT_TEST(bvh_matches_linear) {
+	srand(26);
+	context_t		ctx = context_default();
+	hittable_view_t hs = random_spheres(1000);
+	bvh_t			bvh = bvh_build(ctx, hs);
+
+	FT_EQ(ulong, bvh.prim_count, hs.count);
+
+	for (u64 i = 0; i < 2000; i++) {
+		ray_t r = random_ray();
+		hit_t expected = hit_many(hs, r, 0.0001, 100);
+		hit_t got = bvh_hit(&bvh, r, 0.0001, 100);
+
+		FT_EQ(int, got.is_hit, expected.is_hit);
+		if (expected.is_hit) {
+			FT_EQ(double, got.t, expected.t, .tol = 1e-9);
+		}
+
+		FT_EQ(int, occluded_many(hs, r, 0.0001, 100), expected.is_hit);
+		FT_EQ(int, bvh_occluded(&bvh, r, 0.0001, 100), expected.is_hit);
+	}
+
+	bvh_destroy(&bvh);
+	free(hs.items);
+}
+
+FT_TEST(bvh_stream_matches_single) {
+	srand(33);
+	context_t		ctx = context_default();
+	hittable_view_t hs = random_spheres(1000);
+	bvh_t			bvh = bvh_build(ctx, hs);
+
+	// not a multiple of the stream width, so lanes run dry at different times
+	const u64 count = 1001;
+	ray_t	  rays[count];
+	hit_t	  hits[count];
+	for (u64 i = 0; i < count; i++) {
+		rays[i] = random_ray();
+	}
+	bvh_hit_stream(&bvh, rays, count, 0.0001, 100, hits);
+
+	for (u64 i = 0; i < count; i++) {
+		hit_t expected = bvh_hit(&bvh, rays[i], 0.0001, 100);
+		FT_EQ(int, hits[i].is_hit, expected.is_hit);
+		if (expected.is_hit) {
+			FT_EQ(double, hits[i].t, expected.t, .tol = 1e-9);
+		}
+	}
+
+	bvh_destroy(&bvh);
+	free(hs.items);
+}
+
+FT_TEST(bvh_cache_roundtrip) {
+	srand(27);
+	context_t		ctx = context_default();
+	hittable_view_t hs = random_spheres(300);
+	bvh_t			bvh = bvh_build(ctx, hs);
+	u64				key = hittables_hash(hs);
+
+	char path[] = "/tmp/bvh_cache_XXXXXX";
+	int	 fd = mkstemp(path);
+	FT_EQ(cmp, bvh_cache_write(&bvh, key, fd), NO_ERROR);
+	close(fd);
+
+	bvh_t loaded;
+	FT_EQ(cmp, bvh_cache_load(path, key + 1, &loaded), CACHE_STALE);
+	FT_EQ(cmp, bvh_cache_load(path, key, &loaded), NO_ERROR);
+	FT_EQ(ulong, loaded.node_count, bvh.node_count);
+	FT_EQ(buffer, loaded.nodes, bvh.nodes, .size = bvh.node_count * sizeof(bvh_node_t));
+	FT_EQ(buffer, loaded.prims, bvh.prims, .size = bvh.prim_count * sizeof(hittable_t));
+	FT_EQ(buffer, loaded.prim_ids, bvh.prim_ids, .size = bvh.prim_count * sizeof(u32));
+
+	for (u64 i = 0; i < 200; i++) {
+		ray_t r = random_ray();
+		FT_EQ(double, bvh_hit(&loaded, r, 0.0001, 100).t, bvh_hit(&bvh, r, 0.0001, 100).t, .tol = 0);
+	}
+
+	bvh_destroy(&loaded);
+	bvh_destroy(&bvh);
+	unlink(path);
+	free(hs.items);
+}
+
+FT_TEST(bvh_cache_empty) {
+	context_t		ctx = context_default();
+	hittable_view_t hs = {0};
+	bvh_t			bvh = bvh_build(ctx, hs);
+	u64				key = hittables_hash(hs);
+	FT_EQ(ulong, bvh.node_count, 1);
+
+	char path[] = "/tmp/bvh_cache_XXXXXX";
+	int	 fd = mkstemp(path);
+	FT_EQ(cmp, bvh_cache_write(&bvh, key, fd), NO_ERROR);
+	close(fd);
+
+	bvh_t loaded;
+	FT_EQ(cmp, bvh_cache_load(path, key, &loaded), NO_ERROR);
+	FT_EQ(ulong, loaded.node_count, 1);
+	FT_EQ(ulong, loaded.prim_count, 0);
+	FT_EQ(int, bvh_hit(&loaded, random_ray(), 0.0001, 100).is_hit, false);
+
+	bvh_destroy(&loaded);
+	bvh_destroy(&bvh);
+	unlink(path);
+}
+
+static u32 bvh_test_depth(const bvh_t* bvh, u32 node) {
+	const bvh_node_t* n = &bvh->nodes[node];
+	if (n->count > 0) {
+		return 0;
+	}
+	u32 left = bvh_test_depth(bvh, node + 1);
+	u32 right = bvh_test_depth(bvh, n->offset);
+	return 1 + (left > right ? left : right);
+}
+
+FT_TEST(bvh_depth_bounded) {
+	// every split sah finds peels off one sphere, the tree would be as deep as the scene
+	context_t		ctx = context_default();
+	hittable_view_t hs = {.items = calloc(1000, sizeof(hittable_t)), .count = 1000};
+	f64				x = 1;
+	for (u64 i = 0; i < hs.count; i++, x *= 1.6) {
+		hs.items[i].sphere = (sphere_t){.type = SPHERE, .center = {x, 0, 0}, .radius = 0.25};
+	}
+	bvh_t bvh = bvh_build(ctx, hs);
+	FT_LE(ulong, bvh_test_depth(&bvh, 0), BVH_MAX_TREE_DEPTH);
+
+	x = 1;
+	for (u64 i = 0; i < 40; i++, x *= 1.6) {
+		ray_t r = {.origin = {x - 0.05, 0, 10}, .direction = {0.01, 0.02, -1}};
+		hit_t expected = hit_many(hs, r, 0.0001, 100);
+		hit_t got = bvh_hit(&bvh, r, 0.0001, 100);
+		FT_EQ(int, got.is_hit, true);
+		FT_EQ(double, got.t, expected.t, .tol = 1e-9);
+		FT_EQ(int, bvh_occluded(&bvh, r, 0.0001, 100), true);
+	}
+
+	bvh_destroy(&bvh);
+	free(hs.items);
+}
+
+FT_TEST(bvh_cache_rejects_corrupt) {
+	srand(29);
+	context_t		ctx = context_default();
+	hittable_view_t hs = random_spheres(100);
+	bvh_t			bvh = bvh_build(ctx, hs);
+	u64				key = hittables_hash(hs);
+
+	char path[] = "/tmp/bvh_cache_XXXXXX";
+	int	 fd = mkstemp(path);
+	FT_GE(int, fd, 0);
+	FT_EQ(cmp, bvh_cache_write(&bvh, key, fd), NO_ERROR);
+
+	// an inner node pointing back at the root, then a leaf past the primitives
+	bvh_cache_header_t header;
+	FT_EQ(long, pread(fd, &header, sizeof(header), 0), sizeof(header));
+	bvh_node_t root = bvh.nodes[0];
+	root.offset = 0;
+	FT_EQ(long, pwrite(fd, &root, sizeof(root), header.node_offset), sizeof(root));
+
+	bvh_t loaded;
+	FT_EQ(cmp, bvh_cache_load(path, key, &loaded), CACHE_CORRUPT);
+
+	u64 leaf = 0;
+	while (bvh.nodes[leaf].count == 0) {
+		leaf++;
+	}
+	bvh_node_t bad = bvh.nodes[leaf];
+	bad.offset = bvh.prim_count;
+	FT_EQ(long, pwrite(fd, &bvh.nodes[0], sizeof(root), header.node_offset), sizeof(root));
+	FT_EQ(long, pwrite(fd, &bad, sizeof(bad), header.node_offset + leaf * sizeof(bvh_node_t)), sizeof(bad));
+
+	// nodes past the root are only checked as they are reached, the bad leaf is skipped
+	FT_EQ(cmp, bvh_cache_load(path, key, &loaded), NO_ERROR);
+	for (u64 i = 0; i < 200; i++) {
+		ray_t r = random_ray();
+		u32	  prim;
+		bvh_hit_prim(&loaded, r, 0.0001, 100, &prim);
+		FT_EQ(int, prim == BVH_NO_PRIM || prim < bvh.prim_count, true);
+		bvh_occluded(&loaded, r, 0.0001, 100);
+	}
+	u32 within[100];
+	FT_LE(ulong, bvh_within(&loaded, (vec3_t){0}, 100, within, 100), bvh.prim_count - bad.count);
+	bvh_destroy(&loaded);
+
+	// sections that overlap
+	bvh_cache_header_t overlapping = header;
+	overlapping.prim_offset = header.node_offset;
+	FT_EQ(long, pwrite(fd, &overlapping, sizeof(overlapping), 0), sizeof(overlapping));
+	FT_EQ(cmp, bvh_cache_load(path, key, &loaded), CACHE_CORRUPT);
+
+	close(fd);
+	unlink(path);
+	bvh_destroy(&bvh);
+	free(hs.items);
+}
+
+FT_TEST(tlas_matches_flattened) {
+	srand(28);
+	context_t		ctx = context_default();
+	hittable_view_t cluster = random_spheres(20);
+	bvh_t			blas = bvh_build(ctx, cluster);
+
+	// every copy written out explicitly, as the scene would be without instancing
+	const u64		copies = 50;
+	instance_t		instances[copies];
+	hittable_view_t flat = {.items = calloc(copies * cluster.count, sizeof(hittable_t)), .count = copies * cluster.count};
+
+	for (u64 i = 0; i < copies; i++) {
+		vec3_t	 offset = vec3(test_rand(-20, 20), test_rand(-20, 20), test_rand(-20, 20));
+		f64		 scale = test_rand(0.5, 2);
+		affine_t to_world = affine_mul(affine_translate(offset), affine_scale(scale));
+
+		instances[i] = instance_create(to_world, 0);
+		for (u64 j = 0; j < cluster.count; j++) {
+			sphere_t s = cluster.items[j].sphere;
+			s.center = affine_point(to_world, s.center);
+			s.radius *= scale;
+			flat.items[i * cluster.count + j].sphere = s;
+		}
+	}
+
+	tlas_t tlas = tlas_build(ctx, (instance_view_t){instances, copies}, (bvh_view_t){&blas, 1});
+
+	for (u64 i = 0; i < 2000; i++) {
+		ray_t r = random_ray();
+		r.origin = vec3_mul(r.origin, 2);
+		hit_t expected = hit_many(flat, r, 0.0001, 100);
+		hit_t got = tlas_hit(&tlas, r, 0.0001, 100);
+
+		FT_EQ(int, got.is_hit, expected.is_hit);
+		if (expected.is_hit) {
+			FT_EQ(double, got.t, expected.t, .tol = 1e-6);
+			FT_EQ(double, vec3_dot(got.normal, expected.normal), 1, .tol = 1e-6);
+		}
+		FT_EQ(int, tlas_occluded(&tlas, r, 0.0001, 100), expected.is_hit);
+	}
+
+	tlas_destroy(&tlas);
+	bvh_destroy(&blas);
+	free(flat.items);
+	free(cluster.items);
+}
@@ -0,0 +1,52 @@
+#include <stdlib.h>
+#include <unistd.h>
+#define FT_TEST_DEBUG
+#include "ft_test.h"
+
+#include "../src/rt.h"
+
+// a 4 x 4 block of camera rays from above, aimed at a small square around (x, y) on the z = 0 plane
+static void block_at(f64 x, f64 y, ray_t* rays) {
+	for (u64 i = 0; i < 16; i++) {
+		rays[i] = (ray_t){{0, 0, 5}, {x + (i % 4) * 0.01, y + (i / 4) * 0.01, -5}};
+	}
+}
+
+FT_TEST(gbuffer_classifies_pixels) {
+	context_t  ctx = context_default();
+	hittable_t spheres[] = {
+		{.sphere = {SPHERE, {0, 0, 0}, 1}},
+		{.sphere = {SPHERE, {2, 0, 0}, 1}},
+	};
+	world_t world = {.accel = accel_build(ctx, ACCEL_BVH, (hittable_view_t){spheres, 2})};
+
+	ray_t rays[16];
+	hit_t got[16];
+
+	// nothing around, every sample is a miss without being traced
+	block_at(0, 5, rays);
+	gbuffer_pixel_t px = gbuffer_probe(&world, rays, 4, 4, 0.0001, 100);
+	FT_EQ(int, px.kind, GBUFFER_SKY);
+	gbuffer_hit_block(&world, px, rays, 4, 4, 0.0001, 100, got);
+	for (u64 i = 0; i < 16; i++) {
+		FT_EQ(int, got[i].is_hit, false);
+	}
+
+	// well inside the first sphere
+	block_at(0, 0, rays);
+	px = gbuffer_probe(&world, rays, 4, 4, 0.0001, 100);
+	FT_EQ(int, px.kind, GBUFFER_UNIFORM);
+	FT_EQ(double, spheres[0].sphere.center.x, world.accel.bvh.prims[px.prim].sphere.center.x, .tol = 0);
+	gbuffer_hit_block(&world, px, rays, 4, 4, 0.0001, 100, got);
+	for (u64 i = 0; i < 16; i++) {
+		hit_t expected = world_hit(&world, rays[i], 0.0001, 100);
+		FT_EQ(double, got[i].t, expected.t, .tol = 1e-9);
+	}
+
+	// straddling the point where the spheres touch
+	block_at(0.985, 0, rays);
+	px = gbuffer_probe(&world, rays, 4, 4, 0.0001, 100);
+	FT_EQ(int, px.kind, GBUFFER_MIXED);
+
+	accel_destroy(&world.accel);
+}
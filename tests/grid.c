@@ -0,0 +1,70 @@
+#include <stdlib.h>
+#include <unistd.h>
+#define FT_TEST_DEBUG
+#include "ft_test.h"
+
+#include "../src/rt.h"
+
+static f64 test_rand(f64 min, f64 max) {
+	return min + (max - min) * ((f64)rand() / RAND_MAX);
+}
+
+static hittable_view_t sphere_field(u64 count, f64 min_radius, f64 max_radius) {
+	hittable_view_t hs = {.items = calloc(count, sizeof(hittable_t)), .count = count};
+	for (u64 i = 0; i < count; i++) {
+		hs.items[i].sphere = (sphere_t){
+			.type = SPHERE,
+			.center = {test_rand(-10, 10), test_rand(-10, 10), test_rand(-10, 10)},
+			.radius = test_rand(min_radius, max_radius),
+		};
+	}
+	return hs;
+}
+
+FT_TEST(grid_matches_linear) {
+	srand(28);
+	context_t		ctx = context_default();
+	hittable_view_t hs = sphere_field(2000, 0.1, 0.3);
+
+	// one big sphere spanning many cells
+	hs.items[0].sphere.radius = 4;
+	grid_t grid = grid_build(ctx, hs);
+
+	for (u64 i = 0; i < 3000; i++) {
+		ray_t r = {
+			.origin = {test_rand(-15, 15), test_rand(-15, 15), test_rand(-15, 15)},
+			.direction = {test_rand(-1, 1), test_rand(-1, 1), test_rand(-1, 1)},
+		};
+		// axis aligned rays walk a single row of cells
+		if (i % 10 == 0) {
+			r.direction = vec3(0, 0, i % 20 == 0 ? 1 : -1);
+		}
+
+		hit_t expected = hit_many(hs, r, 0.0001, 100);
+		hit_t got = grid_hit(&grid, r, 0.0001, 100);
+
+		FT_EQ(int, got.is_hit, expected.is_hit);
+		if (expected.is_hit) {
+			FT_EQ(double, got.t, expected.t, .tol = 1e-9);
+		}
+		FT_EQ(int, grid_occluded(&grid, r, 0.0001, 100), expected.is_hit);
+	}
+
+	grid_destroy(&grid);
+	free(hs.items);
+}
+
+FT_TEST(accel_choose_by_size) {
+	srand(29);
+	hittable_view_t hs = sphere_field(1000, 0.2, 0.25);
+	FT_EQ(int, accel_choose(hs), ACCEL_GRID);
+
+	hs.items[0].sphere.radius = 100;
+	FT_EQ(int, accel_choose(hs), ACCEL_BVH);
+
+	hs.count = 10;
+	hs.items[0].sphere.radius = 0.2;
+	FT_EQ(int, accel_choose(hs), ACCEL_BVH);
+
+	free(hs.items);
+}
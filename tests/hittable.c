@@ -0,0 +1,40 @@
+#include <stdlib.h>
+#include <unistd.h>
+#define FT_TEST_DEBUG
+#include "ft_test.h"
+
+#include "../src/rt.h"
+
+FT_TEST(bounces_leave_the_surface) {
+	srand(36);
+	sphere_t ground = {SPHERE, {0, -100.5, -1}, 100};
+
+	// a convex surface can never be hit again by a ray leaving it outwards
+	u64 rehits = 0;
+	for (u64 i = 0; i < 10000; i++) {
+		ray_t r = {{0, 0, 1}, vec3_add(vec3_rand(-0.9, 0.9), vec3(0, -1, -2))};
+		hit_t hit = hit_sphere(ground, r, RAY_MINT, 1e6);
+		if (!hit.is_hit) {
+			continue;
+		}
+
+		ray_t bounce = {ray_offset_origin(hit.point, hit.normal), vec3_rand_hemisphere(hit.normal)};
+		rehits += hit_sphere(ground, bounce, 0, 1e6).is_hit;
+	}
+	FT_EQ(ulong, rehits, 0);
+}
+
+FT_TEST(sphere_roots_far_from_origin) {
+	// a small sphere far down the ray, the textbook discriminant cancels here in f32
+	sphere_t s = {SPHERE, {0, 0, -1000}, 0.25};
+
+	hit_t center = hit_sphere(s, (ray_t){{0, 0, 0}, {0, 0, -1}}, RAY_MINT, 1e6);
+	FT_EQ(int, center.is_hit, true);
+	FT_EQ(double, center.t, 999.75, .tol = 1e-3);
+
+	hit_t edge = hit_sphere(s, (ray_t){{0, 0, 0}, {0.2 / 1000, 0, -1}}, RAY_MINT, 1e6);
+	FT_EQ(int, edge.is_hit, true);
+
+	hit_t outside = hit_sphere(s, (ray_t){{0, 0, 0}, {0.3 / 1000, 0, -1}}, RAY_MINT, 1e6);
+	FT_EQ(int, outside.is_hit, false);
+}
@@ -0,0 +1,55 @@
+#include <stdlib.h>
+#include <unistd.h>
+#define FT_TEST_DEBUG
+#include "ft_test.h"
+
+#include "../src/rt.h"
+
+static f64 test_rand(f64 min, f64 max) {
+	return min + (max - min) * ((f64)rand() / RAND_MAX);
+}
+
+FT_TEST(packet_matches_single_rays) {
+	srand(30);
+	context_t		ctx = context_default();
+	hittable_view_t hs = {.items = calloc(500, sizeof(hittable_t)), .count = 500};
+	for (u64 i = 0; i < hs.count; i++) {
+		hs.items[i].sphere = (sphere_t){SPHERE, {test_rand(-5, 5), test_rand(-5, 5), test_rand(-15, -5)}, test_rand(0.1, 0.6)};
+	}
+	world_t world = {.accel = accel_build(ctx, ACCEL_BVH, hs)};
+
+	// a camera looking down -z, one 8x8 block of rays per tile of the view
+	const u64 side = 8;
+	ray_t	  rays[side * side];
+	hit_t	  hits[side * side];
+
+	for (u64 tile = 0; tile < 64; tile++) {
+		f64 u0 = (tile % 8) / 8. - 0.5, v0 = (tile / 8) / 8. - 0.5;
+		for (u64 y = 0; y < side; y++) {
+			for (u64 x = 0; x < side; x++) {
+				rays[y * side + x] = (ray_t){{0, 0, 1}, {u0 + x / 64., v0 + y / 64., -1}};
+			}
+		}
+
+		world_hit_block(&world, rays, side, side, 0.0001, 100, hits);
+		for (u64 i = 0; i < side * side; i++) {
+			hit_t expected = world_hit(&world, rays[i], 0.0001, 100);
+			FT_EQ(int, hits[i].is_hit, expected.is_hit);
+			FT_EQ(double, hits[i].t, expected.t, .tol = 1e-9);
+			FT_EQ(double, vec3_len(vec3_sub(hits[i].point, expected.point)), 0, .tol = 1e-9);
+			FT_EQ(double, vec3_dot(hits[i].normal, expected.normal), expected.is_hit, .tol = 1e-9);
+		}
+	}
+
+	// incoherent rays lose the frustum but must still be correct
+	for (u64 i = 0; i < side * side; i++) {
+		rays[i] = (ray_t){{test_rand(-6, 6), test_rand(-6, 6), 0}, {test_rand(-1, 1), test_rand(-1, 1), test_rand(-1, 0)}};
+	}
+	world_hit_block(&world, rays, side, side, 0.0001, 100, hits);
+	for (u64 i = 0; i < side * side; i++) {
+		FT_EQ(double, hits[i].t, world_hit(&world, rays[i], 0.0001, 100).t, .tol = 1e-9);
+	}
+
+	accel_destroy(&world.accel);
+	free(hs.items);
+}
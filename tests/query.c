@@ -0,0 +1,326 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#define FT_TEST_DEBUG
+#include "ft_test.h"
+
+#include "../src/rt.h"
+
+static f64 query_test_rand(f64 min, f64 max) {
+	return min + (max - min) * ((f64)rand() / RAND_MAX);
+}
+
+// alike spheres go in a grid, a ground sphere among them makes it a bvh
+static render_scene_t query_test_scene(context_t ctx, u64 count, bool ground) {
+	scene_t scene = scene_default(ctx);
+	for (u64 i = 0; i < count; i++) {
+		hittable_t h = {.sphere = {SPHERE, {query_test_rand(-10, 10), query_test_rand(-10, 10), query_test_rand(-10, 10)},
+								   query_test_rand(0.3, 0.5)}};
+		darr_append(&scene.prims, h);
+	}
+	if (ground) {
+		hittable_t h = {.sphere = {SPHERE, {0, -1000 - 10, 0}, 1000}};
+		darr_append(&scene.prims, h);
+	}
+	return render_scene_create(ctx, scene, null);
+}
+
+static ray_t* query_test_rays(u64 count) {
+	ray_t* rays = calloc(count, sizeof(ray_t));
+	for (u64 i = 0; i < count; i++) {
+		rays[i] = (ray_t){
+			.origin = {query_test_rand(-12, 12), query_test_rand(-12, 12), query_test_rand(-12, 12)},
+			.direction = {query_test_rand(-1, 1), query_test_rand(-1, 1), query_test_rand(-1, 1)},
+		};
+	}
+	return rays;
+}
+
+// every ray against every primitive, in the scene's order; the kernels are built per isa, so t can round differently
+static void query_test_expect(const render_scene_t* rs, const ray_t* rays, u64 count) {
+	real_t* ts = calloc(count, sizeof(real_t));
+	u32*	prim = calloc(count, sizeof(u32));
+	vec3_t* normals = calloc(count, sizeof(vec3_t));
+	bool*	occluded = calloc(count, sizeof(bool));
+	query_hit(rs, rays, count, 0.0001, 100, (query_hits_t){.t = ts, .prim = prim, .normal = normals});
+	query_occluded(rs, rays, count, 0.0001, 100, occluded);
+
+	u64 hits = 0;
+	for (u64 i = 0; i < count; i++) {
+		hit_t closest = {0};
+		u32	  closest_prim = QUERY_MISS;
+		for (u64 p = 0; p < rs->scene.prims.count; p++) {
+			hit_t h = hit_hittable(rs->scene.prims.items[p], rays[i], 0.0001, closest.is_hit ? closest.t : 100);
+			if (h.is_hit) {
+				closest = h, closest_prim = p;
+			}
+		}
+
+		hits += closest.is_hit;
+		FT_EQ(ulong, prim[i], closest_prim);
+		FT_EQ(double, ts[i], closest.is_hit ? closest.t : 100, .tol = 1e-9);
+		FT_EQ(double, normals[i].y, closest.normal.y, .tol = 1e-9);
+		FT_EQ(int, occluded[i], closest.is_hit);
+	}
+	// enough of the rays see a sphere for the comparison to mean something
+	FT_GT(ulong, hits, count / 8);
+
+	free(ts);
+	free(prim);
+	free(normals);
+	free(occluded);
+}
+
+FT_TEST(query_bvh_matches_linear) {
+	srand(47);
+	context_t	   ctx = context_default();
+	render_scene_t rs = query_test_scene(ctx, 500, true);
+	FT_EQ(int, rs.world.accel.type, ACCEL_BVH);
+
+	// not a whole number of chunks
+	const u64 count = 3 * QUERY_CHUNK + 17;
+	ray_t*	  rays = query_test_rays(count);
+	query_test_expect(&rs, rays, count);
+
+	free(rays);
+	render_scene_destroy(&rs);
+}
+
+FT_TEST(query_grid_matches_linear) {
+	srand(48);
+	context_t	   ctx = context_default();
+	render_scene_t rs = query_test_scene(ctx, 500, false);
+	FT_EQ(int, rs.world.accel.type, ACCEL_GRID);
+
+	const u64 count = 2 * QUERY_CHUNK + 5;
+	ray_t*	  rays = query_test_rays(count);
+	query_test_expect(&rs, rays, count);
+
+	free(rays);
+	render_scene_destroy(&rs);
+}
+
+FT_TEST(query_partial_outputs) {
+	srand(49);
+	context_t	   ctx = context_default();
+	render_scene_t rs = query_test_scene(ctx, 50, true);
+	ray_t*		   rays = query_test_rays(10);
+
+	// only the ids, the rest isn't written
+	u32 prim[10];
+	query_hit(&rs, rays, 10, 0.0001, 100, (query_hits_t){.prim = prim});
+	for (u64 i = 0; i < 10; i++) {
+		u32 expected;
+		bvh_hit_prim(&rs.world.accel.bvh, rays[i], 0.0001, 100, &expected);
+		FT_EQ(ulong, prim[i], expected == BVH_NO_PRIM ? QUERY_MISS : rs.world.accel.bvh.prim_ids[expected]);
+	}
+	query_hit(&rs, rays, 0, 0.0001, 100, (query_hits_t){0});
+
+	free(rays);
+	render_scene_destroy(&rs);
+}
+
+static vec3_t* query_test_points(u64 count) {
+	vec3_t* points = calloc(count, sizeof(vec3_t));
+	for (u64 i = 0; i < count; i++) {
+		// some well outside of everything
+		f64 extent = i % 8 == 0 ? 40 : 12;
+		points[i] = vec3(query_test_rand(-extent, extent), query_test_rand(-extent, extent), query_test_rand(-extent, extent));
+	}
+	return points;
+}
+
+static int query_test_cmp_u32(const void* a, const void* b) {
+	return *(const u32*)a < *(const u32*)b ? -1 : *(const u32*)a > *(const u32*)b;
+}
+
+// every point against every primitive
+static void query_test_expect_proximity(const render_scene_t* rs, const vec3_t* points, u64 count) {
+	const u32	 k = 5;
+	const real_t max_distance = 6, radius = 1.5;
+	u32*		 nearest = calloc(count * k, sizeof(u32));
+	real_t*		 distances = calloc(count * k, sizeof(real_t));
+	u64*		 offsets = calloc(count + 1, sizeof(u64));
+	query_nearest(rs, points, count, k, max_distance, nearest, distances);
+
+	u64 total = query_within(rs, points, count, radius, null, 0, offsets);
+	u32* within = calloc(total + 1, sizeof(u32));
+	FT_EQ(ulong, query_within(rs, points, count, radius, within, total, offsets), total);
+	FT_EQ(ulong, offsets[count], total);
+
+	u64 found = 0, misses = 0;
+	for (u64 i = 0; i < count; i++) {
+		// nearest first, and nothing left out closer than the last kept
+		for (u32 j = 0; j < k; j++) {
+			if (nearest[i * k + j] == QUERY_MISS) {
+				misses++;
+				FT_EQ(double, distances[i * k + j], max_distance, .tol = 0);
+				continue;
+			}
+			FT_EQ(double, distances[i * k + j], distance_hittable(rs->scene.prims.items[nearest[i * k + j]], points[i]), .tol = 1e-9);
+			FT_LT(double, distances[i * k + j], max_distance);
+			if (j > 0) {
+				FT_GE(double, distances[i * k + j], distances[i * k + j - 1]);
+			}
+		}
+
+		u64 closer = 0, inside = 0;
+		for (u64 p = 0; p < rs->scene.prims.count; p++) {
+			real_t d = distance_hittable(rs->scene.prims.items[p], points[i]);
+			closer += d < distances[i * k + k - 1];
+			inside += d <= radius;
+		}
+		FT_LE(ulong, closer, k);
+
+		// the same set, in whatever order
+		u64 row = offsets[i + 1] - offsets[i];
+		FT_EQ(ulong, row, inside);
+		qsort(within + offsets[i], row, sizeof(u32), query_test_cmp_u32);
+		for (u64 j = 0; j < row; j++) {
+			FT_LE(double, distance_hittable(rs->scene.prims.items[within[offsets[i] + j]], points[i]), radius);
+			if (j > 0) {
+				FT_GT(ulong, within[offsets[i] + j], within[offsets[i] + j - 1]);
+			}
+		}
+		found += row;
+	}
+	// neither kind of query came back empty handed everywhere
+	FT_GT(ulong, found, 0);
+	FT_LT(ulong, misses, count * k);
+	FT_GT(ulong, misses, 0);
+
+	// over capacity, only the offsets
+	if (total > 0) {
+		within[0] = QUERY_MISS;
+		FT_EQ(ulong, query_within(rs, points, count, radius, within, total - 1, offsets), total);
+		FT_EQ(ulong, within[0], QUERY_MISS);
+	}
+
+	free(within);
+	free(offsets);
+	free(distances);
+	free(nearest);
+}
+
+FT_TEST(query_bvh_proximity) {
+	srand(50);
+	context_t	   ctx = context_default();
+	render_scene_t rs = query_test_scene(ctx, 500, true);
+	FT_EQ(int, rs.world.accel.type, ACCEL_BVH);
+
+	vec3_t* points = query_test_points(300);
+	query_test_expect_proximity(&rs, points, 300);
+
+	free(points);
+	render_scene_destroy(&rs);
+}
+
+FT_TEST(query_grid_proximity) {
+	srand(51);
+	context_t	   ctx = context_default();
+	render_scene_t rs = query_test_scene(ctx, 500, false);
+	FT_EQ(int, rs.world.accel.type, ACCEL_GRID);
+
+	vec3_t* points = query_test_points(300);
+	query_test_expect_proximity(&rs, points, 300);
+
+	free(points);
+	render_scene_destroy(&rs);
+}
+
+static int query_test_cmp_crossing(const void* a, const void* b) {
+	real_t ta = ((const crossing_t*)a)->t, tb = ((const crossing_t*)b)->t;
+	return ta < tb ? -1 : ta > tb;
+}
+
+// every crossing of every primitive, sorted
+static void query_test_expect_all(const render_scene_t* rs, const ray_t* rays, u64 count, u32 k) {
+	crossing_t* out = calloc(count * k, sizeof(crossing_t));
+	u32*		counts = calloc(count, sizeof(u32));
+	crossing_t* expected = calloc(2 * rs->scene.prims.count, sizeof(crossing_t));
+	query_hit_all(rs, rays, count, 0.0001, 100, k, out, counts);
+
+	u64 several = 0;
+	for (u64 i = 0; i < count; i++) {
+		u32 total = 0;
+		for (u64 p = 0; p < rs->scene.prims.count; p++) {
+			u32 n = crossings_hittable(rs->scene.prims.items[p], rays[i], 0.0001, 100, expected + total);
+			for (u32 c = 0; c < n; c++) {
+				expected[total++].prim = p;
+			}
+		}
+		qsort(expected, total, sizeof(crossing_t), query_test_cmp_crossing);
+
+		FT_EQ(ulong, counts[i], total < k ? total : k);
+		for (u32 c = 0; c < counts[i]; c++) {
+			FT_EQ(double, out[i * k + c].t, expected[c].t, .tol = 1e-9);
+			FT_EQ(ulong, out[i * k + c].prim, expected[c].prim);
+			FT_EQ(int, out[i * k + c].entering, expected[c].entering);
+		}
+		several += counts[i] > 2;
+	}
+	// rays that go through more than one sphere
+	FT_GT(ulong, several, 0);
+
+	free(expected);
+	free(counts);
+	free(out);
+}
+
+FT_TEST(query_bvh_hit_all) {
+	srand(52);
+	context_t	   ctx = context_default();
+	render_scene_t rs = query_test_scene(ctx, 500, true);
+	ray_t*		   rays = query_test_rays(300);
+
+	query_test_expect_all(&rs, rays, 300, 3);
+	query_test_expect_all(&rs, rays, 300, 2 * rs.scene.prims.count);
+
+	free(rays);
+	render_scene_destroy(&rs);
+}
+
+FT_TEST(query_grid_hit_all) {
+	srand(53);
+	context_t	   ctx = context_default();
+	render_scene_t rs = query_test_scene(ctx, 500, false);
+	FT_EQ(int, rs.world.accel.type, ACCEL_GRID);
+	ray_t* rays = query_test_rays(300);
+
+	query_test_expect_all(&rs, rays, 300, 3);
+	query_test_expect_all(&rs, rays, 300, 2 * rs.scene.prims.count);
+
+	free(rays);
+	render_scene_destroy(&rs);
+}
+
+// baked queries have no scene to go with them, these answer for the one under test
+static hittable_view_t query_test_baked_prims;
+
+static hit_t query_test_baked_hit(ray_t r, real_t mint, real_t maxt) {
+	return hit_many(query_test_baked_prims, r, mint, maxt);
+}
+
+static bool query_test_baked_occluded(ray_t r, real_t mint, real_t maxt) {
+	return occluded_many(query_test_baked_prims, r, mint, maxt);
+}
+
+FT_TEST(query_baked_matches_linear) {
+	srand(54);
+	context_t	   ctx = context_default();
+	render_scene_t rs = query_test_scene(ctx, 200, true);
+	accel_destroy(&rs.world.accel);
+	rs.world.accel = (accel_t){.type = ACCEL_BAKED, .baked = {query_test_baked_hit, query_test_baked_occluded}};
+	query_test_baked_prims = (hittable_view_t)view_darr(rs.scene.prims);
+
+	const u64 count = QUERY_CHUNK + 9;
+	ray_t*	  rays = query_test_rays(count);
+	vec3_t*	  points = query_test_points(300);
+	query_test_expect(&rs, rays, count);
+	query_test_expect_all(&rs, rays, count, 3);
+	query_test_expect_proximity(&rs, points, 300);
+
+	free(points);
+	free(rays);
+	render_scene_destroy(&rs);
+}
@@ -0,0 +1,111 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#define FT_TEST_DEBUG
+#include "ft_test.h"
+
+#include "../src/rt.h"
+
+static error_t parse(const char* text, scene_t* out) {
+	return scene_parse(context_default(), (const u8*)text, strlen(text), out);
+}
+
+FT_TEST(scene_statements) {
+	scene_t scene;
+	FT_EQ(cmp,
+		  parse("# comment\n"
+				"camera 1 2 3  4 5\n"
+				"image 64 32\r\n"
+				"\tsamples 3  # trailing comment\n"
+				"bounces 0\n"
+				"\n"
+				"sphere 0 -100.5 -1 100\n"
+				"sphere 1e-3 -.25 +7 0.4",
+				&scene),
+		  NO_ERROR);
+
+	FT_EQ(double, scene.camera.center.x, 1, .tol = 0);
+	FT_EQ(double, scene.camera.center.z, 3, .tol = 0);
+	FT_EQ(double, scene.camera.focal_length, 4, .tol = 0);
+	FT_EQ(double, scene.camera.viewport_height, 5, .tol = 0);
+	FT_EQ(ulong, scene.width, 64);
+	FT_EQ(ulong, scene.height, 32);
+	FT_EQ(ulong, scene.samples, 3);
+	FT_EQ(ulong, scene.bounces, 0);
+
+	FT_EQ(ulong, scene.prims.count, 2);
+	FT_EQ(double, scene.prims.items[0].sphere.center.y, -100.5, .tol = 0);
+	FT_EQ(double, scene.prims.items[0].sphere.radius, 100, .tol = 0);
+
+	// the fast path rounds like the compiler does for the same literal
+	FT_EQ(double, scene.prims.items[1].sphere.center.x, (real_t)1e-3, .tol = 0);
+	FT_EQ(double, scene.prims.items[1].sphere.center.y, (real_t)-.25, .tol = 0);
+	FT_EQ(double, scene.prims.items[1].sphere.center.z, 7, .tol = 0);
+	FT_EQ(double, scene.prims.items[1].sphere.radius, (real_t)0.4, .tol = 0);
+
+	scene_destroy(&scene);
+}
+
+FT_TEST(scene_defaults) {
+	scene_t scene;
+	FT_EQ(cmp, parse("sphere 0 0 -1 0.5\n", &scene), NO_ERROR);
+
+	scene_t expected = scene_default(context_default());
+	FT_EQ(ulong, scene.width, expected.width);
+	FT_EQ(ulong, scene.samples, expected.samples);
+	FT_EQ(ulong, scene.bounces, expected.bounces);
+	FT_EQ(ulong, scene.prims.count, 1);
+
+	scene_destroy(&scene);
+}
+
+FT_TEST(scene_errors) {
+	scene_t scene;
+	FT_EQ(cmp, parse("sphere 0 0 -1 0.5\ncube 1\n", &scene), SCENE_UNKNOWN_KEYWORD);
+	FT_EQ(ulong, scene.error_line, 2);
+
+	FT_EQ(cmp, parse("\n\nsphere 0 0 -1\n", &scene), SCENE_SYNTAX_ERROR);
+	FT_EQ(ulong, scene.error_line, 3);
+
+	FT_EQ(cmp, parse("sphere 0 0 -1 0.5 2\n", &scene), SCENE_SYNTAX_ERROR);
+	FT_EQ(cmp, parse("sphere 0 0 -1 -0.5\n", &scene), SCENE_SYNTAX_ERROR);
+	FT_EQ(cmp, parse("sphere 0 0 -1 0.5x\n", &scene), SCENE_SYNTAX_ERROR);
+	FT_EQ(cmp, parse("image 256.5 144\n", &scene), SCENE_SYNTAX_ERROR);
+	FT_EQ(cmp, parse("samples 0\n", &scene), SCENE_SYNTAX_ERROR);
+	FT_EQ(cmp, parse("bounces -1\n", &scene), SCENE_SYNTAX_ERROR);
+
+	// strtod reads these, they are not numbers a scene can use
+	FT_EQ(cmp, parse("sphere nan 0 -1 0.5\n", &scene), SCENE_SYNTAX_ERROR);
+	FT_EQ(cmp, parse("sphere 0 inf -1 0.5\n", &scene), SCENE_SYNTAX_ERROR);
+	FT_EQ(cmp, parse("camera 0 0 1 infinity 2\n", &scene), SCENE_SYNTAX_ERROR);
+	FT_EQ(cmp, parse("sphere 0 0 -1 1e999\n", &scene), SCENE_SYNTAX_ERROR);
+}
+
+FT_TEST(scene_load_default) {
+	scene_t scene;
+	FT_EQ(cmp, scene_load(context_default(), "scenes/default.scene", &scene), NO_ERROR);
+	FT_EQ(ulong, scene.prims.count, 3);
+	FT_EQ(cmp, scene_load(context_default(), "scenes/missing.scene", &scene), FILE_OPEN_ERROR);
+	scene_destroy(&scene);
+}
+
+FT_TEST(scene_load_empty) {
+	// nothing but the defaults, from an empty file and from one of only comments
+	char path[] = "/tmp/scene_XXXXXX";
+	int	 fd = mkstemp(path);
+	FT_GE(int, fd, 0);
+
+	scene_t scene;
+	FT_EQ(cmp, scene_load(context_default(), path, &scene), NO_ERROR);
+	FT_EQ(ulong, scene.prims.count, 0);
+	FT_EQ(ulong, scene.width, scene_default(context_default()).width);
+	scene_destroy(&scene);
+
+	FT_EQ(cmp, file_write_all(fd, "# nothing yet\n", 14), NO_ERROR);
+	FT_EQ(cmp, scene_load(context_default(), path, &scene), NO_ERROR);
+	FT_EQ(ulong, scene.prims.count, 0);
+	scene_destroy(&scene);
+
+	close(fd);
+	unlink(path);
+}
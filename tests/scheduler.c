@@ -0,0 +1,147 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#define FT_TEST_DEBUG
+#include "ft_test.h"
+
+#include "../src/rt.h"
+#include "test_scene.h"
+
+static const char* scheduler_test_scene = "image 32 32\n"
+										  "samples 1\n"
+										  "bounces 1\n"
+										  "sphere 0 0 -1 0.5\n"
+										  "sphere 0 -100.5 -1 100\n";
+
+// a job of 4 tiles of 16 x 16 over the shared scene
+typedef struct {
+	render_job_t job;
+	image_t*	 img;
+} scheduler_test_job_t;
+
+static scheduler_test_job_t scheduler_test_job(context_t ctx, const render_scene_t* rs) {
+	return (scheduler_test_job_t){
+		.job = render_job_create(ctx, rs, RENDER_PACKETS),
+		.img = image_create(ctx, rs->scene.width, rs->scene.height),
+	};
+}
+
+static void scheduler_test_job_destroy(scheduler_test_job_t* t) {
+	render_job_destroy(&t->job);
+	image_destroy(t->img);
+}
+
+FT_TEST(scheduler_priority_preempts_between_tiles) {
+	context_t	   ctx = context_default();
+	render_scene_t rs;
+	FT_EQ(cmp, test_scene_create(ctx, scheduler_test_scene, &rs), NO_ERROR);
+
+	scheduler_test_job_t batch = scheduler_test_job(ctx, &rs);
+	scheduler_test_job_t preview = scheduler_test_job(ctx, &rs);
+	scheduler_t			 s = scheduler_create(ctx);
+
+	u64 batch_id = scheduler_submit(&s, &batch.job, batch.img, (sched_params_t){0});
+	FT_EQ(ulong, scheduler_step(&s), batch_id);
+	FT_EQ(ulong, scheduler_job(&s, batch_id)->tiles_done, 1);
+
+	// every tile of the preview before the batch's next one, and the batch keeps its first
+	u64 preview_id = scheduler_submit(&s, &preview.job, preview.img, (sched_params_t){.priority = 1});
+	sched_stats_t stats = scheduler_stats(&s);
+	FT_EQ(ulong, stats.jobs_queued, 2);
+	FT_EQ(ulong, stats.tiles_queued, 3 + 4);
+	for (u32 i = 0; i < 4; i++) {
+		FT_EQ(ulong, scheduler_step(&s), preview_id);
+	}
+	FT_EQ(int, scheduler_job(&s, preview_id)->done, true);
+	FT_EQ(ulong, scheduler_job(&s, batch_id)->tiles_done, 1);
+
+	for (u32 i = 0; i < 3; i++) {
+		FT_EQ(ulong, scheduler_step(&s), batch_id);
+	}
+	FT_EQ(ulong, scheduler_step(&s), 0);
+	FT_EQ(int, scheduler_job(&s, batch_id)->done, true);
+	FT_EQ(ulong, scheduler_stats(&s).tiles_done, 8);
+	FT_EQ(ulong, scheduler_stats(&s).jobs_queued, 0);
+	FT_GT(double, sched_job_throughput(scheduler_job(&s, preview_id)), 0);
+
+	// interleaved, the images are the same as rendered alone
+	FT_EQ(int, memcmp(batch.img->data, preview.img->data, 32 * 32 * sizeof(color_t)), 0);
+
+	scheduler_remove(&s, preview_id);
+	FT_EQ(int, scheduler_job(&s, preview_id) == null, true);
+	FT_EQ(int, scheduler_job(&s, batch_id) != null, true);
+
+	scheduler_destroy(&s);
+	scheduler_test_job_destroy(&preview);
+	scheduler_test_job_destroy(&batch);
+	render_scene_destroy(&rs);
+}
+
+FT_TEST(scheduler_weighted_share) {
+	context_t	   ctx = context_default();
+	render_scene_t rs;
+	FT_EQ(cmp, test_scene_create(ctx, scheduler_test_scene, &rs), NO_ERROR);
+
+	scheduler_test_job_t heavy = scheduler_test_job(ctx, &rs);
+	scheduler_test_job_t light = scheduler_test_job(ctx, &rs);
+	scheduler_t			 s = scheduler_create(ctx);
+
+	// one pixel tiles so the share has many tiles to even out over
+	heavy.job.tile_w = heavy.job.tile_h = 1;
+	light.job.tile_w = light.job.tile_h = 1;
+	u64 heavy_id = scheduler_submit(&s, &heavy.job, heavy.img, (sched_params_t){.weight = 3});
+	u64 light_id = scheduler_submit(&s, &light.job, light.img, (sched_params_t){.weight = 1});
+
+	// tiles cost about the same, so the time split shows up in the tile counts
+	for (u32 i = 0; i < 400; i++) {
+		scheduler_step(&s);
+	}
+	const sched_job_t* h = scheduler_job(&s, heavy_id);
+	const sched_job_t* l = scheduler_job(&s, light_id);
+	FT_EQ(ulong, h->tiles_done + l->tiles_done, 400);
+	FT_GT(double, h->busy / l->busy, 2.0);
+	FT_LT(double, h->busy / l->busy, 4.5);
+
+	while (scheduler_step(&s) != 0) {
+	}
+	FT_EQ(int, h->done && l->done, true);
+
+	scheduler_destroy(&s);
+	scheduler_test_job_destroy(&light);
+	scheduler_test_job_destroy(&heavy);
+	render_scene_destroy(&rs);
+}
+
+FT_TEST(scheduler_deadline) {
+	context_t	   ctx = context_default();
+	render_scene_t rs;
+	FT_EQ(cmp, test_scene_create(ctx, scheduler_test_scene, &rs), NO_ERROR);
+
+	scheduler_test_job_t first = scheduler_test_job(ctx, &rs);
+	scheduler_test_job_t urgent = scheduler_test_job(ctx, &rs);
+	scheduler_test_job_t relaxed = scheduler_test_job(ctx, &rs);
+	scheduler_t			 s = scheduler_create(ctx);
+
+	u64 first_id = scheduler_submit(&s, &first.job, first.img, (sched_params_t){0});
+	scheduler_step(&s);
+
+	// at the same priority, a deadline that can't wait for its share goes first, a far one doesn't
+	u64 relaxed_id = scheduler_submit(&s, &relaxed.job, relaxed.img, (sched_params_t){.deadline = time_now() + 3600});
+	u64 urgent_id = scheduler_submit(&s, &urgent.job, urgent.img, (sched_params_t){.deadline = time_now()});
+	for (u32 i = 0; i < 4; i++) {
+		FT_EQ(ulong, scheduler_step(&s), urgent_id);
+	}
+
+	// the rest share, the far deadline is not ahead of the job submitted before it
+	FT_EQ(ulong, scheduler_step(&s), first_id);
+	while (scheduler_step(&s) != 0) {
+	}
+	FT_EQ(int, scheduler_job(&s, relaxed_id)->done, true);
+	FT_EQ(int, scheduler_job(&s, first_id)->done, true);
+
+	scheduler_destroy(&s);
+	scheduler_test_job_destroy(&relaxed);
+	scheduler_test_job_destroy(&urgent);
+	scheduler_test_job_destroy(&first);
+	render_scene_destroy(&rs);
+}
@@ -0,0 +1,89 @@
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#define FT_TEST_DEBUG
+#include "ft_test.h"
+
+#include "../src/rt.h"
+
+typedef struct {
+	u64	 calls, last_index;
+	bool in_order;
+} server_test_tiles_t;
+
+// rendered a band at a time, the tiles still count through the whole image
+static void server_test_count_tile(void* user, const image_t* img, render_tile_t tile) {
+	server_test_tiles_t* t = user;
+	t->in_order = t->in_order && tile.count == 3 * 2 && tile.index == t->last_index % tile.count + 1 &&
+				  tile.y == (tile.index - 1) / 3 * TILE_SIZE && tile.y + tile.h <= img->h;
+	t->last_index = tile.index;
+	t->calls++;
+}
+
+FT_TEST(server_streams_tiles) {
+	context_t ctx = context_default();
+
+	char scene_path[] = "/tmp/server_scene_XXXXXX";
+	int	 scene_fd = mkstemp(scene_path);
+	// one bounce, so the image doesn't depend on rand and can be compared with a local render
+	const char* text = "image 40 24\nsamples 2\nbounces 1\nsphere 0 0 -1 0.5\nsphere 0 -100.5 -1 100\n";
+	FT_EQ(cmp, file_write_all(scene_fd, text, strlen(text)), NO_ERROR);
+	close(scene_fd);
+
+	char socket_path[] = "/tmp/server_socket_XXXXXX";
+	close(mkstemp(socket_path));
+
+	// listening before the fork, so the client can't connect too early
+	server_t server = {0};
+	FT_EQ(cmp, server_create(ctx, socket_path, &server), NO_ERROR);
+	pid_t pid = fork();
+	if (pid == 0) {
+		server_serve_one(&server);
+		_exit(server.requests == 3 && server.scene_loads == 1 ? 0 : 1);
+	}
+	close(server.listen_fd);
+
+	int fd = -1;
+	FT_EQ(cmp, client_connect(socket_path, &fd), NO_ERROR);
+
+	// the same scene twice on one connection, loaded once
+	image_t*			remote[2];
+	server_test_tiles_t tiles = {.in_order = true};
+	for (u32 i = 0; i < 2; i++) {
+		server_request_t request = {.mode = RENDER_PACKETS, .bounces = -1};
+		FT_EQ(cmp, client_render(ctx, fd, request, scene_path, &remote[i], server_test_count_tile, &tiles), NO_ERROR);
+	}
+	FT_EQ(ulong, tiles.calls, 2 * 3 * 2);
+	FT_EQ(int, tiles.in_order, true);
+
+	scene_t scene;
+	FT_EQ(cmp, scene_load(ctx, scene_path, &scene), NO_ERROR);
+	render_scene_t rs = render_scene_create(ctx, scene, null);
+	render_job_t   job = render_job_create(ctx, &rs, RENDER_PACKETS);
+	image_t*	   local = image_create(ctx, rs.scene.width, rs.scene.height);
+	render_job_run(&job, local);
+
+	FT_EQ(ulong, remote[0]->w, local->w);
+	FT_EQ(ulong, remote[0]->h, local->h);
+	FT_EQ(buffer, remote[0]->data, local->data, .size = local->w * local->h * sizeof(color_t));
+	FT_EQ(buffer, remote[1]->data, local->data, .size = local->w * local->h * sizeof(color_t));
+
+	// errors come back as the request's result and the connection stays usable for the next one
+	image_t* missing;
+	FT_EQ(cmp, client_render(ctx, fd, (server_request_t){0}, "/tmp/no_such.scene", &missing, null, null), FILE_OPEN_ERROR);
+	FT_EQ(int, missing == null, true);
+	close(fd);
+
+	int status;
+	waitpid(pid, &status, 0);
+	FT_EQ(int, WIFEXITED(status) && WEXITSTATUS(status) == 0, true);
+
+	image_destroy(local);
+	image_destroy(remote[0]);
+	image_destroy(remote[1]);
+	render_job_destroy(&job);
+	render_scene_destroy(&rs);
+	unlink(scene_path);
+	unlink(socket_path);
+}
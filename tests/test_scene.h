@@ -0,0 +1,18 @@
+#ifndef TEST_SCENE_H
+#define TEST_SCENE_H
+
+#include <string.h>
+
+#include "../src/rt.h"
+
+// a render scene from the text of a scene file and no bvh cache, shared by the
+// tests that render; the error is the caller's to check, FT_EQ only returns from a test
+static inline error_t test_scene_create(context_t ctx, const char* text, render_scene_t* out) {
+	scene_t scene;
+	error_t err;
+	try (err = scene_parse(ctx, (const u8*)text, strlen(text), &scene)) or_return err;
+	*out = render_scene_create(ctx, scene, null);
+	return NO_ERROR;
+}
+
+#endif
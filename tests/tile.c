@@ -0,0 +1,69 @@
+#include <stdlib.h>
+#include <unistd.h>
+#define FT_TEST_DEBUG
+#include "ft_test.h"
+
+#include "../src/rt.h"
+
+static f64 test_rand(f64 min, f64 max) {
+	return min + (max - min) * ((f64)rand() / RAND_MAX);
+}
+
+FT_TEST(tile_list_matches_full_scan) {
+	srand(34);
+	const u64		count = 2000;
+	hittable_view_t hs = {.items = calloc(count, sizeof(hittable_t)), .count = count};
+	for (u64 i = 0; i < count; i++) {
+		hs.items[i].sphere = (sphere_t){
+			.type = SPHERE,
+			.center = {test_rand(-10, 10), test_rand(-10, 10), test_rand(-10, 10)},
+			.radius = test_rand(0.05, 0.5),
+		};
+	}
+
+	// a small tile of an image plane one unit in front of a camera in the middle of the field
+	vec3_t origin = vec3(0, 0, 0);
+	vec3_t corner = vec3(0.2, -0.1, -1);
+	vec3_t edge_u = vec3(0.1, 0, 0);
+	vec3_t edge_v = vec3(0, 0.15, 0);
+
+	frustum_t	f = frustum_create(origin, corner, edge_u, edge_v);
+	hittable_t* list = calloc(count, sizeof(hittable_t));
+	u64			list_count = tile_cull(&f, hs, list);
+
+	FT_LT(ulong, list_count, count / 4);
+
+	// the per kind arrays keep the same primitives
+	context_t	   ctx = context_default();
+	hittable_set_t all = hittable_set_build(ctx, hs);
+	hittable_set_t tile_set = hittable_set_build(ctx, hs);
+	FT_EQ(ulong, tile_cull_set(&f, &all, &tile_set), list_count);
+
+	for (u64 i = 0; i < 1000; i++) {
+		vec3_t target = corner;
+		vec3p_add(&target, vec3_mul(edge_u, test_rand(0, 1)));
+		vec3p_add(&target, vec3_mul(edge_v, test_rand(0, 1)));
+		ray_t  r = {origin, vec3_sub(target, origin)};
+
+		hit_t expected = hit_many(hs, r, 0.0001, 100);
+		hit_t got = hit_many((hittable_view_t){list, list_count}, r, 0.0001, 100);
+		FT_EQ(int, got.is_hit, expected.is_hit);
+		if (expected.is_hit) {
+			FT_EQ(double, got.t, expected.t, .tol = 0);
+		}
+
+		hit_t from_set = hit_set(&tile_set, r, 0.0001, 100);
+		FT_EQ(int, from_set.is_hit, expected.is_hit);
+		FT_EQ(double, from_set.t, expected.t, .tol = 0);
+		FT_EQ(int, occluded_set(&all, r, 0.0001, 100), expected.is_hit);
+	}
+
+	// right behind the camera, inside the pyramid's mirror image
+	hittable_t behind = {.sphere = {SPHERE, {-2.5, 1.25, 10}, 0.5}};
+	FT_EQ(int, frustum_culls_hittable(&f, behind), true);
+
+	hittable_set_destroy(&all);
+	hittable_set_destroy(&tile_set);
+	free(list);
+	free(hs.items);
+}
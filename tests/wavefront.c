@@ -0,0 +1,100 @@
+#include <stdlib.h>
+#include <unistd.h>
+#define FT_TEST_DEBUG
+#include "ft_test.h"
+
+#include "../src/rt.h"
+
+FT_TEST(wavefront_escaping_rays_see_the_sky) {
+	context_t ctx = context_default();
+	world_t	  world = {.accel = accel_build(ctx, ACCEL_BVH, (hittable_view_t){0})};
+
+	// more rays than the queue holds, so the batches wrap around
+	const u64	count = 10;
+	ray_t		rays[count];
+	u32			pixels[count];
+	vec3_t		accum[2] = {0};
+	wavefront_t wf = wavefront_create(ctx, 4);
+
+	for (u64 i = 0; i < count; i++) {
+		rays[i] = (ray_t){{0, 0, 0}, {0, i % 2 ? 1 : -1, 0}};
+		pixels[i] = i % 2;
+	}
+	wavefront_render(&wf, &world, rays, pixels, count, 10, accum);
+
+	vec3_t down = sky_color(vec3(0, -1, 0));
+	vec3_t up = sky_color(vec3(0, 1, 0));
+	FT_EQ(double, accum[0].z, down.z * count / 2, .tol = 1e-12);
+	FT_EQ(double, accum[1].z, up.z * count / 2, .tol = 1e-12);
+
+	wavefront_destroy(&wf);
+	accel_destroy(&world.accel);
+}
+
+FT_TEST(wavefront_paths_end_at_max_bounces) {
+	context_t  ctx = context_default();
+	hittable_t sphere = {.sphere = {SPHERE, {0, 0, -3}, 1}};
+	world_t	   world = {.accel = accel_build(ctx, ACCEL_BVH, (hittable_view_t){&sphere, 1})};
+
+	ray_t		ray = {{0, 0, 0}, {0, 0, -1}};
+	u32			pixel = 0;
+	vec3_t		accum = {0};
+	wavefront_t wf = wavefront_create(ctx, 1);
+
+	// the only bounce allowed is used up by the hit, nothing reaches the sky
+	wavefront_render(&wf, &world, &ray, &pixel, 1, 1, &accum);
+	FT_EQ(double, vec3_len(accum), 0, .tol = 0);
+
+	// with one more the bounce off the front of the sphere escapes at half weight
+	wavefront_render(&wf, &world, &ray, &pixel, 1, 2, &accum);
+	FT_GT(double, accum.z, 0.25);
+	FT_LT(double, accum.z, 0.5 + 1e-12);
+
+	wavefront_destroy(&wf);
+	accel_destroy(&world.accel);
+}
+
+FT_TEST(wavefront_reorder_keeps_every_path) {
+	context_t  ctx = context_default();
+	hittable_t sphere = {.sphere = {SPHERE, {0, 0, 0}, 1}};
+	world_t	   world = {.accel = accel_build(ctx, ACCEL_BVH, (hittable_view_t){&sphere, 1})};
+
+	// rays from all around hit the sphere once, then bounce away from it to the sky
+	const u64	count = 64;
+	ray_t		rays[count];
+	u32			pixels[count];
+	vec3_t		accum[count];
+	wavefront_t wf = wavefront_create(ctx, count);
+	wf.reorder = true;
+
+	for (u64 i = 0; i < count; i++) {
+		vec3_t origin = vec3_mul(vec3_rand_unit(), 3);
+		rays[i] = (ray_t){origin, vec3_neg(origin)};
+		pixels[i] = i;
+		accum[i] = (vec3_t){0};
+	}
+	wavefront_render(&wf, &world, rays, pixels, count, 2, accum);
+
+	for (u64 i = 0; i < count; i++) {
+		FT_GT(double, accum[i].z, 0.25);
+		FT_LT(double, accum[i].z, 0.5 + 1e-12);
+	}
+	FT_GT(double, wf.sort_seconds, 0);
+
+	wavefront_destroy(&wf);
+	accel_destroy(&world.accel);
+}
+
+FT_TEST(ray_sort_key_groups_by_octant_then_origin) {
+	aabb_t bounds = {{0, 0, 0}, {8, 8, 8}};
+
+	u32 a = ray_sort_key((ray_t){{1, 1, 1}, {1, 1, 1}}, bounds);
+	u32 b = ray_sort_key((ray_t){{1.01, 1, 1}, {1, 1, 1}}, bounds);
+	u32 c = ray_sort_key((ray_t){{7, 7, 7}, {1, 1, 1}}, bounds);
+	u32 d = ray_sort_key((ray_t){{1, 1, 1}, {1, 1, -1}}, bounds);
+
+	// nearby origins sort closer together than far ones, any change of octant sorts after all of them
+	FT_LT(ulong, b - a, c - a);
+	FT_GT(ulong, d, c);
+	FT_EQ(ulong, d >> (3 * RAY_SORT_BITS), 1);
+}